@@ -0,0 +1,79 @@
+//*****************************************************************************
+//
+//	Copyright 2017 Microsoft Corporation
+//
+//	Licensed under the Apache License, Version 2.0 (the "License");
+//	you may not use this file except in compliance with the License.
+//	You may obtain a copy of the License at
+//
+//	http ://www.apache.org/licenses/LICENSE-2.0
+//
+//	Unless required by applicable law or agreed to in writing, software
+//	distributed under the License is distributed on an "AS IS" BASIS,
+//	WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//	See the License for the specific language governing permissions and
+//	limitations under the License.
+//
+//*****************************************************************************
+
+
+#include "pch.h"
+#include "AudioPriorityScheduler.h"
+#include <chrono>
+
+using namespace FFmpegInterop;
+
+AudioPriorityScheduler::AudioPriorityScheduler()
+	: m_isStarving(false)
+	, m_videoYields(0)
+{
+}
+
+void AudioPriorityScheduler::SetAudioBuffer(int64_t buffered, int64_t target, bool hasInput)
+{
+	// In trouble below half of the target, recovered at three quarters. The gap keeps video
+	// from flapping between yielding and running at the edge. While audio waits on the source
+	// the state is left as it is, e.g. at the live edge the queue never fills up.
+	std::lock_guard<std::mutex> lock(m_mutex);
+	if (!m_isStarving && buffered * 2 < target && hasInput)
+	{
+		m_isStarving = true;
+	}
+	else if (m_isStarving && buffered * 4 >= target * 3)
+	{
+		m_isStarving = false;
+		m_audioRecovered.notify_all();
+	}
+}
+
+void AudioPriorityScheduler::SetAudioIdle()
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	m_isStarving = false;
+	m_audioRecovered.notify_all();
+}
+
+bool AudioPriorityScheduler::IsAudioStarving()
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	return m_isStarving;
+}
+
+bool AudioPriorityScheduler::YieldToAudio(int64_t maxWait)
+{
+	std::unique_lock<std::mutex> lock(m_mutex);
+	if (!m_isStarving)
+	{
+		return false;
+	}
+
+	m_videoYields++;
+	m_audioRecovered.wait_for(lock, std::chrono::microseconds(maxWait), [this]() { return !m_isStarving; });
+	return true;
+}
+
+uint64_t AudioPriorityScheduler::GetVideoYieldCount()
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	return m_videoYields;
+}
@@ -0,0 +1,60 @@
+//*****************************************************************************
+//
+//	Copyright 2017 Microsoft Corporation
+//
+//	Licensed under the Apache License, Version 2.0 (the "License");
+//	you may not use this file except in compliance with the License.
+//	You may obtain a copy of the License at
+//
+//	http ://www.apache.org/licenses/LICENSE-2.0
+//
+//	Unless required by applicable law or agreed to in writing, software
+//	distributed under the License is distributed on an "AS IS" BASIS,
+//	WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//	See the License for the specific language governing permissions and
+//	limitations under the License.
+//
+//*****************************************************************************
+
+
+#pragma once
+#include <condition_variable>
+#include <mutex>
+#include <stdint.h>
+
+namespace FFmpegInterop
+{
+	//////////////////////////////////////////////////////////////////////////
+	//  AudioPriorityScheduler
+	//  Description: Lets video yield the CPU to audio. The audio worker reports
+	//               how much it has decoded ahead; while that is well below its
+	//               target with input waiting to be decoded, the video worker
+	//               waits before decoding the next frame, so video drops frames
+	//               before audio glitches. A queue that is low because the
+	//               source delivers in real time is not starving.
+	//////////////////////////////////////////////////////////////////////////
+
+	class AudioPriorityScheduler
+	{
+	public:
+		AudioPriorityScheduler();
+
+		// Audio side: media decoded ahead and the target, in the same unit. hasInput tells whether
+		// packets are waiting to be decoded, without them audio waits on the source and not the CPU.
+		void SetAudioBuffer(int64_t buffered, int64_t target, bool hasInput);
+		// Audio doesn't need the CPU anymore, e.g. at the end of the stream
+		void SetAudioIdle();
+		bool IsAudioStarving();
+
+		// Video side: returns once audio is out of trouble or after maxWait microseconds.
+		// Returns true if it had to wait.
+		bool YieldToAudio(int64_t maxWait);
+		uint64_t GetVideoYieldCount();
+
+	private:
+		std::mutex m_mutex;
+		std::condition_variable m_audioRecovered;
+		bool m_isStarving;
+		uint64_t m_videoYields;
+	};
+}
@@ -0,0 +1,227 @@
+//*****************************************************************************
+//
+//	Copyright 2017 Microsoft Corporation
+//
+//	Licensed under the Apache License, Version 2.0 (the "License");
+//	you may not use this file except in compliance with the License.
+//	You may obtain a copy of the License at
+//
+//	http ://www.apache.org/licenses/LICENSE-2.0
+//
+//	Unless required by applicable law or agreed to in writing, software
+//	distributed under the License is distributed on an "AS IS" BASIS,
+//	WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//	See the License for the specific language governing permissions and
+//	limitations under the License.
+//
+//*****************************************************************************
+
+#include "pch.h"
+#include "AudioTimeStretcher.h"
+
+#if defined(_M_IX86) || defined(_M_X64)
+#include <emmintrin.h>
+#elif defined(_M_ARM) || defined(_M_ARM64)
+#include <arm_neon.h>
+#endif
+
+using namespace FFmpegInterop;
+
+// Crossfade length and search range (ms). Short blocks keep the CPU cost low and still cover
+// the pitch period of voices and most instruments.
+const int OVERLAPDURATION = 10;
+const int SEARCHDURATION = 5;
+// Positions compared in the first pass of the search, the best one is refined sample by sample
+const int COARSESEARCHSTEP = 4;
+// Samples are scaled down before multiplying and the sum is moved to 64 bit after this many
+// vector iterations, so the 32 bit lanes can't overflow
+const int CORRELATIONSHIFT = 5;
+const int CORRELATIONBLOCK = 256;
+
+// Cross-correlation of two blocks of interleaved samples
+static int64_t Correlate(const int16_t* a, const int16_t* b, int count)
+{
+	int64_t sum = 0;
+	int i = 0;
+
+#if defined(_M_IX86) || defined(_M_X64)
+	while (i + 8 <= count)
+	{
+		__m128i acc = _mm_setzero_si128();
+		for (int block = 0; block < CORRELATIONBLOCK && i + 8 <= count; block++, i += 8)
+		{
+			__m128i va = _mm_srai_epi16(_mm_loadu_si128((const __m128i*)(a + i)), CORRELATIONSHIFT);
+			__m128i vb = _mm_srai_epi16(_mm_loadu_si128((const __m128i*)(b + i)), CORRELATIONSHIFT);
+			acc = _mm_add_epi32(acc, _mm_madd_epi16(va, vb));
+		}
+		acc = _mm_add_epi32(acc, _mm_shuffle_epi32(acc, _MM_SHUFFLE(1, 0, 3, 2)));
+		acc = _mm_add_epi32(acc, _mm_shuffle_epi32(acc, _MM_SHUFFLE(2, 3, 0, 1)));
+		sum += _mm_cvtsi128_si32(acc);
+	}
+#elif defined(_M_ARM) || defined(_M_ARM64)
+	while (i + 8 <= count)
+	{
+		int32x4_t acc = vdupq_n_s32(0);
+		for (int block = 0; block < CORRELATIONBLOCK && i + 8 <= count; block++, i += 8)
+		{
+			int16x8_t va = vshrq_n_s16(vld1q_s16(a + i), CORRELATIONSHIFT);
+			int16x8_t vb = vshrq_n_s16(vld1q_s16(b + i), CORRELATIONSHIFT);
+			acc = vmlal_s16(acc, vget_low_s16(va), vget_low_s16(vb));
+			acc = vmlal_s16(acc, vget_high_s16(va), vget_high_s16(vb));
+		}
+		sum += vgetq_lane_s32(acc, 0) + vgetq_lane_s32(acc, 1) + vgetq_lane_s32(acc, 2) + vgetq_lane_s32(acc, 3);
+	}
+#endif
+
+	for (; i < count; i++)
+	{
+		sum += (a[i] >> CORRELATIONSHIFT) * (b[i] >> CORRELATIONSHIFT);
+	}
+
+	return sum;
+}
+
+AudioTimeStretcher::AudioTimeStretcher(int sampleRate, int channels)
+	: m_channels(channels)
+	, m_overlapFrames(max(sampleRate * OVERLAPDURATION / 1000, 1))
+	, m_searchFrames(sampleRate * SEARCHDURATION / 1000)
+	, m_rate(1.0)
+	, m_isActive(false)
+	, m_inputPos(0)
+	, m_tailEnd(0)
+	, m_removedFrames(0)
+{
+}
+
+void AudioTimeStretcher::SetRate(double rate)
+{
+	m_rate = rate;
+}
+
+void AudioTimeStretcher::Reset()
+{
+	m_input.clear();
+	m_tail.clear();
+	m_inputPos = 0;
+	m_tailEnd = 0;
+	m_removedFrames = 0;
+	m_isActive = false;
+}
+
+int AudioTimeStretcher::TakeRemovedFrames()
+{
+	int removedFrames = (int)m_removedFrames;
+	m_removedFrames -= removedFrames;
+	return removedFrames;
+}
+
+int AudioTimeStretcher::FindBestOffset(int nominal)
+{
+	int first = max(nominal - m_searchFrames, 0);
+	int last = nominal + m_searchFrames;
+	int count = m_overlapFrames * m_channels;
+
+	int best = first;
+	int64_t bestCorrelation = INT64_MIN;
+	for (int position = first; position <= last; position += COARSESEARCHSTEP)
+	{
+		int64_t correlation = Correlate(&m_input[position * m_channels], m_tail.data(), count);
+		if (correlation > bestCorrelation)
+		{
+			bestCorrelation = correlation;
+			best = position;
+		}
+	}
+
+	int coarseBest = best;
+	for (int position = max(coarseBest - COARSESEARCHSTEP + 1, first); position <= min(coarseBest + COARSESEARCHSTEP - 1, last); position++)
+	{
+		int64_t correlation = Correlate(&m_input[position * m_channels], m_tail.data(), count);
+		if (correlation > bestCorrelation)
+		{
+			bestCorrelation = correlation;
+			best = position;
+		}
+	}
+
+	return best;
+}
+
+// Emit the held back tail and continue with the input right after it, so nothing is lost or repeated
+void AudioTimeStretcher::Stop(std::vector<int16_t>& output)
+{
+	output.insert(output.end(), m_tail.begin(), m_tail.end());
+	output.insert(output.end(), m_input.begin() + m_tailEnd * m_channels, m_input.end());
+	m_input.clear();
+	m_tail.clear();
+	m_inputPos = 0;
+	m_tailEnd = 0;
+	m_isActive = false;
+}
+
+void AudioTimeStretcher::Process(const int16_t* input, int frames, std::vector<int16_t>& output)
+{
+	m_input.insert(m_input.end(), input, input + frames * m_channels);
+	int inputFrames = (int)m_input.size() / m_channels;
+
+	if (!m_isActive)
+	{
+		if (m_rate == 1.0 || inputFrames < m_overlapFrames)
+		{
+			// Hold back a partial first block until there is enough to start stretching
+			if (m_rate == 1.0)
+			{
+				output.insert(output.end(), m_input.begin(), m_input.end());
+				m_input.clear();
+			}
+			return;
+		}
+
+		m_tail.assign(m_input.begin(), m_input.begin() + m_overlapFrames * m_channels);
+		m_tailEnd = m_overlapFrames;
+		m_inputPos = m_overlapFrames * (m_rate - 1.0);
+		m_isActive = true;
+	}
+
+	if (m_rate == 1.0)
+	{
+		Stop(output);
+		return;
+	}
+
+	while ((int)m_inputPos + m_searchFrames + 2 * m_overlapFrames <= inputFrames)
+	{
+		int best = FindBestOffset((int)m_inputPos);
+		const int16_t* segment = &m_input[best * m_channels];
+
+		// Crossfade from the continuation of the previous block into the matching segment
+		size_t outputStart = output.size();
+		output.resize(outputStart + m_overlapFrames * m_channels);
+		int16_t* block = &output[outputStart];
+		for (int i = 0; i < m_overlapFrames; i++)
+		{
+			int fadeIn = i;
+			int fadeOut = m_overlapFrames - i;
+			for (int c = 0; c < m_channels; c++)
+			{
+				int index = i * m_channels + c;
+				block[index] = (int16_t)((m_tail[index] * fadeOut + segment[index] * fadeIn) / m_overlapFrames);
+			}
+		}
+
+		// The block replaced input from the start of the tail up to the start of the segment
+		m_removedFrames += best - (m_tailEnd - m_overlapFrames);
+		m_tail.assign(segment + m_overlapFrames * m_channels, segment + 2 * m_overlapFrames * m_channels);
+		m_tailEnd = best + 2 * m_overlapFrames;
+		m_inputPos += m_overlapFrames * m_rate;
+	}
+
+	// Forget input the search can't reach anymore
+	int drop = max(min((int)m_inputPos - m_searchFrames, m_tailEnd), 0);
+	if (drop > 0)
+	{
+		m_input.erase(m_input.begin(), m_input.begin() + drop * m_channels);
+		m_inputPos -= drop;
+		m_tailEnd -= drop;
+	}
+}
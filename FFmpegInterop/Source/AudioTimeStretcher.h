@@ -0,0 +1,70 @@
+//*****************************************************************************
+//
+//	Copyright 2017 Microsoft Corporation
+//
+//	Licensed under the Apache License, Version 2.0 (the "License");
+//	you may not use this file except in compliance with the License.
+//	You may obtain a copy of the License at
+//
+//	http ://www.apache.org/licenses/LICENSE-2.0
+//
+//	Unless required by applicable law or agreed to in writing, software
+//	distributed under the License is distributed on an "AS IS" BASIS,
+//	WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//	See the License for the specific language governing permissions and
+//	limitations under the License.
+//
+//*****************************************************************************
+
+#pragma once
+#include <vector>
+#include <stdint.h>
+
+namespace FFmpegInterop
+{
+	//////////////////////////////////////////////////////////////////////////
+	//  AudioTimeStretcher
+	//  Description: Changes the speed of interleaved 16 bit PCM without
+	//               changing its pitch (WSOLA). Each output block crossfades
+	//               the continuation of the previous block with the input
+	//               segment around the nominal position that matches it best.
+	//////////////////////////////////////////////////////////////////////////
+
+	class AudioTimeStretcher
+	{
+	public:
+		AudioTimeStretcher(int sampleRate, int channels);
+
+		// 1.0 plays at normal speed and passes the input through untouched
+		void SetRate(double rate);
+		double GetRate() { return m_rate; }
+		// True while input is held back for stretching
+		bool IsActive() { return m_isActive; }
+
+		// Append the stretched input to output
+		void Process(const int16_t* input, int frames, std::vector<int16_t>& output);
+		void Reset();
+
+		// Input frames skipped since the last call, the fraction is carried over
+		int TakeRemovedFrames();
+
+	private:
+		int FindBestOffset(int nominal);
+		void Stop(std::vector<int16_t>& output);
+
+		int m_channels;
+		// Crossfade length and search range around the nominal position, in frames
+		int m_overlapFrames;
+		int m_searchFrames;
+		double m_rate;
+		bool m_isActive;
+
+		// Pending interleaved input, m_inputPos is the nominal start of the next segment in frames
+		std::vector<int16_t> m_input;
+		double m_inputPos;
+		// Continuation of the last output block and where it ends in m_input
+		std::vector<int16_t> m_tail;
+		int m_tailEnd;
+		double m_removedFrames;
+	};
+}
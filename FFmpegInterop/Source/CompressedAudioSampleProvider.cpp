@@ -0,0 +1,123 @@
+//*****************************************************************************
+//
+//	Copyright 2017 Microsoft Corporation
+//
+//	Licensed under the Apache License, Version 2.0 (the "License");
+//	you may not use this file except in compliance with the License.
+//	You may obtain a copy of the License at
+//
+//	http ://www.apache.org/licenses/LICENSE-2.0
+//
+//	Unless required by applicable law or agreed to in writing, software
+//	distributed under the License is distributed on an "AS IS" BASIS,
+//	WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//	See the License for the specific language governing permissions and
+//	limitations under the License.
+//
+//*****************************************************************************
+
+
+#include "pch.h"
+#include "CompressedAudioSampleProvider.h"
+#include "FFmpegReader.h"
+#include "TraceRecorder.h"
+
+using namespace FFmpegInterop;
+
+// Upper bound on the frames in one sample, whatever their duration says
+const int MAXPACKETSPERSAMPLE = 64;
+
+CompressedAudioSampleProvider::CompressedAudioSampleProvider(
+	FFmpegReader^ reader,
+	AVFormatContext* avFormatCtx,
+	AVCodecContext* avCodecCtx)
+	: MediaSampleProvider(reader, avFormatCtx, avCodecCtx)
+	, m_sampleDuration(0)
+{
+}
+
+CompressedAudioSampleProvider::~CompressedAudioSampleProvider()
+{
+}
+
+MediaStreamSample^ CompressedAudioSampleProvider::GetNextSample()
+{
+	// Same as the uncompressed audio, but the packets are appended to the sample as they are
+	TRACE_SPAN(TraceSample, "GetNextSample");
+
+	HRESULT hr = S_OK;
+
+	MediaStreamSample^ sample;
+
+	LONGLONG finalPts = -1;
+	LONGLONG finalDur = 0;
+	int packetCount = 0;
+	bool isFirstPacket = true;
+	bool isDiscontinuous = false;
+	LONGLONG sampleDuration = m_sampleDuration;
+	bool isLive = m_pReader->m_isLiveSource;
+
+	do
+	{
+		LONGLONG pts = 0;
+		LONGLONG dur = 0;
+
+		hr = GetNextPacket(&m_sampleWriter, pts, dur, isFirstPacket);
+		if (isFirstPacket)
+		{
+			isDiscontinuous = m_isDiscontinuous;
+		}
+		isFirstPacket = false;
+
+		if (SUCCEEDED(hr))
+		{
+			if (finalPts == -1)
+			{
+				finalPts = pts;
+			}
+			finalDur += dur;
+			packetCount++;
+
+			if (dur <= 0)
+			{
+				// Without a duration the sample can't be filled up, hand out what we have
+				break;
+			}
+		}
+
+		// A live catch-up breaks the timeline, the frames after it start a new sample
+	} while (SUCCEEDED(hr) && finalDur < sampleDuration && packetCount < MAXPACKETSPERSAMPLE && !IsSkipPending() &&
+		!(isLive && IsPacketQueueEmpty()));
+
+	if (packetCount > 0)
+	{
+		sample = MediaStreamSample::CreateFromBuffer(m_sampleWriter.DetachBuffer(), { finalPts });
+		sample->Duration = { finalDur };
+		sample->Discontinuous = isDiscontinuous;
+		if (SUCCEEDED(hr))
+		{
+			// only reset flag if last packet was read successfully
+			m_isDiscontinuous = false;
+		}
+	}
+	else
+	{
+		// flush stream and disable any further processing
+		m_sampleWriter.Clear();
+		DebugMessage(L"Too many broken packets - disable stream\n");
+		DisableStream();
+	}
+
+	return sample;
+}
+
+HRESULT CompressedAudioSampleProvider::DecodeAVPacket(SampleWriter* dataWriter, AVPacket* avPacket, int64_t& framePts, int64_t& frameDuration)
+{
+	// Some demuxers leave the packet duration out. Every frame of the formats passed through holds frame_size samples.
+	if (avPacket != nullptr && avPacket->duration <= 0 && m_pAvCodecCtx->frame_size > 0 && m_pAvCodecCtx->sample_rate > 0)
+	{
+		avPacket->duration = av_rescale_q(m_pAvCodecCtx->frame_size, av_make_q(1, m_pAvCodecCtx->sample_rate), m_pAvFormatCtx->streams[m_streamIndex]->time_base);
+	}
+
+	return MediaSampleProvider::DecodeAVPacket(dataWriter, avPacket, framePts, frameDuration);
+}
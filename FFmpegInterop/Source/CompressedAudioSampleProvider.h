@@ -0,0 +1,45 @@
+//*****************************************************************************
+//
+//	Copyright 2017 Microsoft Corporation
+//
+//	Licensed under the Apache License, Version 2.0 (the "License");
+//	you may not use this file except in compliance with the License.
+//	You may obtain a copy of the License at
+//
+//	http ://www.apache.org/licenses/LICENSE-2.0
+//
+//	Unless required by applicable law or agreed to in writing, software
+//	distributed under the License is distributed on an "AS IS" BASIS,
+//	WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//	See the License for the specific language governing permissions and
+//	limitations under the License.
+//
+//*****************************************************************************
+
+
+#pragma once
+#include "MediaSampleProvider.h"
+
+namespace FFmpegInterop
+{
+	// Passes compressed audio through to the system decoder, several frames per sample.
+	// Only for formats whose frames can be concatenated, i.e. AAC with ADTS headers and MP3.
+	ref class CompressedAudioSampleProvider :
+		public MediaSampleProvider
+	{
+	public:
+		virtual ~CompressedAudioSampleProvider();
+		virtual MediaStreamSample^ GetNextSample() override;
+
+	internal:
+		CompressedAudioSampleProvider(
+			FFmpegReader^ reader,
+			AVFormatContext* avFormatCtx,
+			AVCodecContext* avCodecCtx);
+		virtual HRESULT DecodeAVPacket(SampleWriter* dataWriter, AVPacket* avPacket, int64_t& framePts, int64_t& frameDuration) override;
+
+		// Frames are collected into samples of this duration (100 ns units), 0 hands out each frame on its own.
+		// Live sources hand out a shorter sample rather than wait for the network.
+		std::atomic<int64_t> m_sampleDuration;
+	};
+}
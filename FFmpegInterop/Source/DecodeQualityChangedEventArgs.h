@@ -0,0 +1,63 @@
+//*****************************************************************************
+//
+//	Copyright 2017 Microsoft Corporation
+//
+//	Licensed under the Apache License, Version 2.0 (the "License");
+//	you may not use this file except in compliance with the License.
+//	You may obtain a copy of the License at
+//
+//	http ://www.apache.org/licenses/LICENSE-2.0
+//
+//	Unless required by applicable law or agreed to in writing, software
+//	distributed under the License is distributed on an "AS IS" BASIS,
+//	WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//	See the License for the specific language governing permissions and
+//	limitations under the License.
+//
+//*****************************************************************************
+
+#pragma once
+
+namespace FFmpegInterop
+{
+	// Steps the video decoder takes, in order, when it can't keep up with the frame rate
+	public enum class DecodeQuality
+	{
+		Full,
+		SkipLoopFilter,
+		Fast,
+		SkipNonRefIdct,
+		ReducedResolution
+	};
+
+	public ref class DecodeQualityChangedEventArgs sealed
+	{
+		DecodeQuality _quality;
+		double _decodeLoad;
+
+	public:
+
+		property DecodeQuality Quality
+		{
+			DecodeQuality get()
+			{
+				return _quality;
+			}
+		}
+		// Decode time relative to the frame duration when the step was taken, above 1.0 the decoder falls behind
+		property double DecodeLoad
+		{
+			double get()
+			{
+				return _decodeLoad;
+			}
+		}
+
+	internal:
+		DecodeQualityChangedEventArgs(DecodeQuality quality, double decodeLoad)
+		{
+			this->_quality = quality;
+			this->_decodeLoad = decodeLoad;
+		}
+	};
+}
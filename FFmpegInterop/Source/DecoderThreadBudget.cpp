@@ -0,0 +1,162 @@
+//*****************************************************************************
+//
+//	Copyright 2017 Microsoft Corporation
+//
+//	Licensed under the Apache License, Version 2.0 (the "License");
+//	you may not use this file except in compliance with the License.
+//	You may obtain a copy of the License at
+//
+//	http ://www.apache.org/licenses/LICENSE-2.0
+//
+//	Unless required by applicable law or agreed to in writing, software
+//	distributed under the License is distributed on an "AS IS" BASIS,
+//	WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//	See the License for the specific language governing permissions and
+//	limitations under the License.
+//
+//*****************************************************************************
+
+#include "pch.h"
+#include "DecoderThreadBudget.h"
+#include <algorithm>
+#include <thread>
+
+using namespace FFmpegInterop;
+
+// Relative share of a decoder for each priority (low, normal, high)
+static const double PriorityWeights[] = { 0.5, 1.0, 4.0 };
+
+DecoderThreadBudget& DecoderThreadBudget::Instance()
+{
+	static DecoderThreadBudget budget(std::thread::hardware_concurrency());
+	return budget;
+}
+
+DecoderThreadBudget::DecoderThreadBudget(unsigned int totalThreads)
+	: m_totalThreads(totalThreads > 0 ? totalThreads : 1)
+	, m_nextId(0)
+	, m_audioDecoders(0)
+	, m_generation(0)
+{
+}
+
+int DecoderThreadBudget::Register(int width, int height, double codecComplexity, int priority)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+
+	// Decode cost grows with the number of pixels, use 1080p as the unit
+	double pixels = max(width, 16) * (double)max(height, 16);
+	Decoder decoder = { m_nextId++, pixels / (1920.0 * 1080.0) * codecComplexity, priority, 1 };
+	m_decoders.push_back(decoder);
+	Rebalance();
+
+	return decoder.id;
+}
+
+void DecoderThreadBudget::Unregister(int id)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+
+	m_decoders.erase(std::remove_if(m_decoders.begin(), m_decoders.end(), [id](const Decoder& decoder) { return decoder.id == id; }), m_decoders.end());
+	Rebalance();
+}
+
+void DecoderThreadBudget::SetPriority(int id, int priority)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+
+	for (auto& decoder : m_decoders)
+	{
+		if (decoder.id == id)
+		{
+			decoder.priority = priority;
+		}
+	}
+	Rebalance();
+}
+
+int DecoderThreadBudget::GetThreadCount(int id)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+
+	for (auto& decoder : m_decoders)
+	{
+		if (decoder.id == id)
+		{
+			return decoder.threadCount;
+		}
+	}
+	return 1;
+}
+
+void DecoderThreadBudget::ReserveAudioThread()
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+
+	m_audioDecoders++;
+	Rebalance();
+}
+
+void DecoderThreadBudget::ReleaseAudioThread()
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+
+	m_audioDecoders--;
+	Rebalance();
+}
+
+unsigned int DecoderThreadBudget::GetTotalThreads()
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	return m_totalThreads;
+}
+
+void DecoderThreadBudget::SetTotalThreads(unsigned int totalThreads)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+
+	m_totalThreads = totalThreads > 0 ? totalThreads : 1;
+	Rebalance();
+}
+
+// Hand out the budget proportionally to each decoder's weight. Everybody gets at least one thread
+// and the threads lost to rounding go to the decoders with the largest remainders.
+void DecoderThreadBudget::Rebalance()
+{
+	m_generation.fetch_add(1, std::memory_order_release);
+	if (m_decoders.empty())
+	{
+		return;
+	}
+
+	double totalWeight = 0;
+	for (auto& decoder : m_decoders)
+	{
+		totalWeight += decoder.complexity * PriorityWeights[min(max(decoder.priority, 0), 2)];
+	}
+
+	// Audio decoding is cheap but must never wait for a core, a single thread covers all instances
+	int reserved = m_audioDecoders > 0 && m_totalThreads > 1 ? 1 : 0;
+	int available = (int)m_totalThreads - reserved - (int)m_decoders.size();
+	std::vector<std::pair<double, size_t>> remainders;
+	int assigned = 0;
+
+	for (size_t i = 0; i < m_decoders.size(); i++)
+	{
+		Decoder& decoder = m_decoders[i];
+		double share = 0;
+		if (available > 0 && totalWeight > 0)
+		{
+			share = available * decoder.complexity * PriorityWeights[min(max(decoder.priority, 0), 2)] / totalWeight;
+		}
+		decoder.threadCount = 1 + (int)share;
+		assigned += (int)share;
+		remainders.push_back(std::make_pair(share - (int)share, i));
+	}
+
+	std::sort(remainders.begin(), remainders.end(), [](const std::pair<double, size_t>& a, const std::pair<double, size_t>& b) { return a.first > b.first; });
+	for (size_t i = 0; available > assigned && i < remainders.size(); i++, assigned++)
+	{
+		m_decoders[remainders[i].second].threadCount++;
+	}
+}
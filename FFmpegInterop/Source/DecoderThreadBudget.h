@@ -0,0 +1,77 @@
+//*****************************************************************************
+//
+//	Copyright 2017 Microsoft Corporation
+//
+//	Licensed under the Apache License, Version 2.0 (the "License");
+//	you may not use this file except in compliance with the License.
+//	You may obtain a copy of the License at
+//
+//	http ://www.apache.org/licenses/LICENSE-2.0
+//
+//	Unless required by applicable law or agreed to in writing, software
+//	distributed under the License is distributed on an "AS IS" BASIS,
+//	WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//	See the License for the specific language governing permissions and
+//	limitations under the License.
+//
+//*****************************************************************************
+
+#pragma once
+#include <atomic>
+#include <mutex>
+#include <vector>
+
+namespace FFmpegInterop
+{
+	//////////////////////////////////////////////////////////////////////////
+	//  DecoderThreadBudget
+	//  Description: Splits a process wide number of video decoder threads
+	//               between all open FFmpegInteropMSS instances, weighted by
+	//               resolution, codec complexity and priority. One thread is
+	//               held back while audio is being decoded. Plain C++ without
+	//               FFmpeg or WinRT dependencies so it can be tested on its own.
+	//////////////////////////////////////////////////////////////////////////
+
+	class DecoderThreadBudget
+	{
+	public:
+		explicit DecoderThreadBudget(unsigned int totalThreads);
+
+		// Process wide budget of all hardware threads
+		static DecoderThreadBudget& Instance();
+
+		// Returns an id used to query and release the share of this decoder. The codec complexity
+		// is the relative cost of decoding a pixel, 1 for H.264.
+		int Register(int width, int height, double codecComplexity, int priority);
+		void Unregister(int id);
+		void SetPriority(int id, int priority);
+		// Read when the decoder is (re)opened
+		int GetThreadCount(int id);
+		// Changes whenever the shares were rebalanced, running decoders compare it to pick up a new share
+		unsigned int GetGeneration() { return m_generation.load(std::memory_order_acquire); }
+		// Keep a thread free for audio decoding, calls are counted
+		void ReserveAudioThread();
+		void ReleaseAudioThread();
+
+		unsigned int GetTotalThreads();
+		void SetTotalThreads(unsigned int totalThreads);
+
+	private:
+		void Rebalance();
+
+		struct Decoder
+		{
+			int id;
+			double complexity;
+			int priority;
+			int threadCount;
+		};
+
+		std::mutex m_mutex;
+		std::vector<Decoder> m_decoders;
+		unsigned int m_totalThreads;
+		int m_nextId;
+		int m_audioDecoders;
+		std::atomic<unsigned int> m_generation;
+	};
+}
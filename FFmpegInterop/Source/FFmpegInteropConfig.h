@@ -0,0 +1,123 @@
+//*****************************************************************************
+//
+//	Copyright 2017 Microsoft Corporation
+//
+//	Licensed under the Apache License, Version 2.0 (the "License");
+//	you may not use this file except in compliance with the License.
+//	You may obtain a copy of the License at
+//
+//	http ://www.apache.org/licenses/LICENSE-2.0
+//
+//	Unless required by applicable law or agreed to in writing, software
+//	distributed under the License is distributed on an "AS IS" BASIS,
+//	WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//	See the License for the specific language governing permissions and
+//	limitations under the License.
+//
+//*****************************************************************************
+
+#pragma once
+
+namespace FFmpegInterop
+{
+	public enum class LatencyProfile
+	{
+		// Live for realtime sources without a duration, Playback otherwise
+		Auto,
+		// Local files and VOD, favors throughput
+		Playback,
+		// Realtime streams, favors low latency
+		Live,
+		// Audio playing in the background, favors power: large audio samples let the CPU sleep longer
+		Background
+	};
+
+	// Share of the process wide decoder thread budget relative to other instances
+	public enum class DecoderPriority
+	{
+		Low,
+		Normal,
+		High
+	};
+
+	// Where playback starts after a seek
+	public enum class SeekMode
+	{
+		// At the requested position: decode from the keyframe before it and drop the frames in between
+		Accurate,
+		// At the keyframe before the requested position, without decoding anything that isn't shown
+		Fast
+	};
+
+	public ref class FFmpegInteropConfig sealed
+	{
+	public:
+		FFmpegInteropConfig()
+		{
+			Profile = LatencyProfile::Auto;
+			MaxVideoDecoderThreads = 4;
+			Priority = DecoderPriority::Normal;
+
+			Windows::Foundation::TimeSpan maxLiveLatency = { 30000000 };
+			MaxLiveLatency = maxLiveLatency;
+			Windows::Foundation::TimeSpan maxJitterBuffer = { 10000000 };
+			MaxJitterBuffer = maxJitterBuffer;
+
+			VideoReadySamples = 3;
+			VideoDecodeAheadFrames = 2;
+			PrioritizeAudio = true;
+			Windows::Foundation::TimeSpan audioReadyDuration = { 2000000 };
+			AudioReadyDuration = audioReadyDuration;
+		}
+
+		property LatencyProfile Profile;
+
+		// Upper bound for frame threading in Playback profile. Each frame thread adds one frame of decode delay.
+		property unsigned int MaxVideoDecoderThreads;
+
+		property DecoderPriority Priority;
+
+		property FFmpegInterop::SeekMode SeekMode;
+
+		// Live profile only: skip ahead to the newest keyframe once playback falls this far behind the live edge, 0 disables it
+		property Windows::Foundation::TimeSpan MaxLiveLatency;
+
+		// Live profile only: play decoded audio up to 10% faster, with video following, until playback is back within this latency.
+		// 0 (the default) disables it. Above 0 AAC and MP3 are decoded in software instead of passed to the system decoder,
+		// as if forceAudioDecode was set, since only decoded audio can be stretched.
+		property Windows::Foundation::TimeSpan TargetLiveLatency;
+
+		// Live profile only: bounds of the MediaStreamSource buffer that absorbs network jitter
+		property Windows::Foundation::TimeSpan MinJitterBuffer;
+		property Windows::Foundation::TimeSpan MaxJitterBuffer;
+
+		// Record every demuxed packet with its arrival time to this file. The capture can be opened again
+		// like any media file and replays with the recorded timing, see PacketCapture.h for the options.
+		property Platform::String^ CapturePath;
+
+		// Raise FFmpegInteropMSS::TelemetryUpdated with a snapshot of the pipeline counters this often, 0 disables it
+		property Windows::Foundation::TimeSpan TelemetryInterval;
+
+		// Samples decoded ahead of the requests on a worker thread. Requests that find nothing ready are
+		// deferred until the worker catches up. 0 decodes on the request thread instead.
+		property unsigned int VideoReadySamples;
+		property Windows::Foundation::TimeSpan AudioReadyDuration;
+
+		// Decoded video frames waiting for conversion. Above 0 decoding runs on a thread of its own,
+		// overlapping the NV12 conversion of the previous frame.
+		property unsigned int VideoDecodeAheadFrames;
+
+		// Under CPU contention let video drop frames before audio glitches: audio decodes at a raised
+		// thread priority with a decoder thread held back for it, and video waits while the audio
+		// ready queue is below half of AudioReadyDuration
+		property bool PrioritizeAudio;
+
+		// Decoded audio is handed out in samples of this duration. 0 picks it from the profile:
+		// 20 ms for Live, 50 ms for Playback and 500 ms for Background.
+		property Windows::Foundation::TimeSpan AudioSampleDuration;
+
+		// Pass AAC with ADTS headers and MP3 to the system decoder in samples of AudioSampleDuration
+		// rather than a sample for every frame (about 43 per second), cutting the per-sample overhead
+		property bool BatchPassthroughAudio;
+	};
+}
@@ -19,6 +19,7 @@
 
 #include "pch.h"
 #include "FFmpegInteropLogging.h"
+#include "LogSink.h"
 
 using namespace FFmpegInterop;
 
@@ -27,8 +28,6 @@ extern "C"
 #include <libavutil/log.h>
 }
 
-ILogProvider^ FFmpegInteropLogging::s_pLogProvider = nullptr;
-
 FFmpegInteropLogging::FFmpegInteropLogging()
 {
 }
@@ -40,23 +39,19 @@ void FFmpegInteropLogging::SetLogLevel(LogLevel level)
 
 void FFmpegInteropLogging::SetLogProvider(ILogProvider^ logProvider)
 {
-	s_pLogProvider = logProvider;
+	if (logProvider == nullptr)
+	{
+		// Nothing would deliver the lines, go back to FFmpeg's own output
+		SetDefaultLogProvider();
+		return;
+	}
+
+	LogSink::Instance().SetProvider(logProvider);
 	av_log_set_callback([](void*avcl, int level, const char *fmt, va_list vl)->void
 	{
 		if (level <= av_log_get_level())
 		{
-			if (s_pLogProvider != nullptr)
-			{
-				char pLine[1000];
-				int printPrefix = 1;
-				av_log_format_line(avcl, level, fmt, vl, pLine, sizeof(pLine), &printPrefix);
-
-				wchar_t wLine[sizeof(pLine)];
-				if (MultiByteToWideChar(CP_ACP, MB_PRECOMPOSED, pLine, -1, wLine, sizeof(pLine)) != 0)
-				{
-					s_pLogProvider->Log((LogLevel)level, ref new String(wLine));
-				}
-			}
+			LogSink::Instance().Push(avcl, level, fmt, vl);
 		}
 	});
 }
@@ -64,5 +59,17 @@ void FFmpegInteropLogging::SetLogProvider(ILogProvider^ logProvider)
 void FFmpegInteropLogging::SetDefaultLogProvider()
 {
 	av_log_set_callback(av_log_default_callback);
+	// Deliver what is still queued and stop the delivery thread
+	LogSink::Instance().SetProvider(nullptr);
+}
+
+void FFmpegInteropLogging::SetLogOverflowPolicy(LogOverflowPolicy policy)
+{
+	LogSink::Instance().SetBlockWhenFull(policy == LogOverflowPolicy::Block);
+}
+
+unsigned long long FFmpegInteropLogging::DroppedMessages::get()
+{
+	return LogSink::Instance().GetDroppedCount();
 }
 
@@ -21,17 +21,32 @@
 
 namespace FFmpegInterop
 {
+	// What FFmpeg's threads do when log lines arrive faster than the provider takes them
+	public enum class LogOverflowPolicy
+	{
+		// Drop the line and count it, decoding is never slowed down by logging
+		Drop,
+		// Wait until the provider caught up, nothing is lost
+		Block
+	};
+
 	public ref class FFmpegInteropLogging sealed
 	{
 	public:
 		static void SetLogLevel(LogLevel level);
+		// The provider is called on a background thread, in batches, not on the thread that logged
 		static void SetLogProvider(ILogProvider^ logProvider);
 		static void SetDefaultLogProvider();
+		static void SetLogOverflowPolicy(LogOverflowPolicy policy);
+
+		// Log lines dropped because the provider fell behind
+		static property unsigned long long DroppedMessages
+		{
+			unsigned long long get();
+		}
 
 	private:
 		FFmpegInteropLogging();
-
-		static ILogProvider^ s_pLogProvider;
 	};
 }
 
@@ -21,15 +21,21 @@
 #include "MediaSampleProvider.h"
 #include "H264AVCSampleProvider.h"
 #include "H264SampleProvider.h"
+#include "CompressedAudioSampleProvider.h"
 #include "UncompressedAudioSampleProvider.h"
 #include "UncompressedVideoSampleProvider.h"
 #include "CritSec.h"
+#include "DecoderThreadBudget.h"
+#include "PacketCapture.h"
+#include "SampleProducer.h"
+#include "TraceRecorder.h"
 #include "shcore.h"
 #include <mfapi.h>
 
 extern "C"
 {
 #include <libavutil/imgutils.h>
+#include <libavutil/time.h>
 }
 
 using namespace concurrency;
@@ -40,18 +46,35 @@ using namespace Windows::Media::MediaProperties;
 
 // Size of the buffer when reading a stream
 const int FILESTREAMBUFFERSZ = 16384;
+// Audio sample duration of each latency profile unless the config sets one (100 ns units)
+const LONGLONG LIVEAUDIOSAMPLEDURATION = 200000;
+const LONGLONG PLAYBACKAUDIOSAMPLEDURATION = 500000;
+const LONGLONG BACKGROUNDAUDIOSAMPLEDURATION = 5000000;
+// Packets read while looking for the keyframe of the seeked stream before giving up
+const int MAXKEYFRAMESEARCHPACKETS = 500;
 
 // Static functions passed to FFmpeg
 static int FileStreamRead(void* ptr, uint8_t* buf, int bufSize);
 static int64_t FileStreamSeek(void* ptr, int64_t pos, int whence);
+static int IsInterrupted(void* ptr);
+static double GetVideoCodecComplexity(AVCodecID codecId);
 static int lock_manager(void **mtx, enum AVLockOp op);
 
 // Flag for ffmpeg global setup
 static bool isRegistered = false;
 
 // Initialize an FFmpegInteropObject
-FFmpegInteropMSS::FFmpegInteropMSS()
-	: avDict(nullptr)
+FFmpegInteropMSS::FFmpegInteropMSS(FFmpegInteropConfig^ config)
+	: config(config != nullptr ? config : ref new FFmpegInteropConfig())
+	, latencyProfile(LatencyProfile::Playback)
+	, decoderPriority(this->config->Priority)
+	, seekMode(this->config->SeekMode)
+	, threadBudgetId(-1)
+	, threadBudgetGeneration(0)
+	, videoDecoderThreads(0)
+	, isAudioThreadReserved(false)
+	, isInterrupted(false)
+	, avDict(nullptr)
 	, avIOCtx(nullptr)
 	, avFormatCtx(nullptr)
 	, avAudioCodecCtx(nullptr)
@@ -62,17 +85,45 @@ FFmpegInteropMSS::FFmpegInteropMSS()
 	, fileStreamData(nullptr)
 	, fileStreamBuffer(nullptr)
 {
+	for (auto& time : startupTimes)
+	{
+		time = INT64_MIN;
+	}
+	MarkStartupPhase(StartupPhase::Start);
+
 	if (!isRegistered)
 	{
 		av_register_all();
 		av_lockmgr_register(lock_manager);
+		PacketCapture::RegisterReplayFormat();
 		isRegistered = true;
 	}
 }
 
 FFmpegInteropMSS::~FFmpegInteropMSS()
 {
-	mutexGuard.lock();
+	if (telemetryTimer != nullptr)
+	{
+		telemetryTimer->Cancel();
+		telemetryTimer = nullptr;
+	}
+
+	// The workers take seekMutex, stop them first. Fail the network read they may be blocked in, the
+	// read callback of a stream can't be interrupted.
+	isInterrupted = true;
+	audioProducer = nullptr;
+	videoProducer = nullptr;
+
+	// The decode thread holds a reference to the provider until it is stopped
+	auto uncompressedVideoSampleProvider = dynamic_cast<UncompressedSampleProvider^>(videoSampleProvider);
+	if (uncompressedVideoSampleProvider != nullptr)
+	{
+		uncompressedVideoSampleProvider->StopDecodeThread();
+		// The provider replaces the decoder when its thread share changes
+		avVideoCodecCtx = uncompressedVideoSampleProvider->m_pAvCodecCtx;
+	}
+
+	std::lock_guard<std::shared_timed_mutex> lock(seekMutex);
 	if (mss)
 	{
 		mss->Starting -= startingRequestedToken;
@@ -91,6 +142,19 @@ FFmpegInteropMSS::~FFmpegInteropMSS()
 		m_pReader = nullptr;
 	}
 
+	if (threadBudgetId >= 0)
+	{
+		DecoderThreadBudget::Instance().Unregister(threadBudgetId);
+		threadBudgetId = -1;
+	}
+
+	if (isAudioThreadReserved)
+	{
+		DecoderThreadBudget::Instance().ReleaseAudioThread();
+		isAudioThreadReserved = false;
+	}
+	audioScheduler = nullptr;
+
 	avcodec_close(avVideoCodecCtx);
 	avcodec_close(avAudioCodecCtx);
 	avformat_close_input(&avFormatCtx);
@@ -101,12 +165,11 @@ FFmpegInteropMSS::~FFmpegInteropMSS()
 	{
 		fileStreamData->Release();
 	}
-	mutexGuard.unlock();
 }
 
-FFmpegInteropMSS^ FFmpegInteropMSS::CreateFFmpegInteropMSSFromStream(IRandomAccessStream^ stream, bool forceAudioDecode, bool forceVideoDecode, PropertySet^ ffmpegOptions, MediaStreamSource^ mss)
+FFmpegInteropMSS^ FFmpegInteropMSS::CreateFFmpegInteropMSSFromStream(IRandomAccessStream^ stream, bool forceAudioDecode, bool forceVideoDecode, PropertySet^ ffmpegOptions, MediaStreamSource^ mss, FFmpegInteropConfig^ config)
 {
-	auto interopMSS = ref new FFmpegInteropMSS();
+	auto interopMSS = ref new FFmpegInteropMSS(config);
 	if (FAILED(interopMSS->CreateMediaStreamSource(stream, forceAudioDecode, forceVideoDecode, ffmpegOptions, mss)))
 	{
 		// We failed to initialize, clear the variable to return failure
@@ -116,6 +179,11 @@ FFmpegInteropMSS^ FFmpegInteropMSS::CreateFFmpegInteropMSSFromStream(IRandomAcce
 	return interopMSS;
 }
 
+FFmpegInteropMSS^ FFmpegInteropMSS::CreateFFmpegInteropMSSFromStream(IRandomAccessStream^ stream, bool forceAudioDecode, bool forceVideoDecode, PropertySet^ ffmpegOptions, MediaStreamSource^ mss)
+{
+	return CreateFFmpegInteropMSSFromStream(stream, forceAudioDecode, forceVideoDecode, ffmpegOptions, mss, nullptr);
+}
+
 FFmpegInteropMSS^ FFmpegInteropMSS::CreateFFmpegInteropMSSFromStream(IRandomAccessStream^ stream, bool forceAudioDecode, bool forceVideoDecode, PropertySet^ ffmpegOptions)
 {
 	return CreateFFmpegInteropMSSFromStream(stream, forceAudioDecode, forceVideoDecode, nullptr, nullptr);
@@ -126,9 +194,9 @@ FFmpegInteropMSS^ FFmpegInteropMSS::CreateFFmpegInteropMSSFromStream(IRandomAcce
 	return CreateFFmpegInteropMSSFromStream(stream, forceAudioDecode, forceVideoDecode, nullptr);
 }
 
-FFmpegInteropMSS^ FFmpegInteropMSS::CreateFFmpegInteropMSSFromUri(String^ uri, bool forceAudioDecode, bool forceVideoDecode, PropertySet^ ffmpegOptions)
+FFmpegInteropMSS^ FFmpegInteropMSS::CreateFFmpegInteropMSSFromUri(String^ uri, bool forceAudioDecode, bool forceVideoDecode, PropertySet^ ffmpegOptions, FFmpegInteropConfig^ config)
 {
-	auto interopMSS = ref new FFmpegInteropMSS();
+	auto interopMSS = ref new FFmpegInteropMSS(config);
 	if (FAILED(interopMSS->CreateMediaStreamSource(uri, forceAudioDecode, forceVideoDecode, ffmpegOptions)))
 	{
 		// We failed to initialize, clear the variable to return failure
@@ -138,6 +206,11 @@ FFmpegInteropMSS^ FFmpegInteropMSS::CreateFFmpegInteropMSSFromUri(String^ uri, b
 	return interopMSS;
 }
 
+FFmpegInteropMSS^ FFmpegInteropMSS::CreateFFmpegInteropMSSFromUri(String^ uri, bool forceAudioDecode, bool forceVideoDecode, PropertySet^ ffmpegOptions)
+{
+	return CreateFFmpegInteropMSSFromUri(uri, forceAudioDecode, forceVideoDecode, ffmpegOptions, nullptr);
+}
+
 FFmpegInteropMSS^ FFmpegInteropMSS::CreateFFmpegInteropMSSFromUri(String^ uri, bool forceAudioDecode, bool forceVideoDecode)
 {
 	return CreateFFmpegInteropMSSFromUri(uri, forceAudioDecode, forceVideoDecode, nullptr);
@@ -148,6 +221,280 @@ MediaStreamSource^ FFmpegInteropMSS::GetMediaStreamSource()
 	return mss;
 }
 
+IVectorView<LatencyStatistics^>^ FFmpegInteropMSS::GetAudioLatencyStatistics()
+{
+	return GetLatencyStatistics(audioSampleProvider);
+}
+
+IVectorView<LatencyStatistics^>^ FFmpegInteropMSS::GetVideoLatencyStatistics()
+{
+	return GetLatencyStatistics(videoSampleProvider);
+}
+
+IVectorView<LatencyStatistics^>^ FFmpegInteropMSS::GetLatencyStatistics(MediaSampleProvider^ sampleProvider)
+{
+	auto statistics = ref new Platform::Collections::Vector<LatencyStatistics^>();
+	if (sampleProvider != nullptr)
+	{
+		for (int stage = 0; stage <= static_cast<int>(LatencyStage::Total); stage++)
+		{
+			LatencyHistogram& histogram = sampleProvider->m_latencyHistograms[stage];
+			statistics->Append(ref new LatencyStatistics(static_cast<LatencyStage>(stage), histogram.GetCount(),
+				histogram.GetPercentile(0.5), histogram.GetPercentile(0.95), histogram.GetPercentile(0.99), histogram.GetMax()));
+		}
+	}
+	return statistics->GetView();
+}
+
+String^ FFmpegInteropMSS::ExportLatencyStatistics()
+{
+	std::wstring json = L"{\"audio\":" + ExportLatencyStatistics(audioSampleProvider) + L",\"video\":" + ExportLatencyStatistics(videoSampleProvider) + L"}";
+	return ref new String(json.c_str());
+}
+
+std::wstring FFmpegInteropMSS::ExportLatencyStatistics(MediaSampleProvider^ sampleProvider)
+{
+	static const wchar_t* stageNames[] = { L"queue", L"decode", L"convert", L"handoff", L"total" };
+
+	std::wstring json = L"{";
+	if (sampleProvider != nullptr)
+	{
+		for (int stage = 0; stage <= static_cast<int>(LatencyStage::Total); stage++)
+		{
+			LatencyHistogram& histogram = sampleProvider->m_latencyHistograms[stage];
+			wchar_t buffer[250];
+			swprintf_s(buffer, L"%s\"%s\":{\"count\":%llu,\"p50\":%lld,\"p95\":%lld,\"p99\":%lld,\"max\":%lld}", stage > 0 ? L"," : L"", stageNames[stage],
+				histogram.GetCount(), histogram.GetPercentile(0.5), histogram.GetPercentile(0.95), histogram.GetPercentile(0.99), histogram.GetMax());
+			json += buffer;
+		}
+	}
+	return json + L"}";
+}
+
+void FFmpegInteropMSS::ResetLatencyStatistics()
+{
+	auto reset = [](MediaSampleProvider^ sampleProvider)
+	{
+		if (sampleProvider != nullptr)
+		{
+			for (auto& histogram : sampleProvider->m_latencyHistograms)
+			{
+				histogram.Reset();
+			}
+		}
+	};
+	reset(audioSampleProvider);
+	reset(videoSampleProvider);
+}
+
+TimeSpan FFmpegInteropMSS::VideoDecodeLatency::get()
+{
+	TimeSpan latency = { 0 };
+	auto uncompressedVideoSampleProvider = dynamic_cast<UncompressedSampleProvider^>(videoSampleProvider);
+	if (uncompressedVideoSampleProvider != nullptr)
+	{
+		// Microseconds to TimeSpan units
+		latency.Duration = uncompressedVideoSampleProvider->m_decodeLatency * 10;
+	}
+	return latency;
+}
+
+unsigned long long FFmpegInteropMSS::VideoFramesDropped::get()
+{
+	auto uncompressedVideoSampleProvider = dynamic_cast<UncompressedVideoSampleProvider^>(videoSampleProvider);
+	return uncompressedVideoSampleProvider != nullptr ? uncompressedVideoSampleProvider->m_lateFramesDropped.load() : 0;
+}
+
+TimeSpan FFmpegInteropMSS::LiveLatency::get()
+{
+	TimeSpan latency = { 0 };
+	if (m_pReader != nullptr)
+	{
+		latency.Duration = m_pReader->m_liveLatency * 10;
+	}
+	return latency;
+}
+
+TimeSpan FFmpegInteropMSS::NetworkJitter::get()
+{
+	TimeSpan jitter = { 0 };
+	if (m_pReader != nullptr)
+	{
+		jitter.Duration = m_pReader->m_networkJitter * 10;
+	}
+	return jitter;
+}
+
+TimeSpan FFmpegInteropMSS::JitterBufferTime::get()
+{
+	return mss != nullptr ? mss->BufferTime : TimeSpan{ 0 };
+}
+
+// MediaStreamSource buffers BufferTime worth of samples before it starts and after running dry.
+// Follow the jitter estimate instead of a fixed value, ignoring small changes.
+void FFmpegInteropMSS::UpdateJitterBuffer()
+{
+	const LONGLONG minChange = 100000;
+
+	LONGLONG target = m_pReader->m_jitterTargetDelay * 10;
+	LONGLONG current = mss->BufferTime.Duration;
+	if (target > current + minChange || target < current - minChange)
+	{
+		SetBufferTime({ target });
+	}
+}
+
+// The video clock runs BufferTime behind the first sample handed out, frames inside it aren't late
+void FFmpegInteropMSS::SetBufferTime(TimeSpan bufferTime)
+{
+	mss->BufferTime = bufferTime;
+
+	auto uncompressedVideoSampleProvider = dynamic_cast<UncompressedVideoSampleProvider^>(videoSampleProvider);
+	if (uncompressedVideoSampleProvider != nullptr)
+	{
+		uncompressedVideoSampleProvider->SetBufferTime(bufferTime);
+	}
+}
+
+double FFmpegInteropMSS::AudioPlaybackRate::get()
+{
+	auto uncompressedAudioSampleProvider = dynamic_cast<UncompressedAudioSampleProvider^>(audioSampleProvider);
+	return uncompressedAudioSampleProvider != nullptr ? uncompressedAudioSampleProvider->m_playbackRate : 1.0;
+}
+
+StreamTelemetry^ FFmpegInteropMSS::AudioTelemetry::get()
+{
+	auto sampleProvider = audioSampleProvider;
+	return sampleProvider != nullptr ? ref new StreamTelemetry(sampleProvider->m_counters) : nullptr;
+}
+
+StreamTelemetry^ FFmpegInteropMSS::VideoTelemetry::get()
+{
+	auto sampleProvider = videoSampleProvider;
+	return sampleProvider != nullptr ? ref new StreamTelemetry(sampleProvider->m_counters) : nullptr;
+}
+
+StartupTimings^ FFmpegInteropMSS::GetStartupTimings()
+{
+	return ref new StartupTimings(startupTimes);
+}
+
+// Only the first time counts, later samples and reopened decoders are not startup
+static void MarkStartupTime(std::atomic<int64_t>& time)
+{
+	int64_t notReached = INT64_MIN;
+	time.compare_exchange_strong(notReached, av_gettime_relative());
+}
+
+void FFmpegInteropMSS::MarkStartupPhase(StartupPhase phase)
+{
+	MarkStartupTime(startupTimes[static_cast<int>(phase)]);
+}
+
+// The producers get the startup slot instead of this instance, a handle would keep it alive
+void FFmpegInteropMSS::StartSampleProducers()
+{
+	// Audio only gets ahead of video when it is decoded here and has a ready queue to watch
+	bool isAudioDecoded = dynamic_cast<UncompressedAudioSampleProvider^>(audioSampleProvider) != nullptr;
+	if (config->PrioritizeAudio && isAudioDecoded && config->AudioReadyDuration.Duration > 0)
+	{
+		audioScheduler.reset(new AudioPriorityScheduler());
+		DecoderThreadBudget::Instance().ReserveAudioThread();
+		isAudioThreadReserved = true;
+		UpdateVideoDecoderThreads();
+	}
+
+	if (audioSampleProvider != nullptr && config->AudioReadyDuration.Duration > 0)
+	{
+		std::atomic<int64_t>* firstSampleTime = &startupTimes[static_cast<int>(StartupPhase::FirstAudioSample)];
+		audioProducer.reset(new SampleProducer(audioSampleProvider, seekMutex, audioMutex, 0, config->AudioReadyDuration.Duration, [firstSampleTime]() { MarkStartupTime(*firstSampleTime); },
+			audioScheduler.get(), true));
+	}
+	if (videoSampleProvider != nullptr && config->VideoReadySamples > 0)
+	{
+		std::atomic<int64_t>* firstSampleTime = &startupTimes[static_cast<int>(StartupPhase::FirstVideoSample)];
+		videoProducer.reset(new SampleProducer(videoSampleProvider, seekMutex, videoMutex, config->VideoReadySamples, 0, [firstSampleTime]() { MarkStartupTime(*firstSampleTime); },
+			audioScheduler.get(), false));
+	}
+
+	// Conversion of a frame overlaps decoding of the next one
+	auto uncompressedVideoSampleProvider = dynamic_cast<UncompressedSampleProvider^>(videoSampleProvider);
+	if (uncompressedVideoSampleProvider != nullptr && config->VideoDecodeAheadFrames > 0)
+	{
+		uncompressedVideoSampleProvider->StartDecodeThread(config->VideoDecodeAheadFrames);
+	}
+}
+
+void FFmpegInteropMSS::StartTelemetryTimer()
+{
+	// The timer must not keep this instance alive, it is cancelled by the destructor
+	WeakReference weakThis(this);
+	telemetryTimer = Windows::System::Threading::ThreadPoolTimer::CreatePeriodicTimer(ref new Windows::System::Threading::TimerElapsedHandler([weakThis](Windows::System::Threading::ThreadPoolTimer^ timer)
+	{
+		auto interopMSS = weakThis.Resolve<FFmpegInteropMSS>();
+		if (interopMSS != nullptr)
+		{
+			interopMSS->OnTelemetryTimer();
+		}
+	}), config->TelemetryInterval);
+}
+
+void FFmpegInteropMSS::OnTelemetryTimer()
+{
+	TelemetryUpdated(this, ref new TelemetryUpdatedEventArgs(AudioTelemetry, VideoTelemetry));
+}
+
+TimeSpan FFmpegInteropMSS::AudioSampleDuration::get()
+{
+	auto uncompressedAudioSampleProvider = dynamic_cast<UncompressedAudioSampleProvider^>(audioSampleProvider);
+	auto compressedAudioSampleProvider = dynamic_cast<CompressedAudioSampleProvider^>(audioSampleProvider);
+	if (uncompressedAudioSampleProvider != nullptr)
+	{
+		return TimeSpan{ uncompressedAudioSampleProvider->m_sampleDuration.load() };
+	}
+	return TimeSpan{ compressedAudioSampleProvider != nullptr ? compressedAudioSampleProvider->m_sampleDuration.load() : 0 };
+}
+
+// Picked up with the next sample, e.g. to switch to large samples when the app goes to the background
+void FFmpegInteropMSS::AudioSampleDuration::set(TimeSpan value)
+{
+	auto uncompressedAudioSampleProvider = dynamic_cast<UncompressedAudioSampleProvider^>(audioSampleProvider);
+	auto compressedAudioSampleProvider = dynamic_cast<CompressedAudioSampleProvider^>(audioSampleProvider);
+	if (uncompressedAudioSampleProvider != nullptr && value.Duration > 0)
+	{
+		uncompressedAudioSampleProvider->m_sampleDuration = value.Duration;
+	}
+	else if (compressedAudioSampleProvider != nullptr && value.Duration > 0)
+	{
+		compressedAudioSampleProvider->m_sampleDuration = value.Duration;
+	}
+}
+
+FFmpegInterop::DecodeQuality FFmpegInteropMSS::VideoDecodeQuality::get()
+{
+	auto uncompressedVideoSampleProvider = dynamic_cast<UncompressedVideoSampleProvider^>(videoSampleProvider);
+	return uncompressedVideoSampleProvider != nullptr ? uncompressedVideoSampleProvider->m_decodeQuality.load() : DecodeQuality::Full;
+}
+
+void FFmpegInteropMSS::Priority::set(FFmpegInterop::DecoderPriority value)
+{
+	decoderPriority = value;
+	if (threadBudgetId >= 0)
+	{
+		DecoderThreadBudget::Instance().SetPriority(threadBudgetId, (int)value);
+	}
+}
+
+unsigned int FFmpegInteropMSS::TotalDecoderThreads::get()
+{
+	return DecoderThreadBudget::Instance().GetTotalThreads();
+}
+
+void FFmpegInteropMSS::TotalDecoderThreads::set(unsigned int value)
+{
+	DecoderThreadBudget::Instance().SetTotalThreads(value);
+}
+
 HRESULT FFmpegInteropMSS::CreateMediaStreamSource(String^ uri, bool forceAudioDecode, bool forceVideoDecode, PropertySet^ ffmpegOptions)
 {
 	HRESULT hr = S_OK;
@@ -164,6 +511,11 @@ HRESULT FFmpegInteropMSS::CreateMediaStreamSource(String^ uri, bool forceAudioDe
 		{
 			hr = E_OUTOFMEMORY;
 		}
+		else
+		{
+			avFormatCtx->interrupt_callback.callback = IsInterrupted;
+			avFormatCtx->interrupt_callback.opaque = &isInterrupted;
+		}
 	}
 
 	if (SUCCEEDED(hr))
@@ -183,6 +535,7 @@ HRESULT FFmpegInteropMSS::CreateMediaStreamSource(String^ uri, bool forceAudioDe
 		{
 			hr = E_FAIL; // Error opening file
 		}
+		MarkStartupPhase(StartupPhase::OpenInput);
 
 		// avDict is not NULL only when there is an issue with the given ffmpegOptions such as invalid key, value type etc. Iterate through it to see which one is causing the issue.
 		if (avDict != nullptr)
@@ -243,6 +596,11 @@ HRESULT FFmpegInteropMSS::CreateMediaStreamSource(IRandomAccessStream^ stream, b
 		{
 			hr = E_OUTOFMEMORY;
 		}
+		else
+		{
+			avFormatCtx->interrupt_callback.callback = IsInterrupted;
+			avFormatCtx->interrupt_callback.opaque = &isInterrupted;
+		}
 	}
 
 	if (SUCCEEDED(hr))
@@ -262,6 +620,7 @@ HRESULT FFmpegInteropMSS::CreateMediaStreamSource(IRandomAccessStream^ stream, b
 		{
 			hr = E_FAIL; // Error opening file
 		}
+		MarkStartupPhase(StartupPhase::OpenInput);
 
 		// avDict is not NULL only when there is an issue with the given ffmpegOptions such as invalid key, value type etc. Iterate through it to see which one is causing the issue.
 		if (avDict != nullptr)
@@ -297,6 +656,17 @@ HRESULT FFmpegInteropMSS::InitFFmpegContext(bool forceAudioDecode, bool forceVid
 		{
 			hr = E_FAIL; // Error finding info
 		}
+		MarkStartupPhase(StartupPhase::FindStreamInfo);
+	}
+
+	if (SUCCEEDED(hr))
+	{
+		// Realtime sources don't report a duration
+		latencyProfile = config->Profile;
+		if (latencyProfile == LatencyProfile::Auto)
+		{
+			latencyProfile = avFormatCtx->duration > 0 ? LatencyProfile::Playback : LatencyProfile::Live;
+		}
 	}
 
 	if (SUCCEEDED(hr))
@@ -306,6 +676,14 @@ HRESULT FFmpegInteropMSS::InitFFmpegContext(bool forceAudioDecode, bool forceVid
 		{
 			hr = E_OUTOFMEMORY;
 		}
+		else if (latencyProfile == LatencyProfile::Live)
+		{
+			// TimeSpan units to microseconds
+			m_pReader->SetMaxLiveLatency(config->MaxLiveLatency.Duration / 10);
+			m_pReader->m_targetLiveLatency = config->TargetLiveLatency.Duration / 10;
+			m_pReader->m_isLiveSource = true;
+			m_pReader->SetJitterBounds(config->MinJitterBuffer.Duration / 10, config->MaxJitterBuffer.Duration / 10);
+		}
 	}
 
 	if (SUCCEEDED(hr))
@@ -343,6 +721,8 @@ HRESULT FFmpegInteropMSS::InitFFmpegContext(bool forceAudioDecode, bool forceVid
 					}
 					else
 					{
+						MarkStartupPhase(StartupPhase::OpenAudioDecoder);
+
 						// Detect audio format and create audio stream descriptor accordingly
 						hr = CreateAudioStreamDescriptor(forceAudioDecode);
 						if (SUCCEEDED(hr))
@@ -350,6 +730,7 @@ HRESULT FFmpegInteropMSS::InitFFmpegContext(bool forceAudioDecode, bool forceVid
 							hr = audioSampleProvider->AllocateResources();
 							if (SUCCEEDED(hr))
 							{
+								MarkStartupPhase(StartupPhase::AllocateAudioResources);
 								m_pReader->SetAudioStream(audioStreamIndex, audioSampleProvider);
 							}
 						}
@@ -415,13 +796,10 @@ HRESULT FFmpegInteropMSS::InitFFmpegContext(bool forceAudioDecode, bool forceVid
 
 				if (SUCCEEDED(hr))
 				{
-					// enable multi threading
-					unsigned threads = std::thread::hardware_concurrency();
-					if (threads > 0)
-					{
-						avVideoCodecCtx->thread_count = threads;
-						avVideoCodecCtx->thread_type = FF_THREAD_FRAME | FF_THREAD_SLICE;
-					}
+					// enable multi threading with our share of the process wide budget
+					AVCodecParameters* codecPar = avFormatCtx->streams[videoStreamIndex]->codecpar;
+					threadBudgetId = DecoderThreadBudget::Instance().Register(codecPar->width, codecPar->height, GetVideoCodecComplexity(codecPar->codec_id), (int)decoderPriority);
+					SetVideoDecoderThreading(avVideoCodecCtx);
 
 					if (avcodec_open2(avVideoCodecCtx, avVideoCodec, NULL) < 0)
 					{
@@ -430,13 +808,22 @@ HRESULT FFmpegInteropMSS::InitFFmpegContext(bool forceAudioDecode, bool forceVid
 					}
 					else
 					{
+						MarkStartupPhase(StartupPhase::OpenVideoDecoder);
+
 						// Detect video format and create video stream descriptor accordingly
 						hr = CreateVideoStreamDescriptor(forceVideoDecode);
+						if (SUCCEEDED(hr) && dynamic_cast<UncompressedSampleProvider^>(videoSampleProvider) == nullptr)
+						{
+							// Passthrough streams are decoded by the system, leave the threads to other instances
+							DecoderThreadBudget::Instance().Unregister(threadBudgetId);
+							threadBudgetId = -1;
+						}
 						if (SUCCEEDED(hr))
 						{
 							hr = videoSampleProvider->AllocateResources();
 							if (SUCCEEDED(hr))
 							{
+								MarkStartupPhase(StartupPhase::AllocateVideoResources);
 								m_pReader->SetVideoStream(videoStreamIndex, videoSampleProvider);
 							}
 						}
@@ -452,6 +839,17 @@ HRESULT FFmpegInteropMSS::InitFFmpegContext(bool forceAudioDecode, bool forceVid
 		}
 	}
 
+	if (SUCCEEDED(hr) && config->CapturePath != nullptr && !config->CapturePath->IsEmpty())
+	{
+		// Record what the reader demuxes so the session can be replayed offline
+		std::wstring pathW(config->CapturePath->Begin());
+		std::string pathA(pathW.begin(), pathW.end());
+		if (!m_pReader->StartCapture(pathA.c_str()))
+		{
+			DebugMessage(L"Could not create the packet capture\n");
+		}
+	}
+
 	if (SUCCEEDED(hr))
 	{
 		// Convert media duration from AV_TIME_BASE to TimeSpan unit
@@ -503,12 +901,20 @@ HRESULT FFmpegInteropMSS::InitFFmpegContext(bool forceAudioDecode, bool forceVid
 			}
 			else
 			{
-				// Set buffer time to 0 for realtime streaming to reduce latency
-				mss->BufferTime = { 0 };				
+				// Set buffer time to the minimum for realtime streaming to reduce latency, it grows with the measured jitter
+				SetBufferTime(latencyProfile == LatencyProfile::Live ? config->MinJitterBuffer : TimeSpan{ 0 });
 			}
 
 			startingRequestedToken = mss->Starting += ref new TypedEventHandler<MediaStreamSource ^, MediaStreamSourceStartingEventArgs ^>(this, &FFmpegInteropMSS::OnStarting);
 			sampleRequestedToken = mss->SampleRequested += ref new TypedEventHandler<MediaStreamSource ^, MediaStreamSourceSampleRequestedEventArgs ^>(this, &FFmpegInteropMSS::OnSampleRequested);
+
+			if (config->TelemetryInterval.Duration > 0)
+			{
+				StartTelemetryTimer();
+			}
+			StartSampleProducers();
+
+			MarkStartupPhase(StartupPhase::CreateMediaStreamSource);
 		}
 		else
 		{
@@ -578,36 +984,68 @@ HRESULT FFmpegInteropMSS::ConvertCodecName(const char* codecName, String^ *outpu
 
 HRESULT FFmpegInteropMSS::CreateAudioStreamDescriptor(bool forceAudioDecode)
 {
+	LONGLONG sampleDuration = config->AudioSampleDuration.Duration;
+	if (sampleDuration <= 0)
+	{
+		sampleDuration = latencyProfile == LatencyProfile::Live ? LIVEAUDIOSAMPLEDURATION :
+			latencyProfile == LatencyProfile::Background ? BACKGROUNDAUDIOSAMPLEDURATION : PLAYBACKAUDIOSAMPLEDURATION;
+	}
+
+	if (m_pReader->m_targetLiveLatency > 0)
+	{
+		// The live time-stretch works on decoded audio, don't pass AAC or MP3 through. Only when the
+		// app opted in with TargetLiveLatency, the default keeps the pass-through.
+		forceAudioDecode = true;
+	}
+
 	if (avAudioCodecCtx->codec_id == AV_CODEC_ID_AAC && !forceAudioDecode)
 	{
 		if (avAudioCodecCtx->extradata_size == 0)
 		{
 			audioStreamDescriptor = ref new AudioStreamDescriptor(AudioEncodingProperties::CreateAacAdts(avAudioCodecCtx->sample_rate, avAudioCodecCtx->channels, (unsigned int)avAudioCodecCtx->bit_rate));
+			audioSampleProvider = CreateCompressedAudioSampleProvider(sampleDuration);
 		}
 		else
 		{
+			// Raw AAC frames carry no headers, the decoder needs exactly one per sample
 			audioStreamDescriptor = ref new AudioStreamDescriptor(AudioEncodingProperties::CreateAac(avAudioCodecCtx->sample_rate, avAudioCodecCtx->channels, (unsigned int)avAudioCodecCtx->bit_rate));
+			audioSampleProvider = ref new MediaSampleProvider(m_pReader, avFormatCtx, avAudioCodecCtx);
 		}
-		audioSampleProvider = ref new MediaSampleProvider(m_pReader, avFormatCtx, avAudioCodecCtx);
 	}
 	else if (avAudioCodecCtx->codec_id == AV_CODEC_ID_MP3 && !forceAudioDecode)
 	{
 		audioStreamDescriptor = ref new AudioStreamDescriptor(AudioEncodingProperties::CreateMp3(avAudioCodecCtx->sample_rate, avAudioCodecCtx->channels, (unsigned int)avAudioCodecCtx->bit_rate));
-		audioSampleProvider = ref new MediaSampleProvider(m_pReader, avFormatCtx, avAudioCodecCtx);
+		audioSampleProvider = CreateCompressedAudioSampleProvider(sampleDuration);
 	}
 	else
 	{
 		// We always convert to 16-bit audio so set the size here
 		audioStreamDescriptor = ref new AudioStreamDescriptor(AudioEncodingProperties::CreatePcm(avAudioCodecCtx->sample_rate, avAudioCodecCtx->channels, 16));
-		audioSampleProvider = ref new UncompressedAudioSampleProvider(m_pReader, avFormatCtx, avAudioCodecCtx);
+		auto uncompressedAudioSampleProvider = ref new UncompressedAudioSampleProvider(m_pReader, avFormatCtx, avAudioCodecCtx);
+		uncompressedAudioSampleProvider->m_sampleDuration = sampleDuration;
+		audioSampleProvider = uncompressedAudioSampleProvider;
 	}
 
 	return (audioStreamDescriptor != nullptr && audioSampleProvider != nullptr) ? S_OK : E_OUTOFMEMORY;
 }
 
+// Frames that can be concatenated are batched if the config asks for it, otherwise each frame is a sample
+MediaSampleProvider^ FFmpegInteropMSS::CreateCompressedAudioSampleProvider(LONGLONG sampleDuration)
+{
+	if (!config->BatchPassthroughAudio)
+	{
+		return ref new MediaSampleProvider(m_pReader, avFormatCtx, avAudioCodecCtx);
+	}
+
+	auto compressedAudioSampleProvider = ref new CompressedAudioSampleProvider(m_pReader, avFormatCtx, avAudioCodecCtx);
+	compressedAudioSampleProvider->m_sampleDuration = sampleDuration;
+	return compressedAudioSampleProvider;
+}
+
 HRESULT FFmpegInteropMSS::CreateVideoStreamDescriptor(bool forceVideoDecode)
 {
 	VideoEncodingProperties^ videoProperties;	
+	UncompressedVideoSampleProvider^ uncompressedVideoSampleProvider;
 
 	if (avVideoCodecCtx->codec_id == AV_CODEC_ID_H264 && !forceVideoDecode)
 	{
@@ -631,7 +1069,8 @@ HRESULT FFmpegInteropMSS::CreateVideoStreamDescriptor(bool forceVideoDecode)
 	else
 	{
 		videoProperties = VideoEncodingProperties::CreateUncompressed(MediaEncodingSubtypes::Nv12, avVideoCodecCtx->width, avVideoCodecCtx->height);
-		videoSampleProvider = ref new UncompressedVideoSampleProvider(m_pReader, avFormatCtx, avVideoCodecCtx);
+		uncompressedVideoSampleProvider = ref new UncompressedVideoSampleProvider(m_pReader, avFormatCtx, avVideoCodecCtx);
+		videoSampleProvider = uncompressedVideoSampleProvider;
 
 		if (avVideoCodecCtx->sample_aspect_ratio.num > 0 && avVideoCodecCtx->sample_aspect_ratio.den != 0)
 		{
@@ -661,9 +1100,67 @@ HRESULT FFmpegInteropMSS::CreateVideoStreamDescriptor(bool forceVideoDecode)
 	videoProperties->Bitrate = (unsigned int)avVideoCodecCtx->bit_rate;
 	videoStreamDescriptor = ref new VideoStreamDescriptor(videoProperties);
 
+	if (uncompressedVideoSampleProvider != nullptr)
+	{
+		// Let the provider signal mid-stream resolution and format changes through the descriptor
+		uncompressedVideoSampleProvider->m_pStreamDescriptor = videoStreamDescriptor;
+	}
+
 	return (videoStreamDescriptor != nullptr && videoSampleProvider != nullptr) ? S_OK : E_OUTOFMEMORY;
 }
 
+unsigned int FFmpegInteropMSS::GetVideoDecoderThreadCount()
+{
+	unsigned threads = threadBudgetId >= 0 ? DecoderThreadBudget::Instance().GetThreadCount(threadBudgetId) : std::thread::hardware_concurrency();
+	if (threads > 0 && latencyProfile != LatencyProfile::Live && config->MaxVideoDecoderThreads > 0)
+	{
+		// Frame threading adds a frame of delay and memory per thread, cap it
+		threads = min(threads, config->MaxVideoDecoderThreads);
+	}
+	return threads;
+}
+
+void FFmpegInteropMSS::SetVideoDecoderThreading(AVCodecContext* codecCtx)
+{
+	threadBudgetGeneration = DecoderThreadBudget::Instance().GetGeneration();
+	unsigned threads = GetVideoDecoderThreadCount();
+	if (threads > 0)
+	{
+		videoDecoderThreads = threads;
+		codecCtx->thread_count = threads;
+		if (latencyProfile == LatencyProfile::Live)
+		{
+			// Frame threading holds back one frame per thread, slice threading adds no delay
+			codecCtx->thread_type = FF_THREAD_SLICE;
+			codecCtx->flags |= AV_CODEC_FLAG_LOW_DELAY;
+		}
+		else
+		{
+			// Frame threading scales best for files
+			codecCtx->thread_type = FF_THREAD_FRAME | FF_THREAD_SLICE;
+		}
+	}
+}
+
+// Pick up the share of a rebalanced budget. FFmpeg fixes the thread count when the codec is opened,
+// the provider reopens the decoder at the next keyframe.
+void FFmpegInteropMSS::UpdateVideoDecoderThreads()
+{
+	auto uncompressedVideoSampleProvider = dynamic_cast<UncompressedSampleProvider^>(videoSampleProvider);
+	if (threadBudgetId < 0 || uncompressedVideoSampleProvider == nullptr)
+	{
+		return;
+	}
+
+	threadBudgetGeneration = DecoderThreadBudget::Instance().GetGeneration();
+	unsigned threads = GetVideoDecoderThreadCount();
+	if (threads > 0 && threads != videoDecoderThreads)
+	{
+		videoDecoderThreads = threads;
+		uncompressedVideoSampleProvider->SetDecoderThreadCount(threads);
+	}
+}
+
 HRESULT FFmpegInteropMSS::ParseOptions(PropertySet^ ffmpegOptions)
 {
 	HRESULT hr = S_OK;
@@ -702,11 +1199,21 @@ HRESULT FFmpegInteropMSS::ParseOptions(PropertySet^ ffmpegOptions)
 
 void FFmpegInteropMSS::OnStarting(MediaStreamSource ^sender, MediaStreamSourceStartingEventArgs ^args)
 {
+	TRACE_SPAN(TraceSeek, "Starting");
 	MediaStreamSourceStartingRequest^ request = args->Request;
 
+	// Wait for sample requests still in flight before moving the reader
+	std::lock_guard<std::shared_timed_mutex> lock(seekMutex);
+	auto uncompressedSampleProvider = dynamic_cast<UncompressedSampleProvider^>(videoSampleProvider);
+	if (uncompressedSampleProvider != nullptr)
+	{
+		uncompressedSampleProvider->PauseDecodeThread();
+	}
+
 	// Perform seek operation when MediaStreamSource received seek event from MediaElement
 	if (request->StartPosition && request->StartPosition->Value.Duration <= mediaDuration.Duration)
 	{
+		TimeSpan actualPosition = request->StartPosition->Value;
 		// Select the first valid stream either from video or audio
 		int streamIndex = videoStreamIndex >= 0 ? videoStreamIndex : audioStreamIndex >= 0 ? audioStreamIndex : -1;
 
@@ -723,45 +1230,206 @@ void FFmpegInteropMSS::OnStarting(MediaStreamSource ^sender, MediaStreamSourceSt
 			{
 				// Add deferral
 
+				// The requested position is on the original timeline
+				m_pReader->m_timeStretchOffset = 0;
+
 				// Flush the AudioSampleProvider
 				if (audioSampleProvider != nullptr)
 				{
 					audioSampleProvider->Flush();
 					avcodec_flush_buffers(avAudioCodecCtx);
+					if (audioProducer != nullptr)
+					{
+						audioProducer->Flush();
+					}
 				}
 
 				// Flush the VideoSampleProvider
 				if (videoSampleProvider != nullptr)
 				{
 					videoSampleProvider->Flush();
-					avcodec_flush_buffers(avVideoCodecCtx);
+					if (videoProducer != nullptr)
+					{
+						videoProducer->Flush();
+					}
+
+					// The reader is on a keyframe now, pick up a rebalanced thread count
+					UpdateVideoDecoderThreads();
+				}
+
+				if (seekMode == FFmpegInterop::SeekMode::Fast)
+				{
+					SeekToKeyFrame(streamIndex, actualPosition);
+				}
+				else
+				{
+					SetSeekTarget(actualPosition);
 				}
 			}
 		}
 
-		request->SetActualStartPosition(request->StartPosition->Value);
+		request->SetActualStartPosition(actualPosition);
+	}
+
+	if (uncompressedSampleProvider != nullptr)
+	{
+		uncompressedSampleProvider->ResumeDecodeThread();
+		uncompressedSampleProvider->PreRollDecodeThread();
+	}
+
+	// Fill the ready queues of both streams in parallel while the player sets up, so the first request
+	// of each stream only waits for its own decoding. The workers start once the seek lock is released.
+	if (audioProducer != nullptr)
+	{
+		audioProducer->PreRoll();
+	}
+	if (videoProducer != nullptr)
+	{
+		videoProducer->PreRoll();
+	}
+
+	// Starting is also raised when playback resumes after a pause, the renderer clock restarts either way
+	auto uncompressedVideoSampleProvider = dynamic_cast<UncompressedVideoSampleProvider^>(videoSampleProvider);
+	if (uncompressedVideoSampleProvider != nullptr)
+	{
+		uncompressedVideoSampleProvider->ResetClock();
+	}
+}
+
+// Demux up to the keyframe the reader landed on, playback really starts there. Audio before it is dropped
+// so both streams start together.
+void FFmpegInteropMSS::SeekToKeyFrame(int streamIndex, TimeSpan& position)
+{
+	MediaSampleProvider^ seekProvider = streamIndex == videoStreamIndex ? videoSampleProvider : audioSampleProvider;
+
+	// Runs with seekMutex held exclusively, a stream that sends nothing must not make it read to the end
+	for (int packetCount = 0; seekProvider->IsPacketQueueEmpty(); packetCount++)
+	{
+		if (!seekProvider->IsEnabled() || packetCount >= MAXKEYFRAMESEARCHPACKETS || m_pReader->ReadPacket() < 0)
+		{
+			return;
+		}
+	}
+
+	LONGLONG keyFramePosition = 0;
+	if (seekProvider->GetFirstPacketPosition(keyFramePosition))
+	{
+		position.Duration = max(keyFramePosition, 0LL);
+		if (seekProvider != audioSampleProvider && audioSampleProvider != nullptr)
+		{
+			audioSampleProvider->DropPacketsBefore(seekProvider->GetFirstPacketTime());
+		}
+	}
+}
+
+// Decoded streams drop what comes before the requested position themselves, without converting it.
+// Passed through streams are dropped by the system decoder.
+void FFmpegInteropMSS::SetSeekTarget(TimeSpan position)
+{
+	auto uncompressedAudioSampleProvider = dynamic_cast<UncompressedSampleProvider^>(audioSampleProvider);
+	if (uncompressedAudioSampleProvider != nullptr)
+	{
+		uncompressedAudioSampleProvider->SetSeekTarget(position.Duration);
+	}
+
+	auto uncompressedVideoSampleProvider = dynamic_cast<UncompressedSampleProvider^>(videoSampleProvider);
+	if (uncompressedVideoSampleProvider != nullptr)
+	{
+		uncompressedVideoSampleProvider->SetSeekTarget(position.Duration);
 	}
 }
 
 void FFmpegInteropMSS::OnSampleRequested(Windows::Media::Core::MediaStreamSource ^sender, MediaStreamSourceSampleRequestedEventArgs ^args)
 {
-	mutexGuard.lock();
+	DecodeQualityChangedEventArgs^ qualityChangedArgs = nullptr;
+	LiveCatchUpEventArgs^ catchUpArgs = nullptr;
+
+	TRACE_SPAN(TraceSample, "SampleRequested");
+	MarkStartupPhase(StartupPhase::FirstSampleRequest);
+
+	std::shared_lock<std::shared_timed_mutex> lock(seekMutex);
 	if (mss != nullptr)
 	{
 		if (args->Request->StreamDescriptor == audioStreamDescriptor && audioSampleProvider != nullptr)
 		{
-			args->Request->Sample = audioSampleProvider->GetNextSample();
+			if (audioProducer != nullptr)
+			{
+				audioProducer->Serve(args->Request);
+			}
+			else
+			{
+				std::lock_guard<std::mutex> audioLock(audioMutex);
+				args->Request->Sample = audioSampleProvider->GetNextSample();
+				if (args->Request->Sample != nullptr)
+				{
+					audioSampleProvider->RecordSampleHandoff(args->Request->Sample, audioSampleProvider->TakeSampleTiming());
+					MarkStartupPhase(StartupPhase::FirstAudioSample);
+				}
+			}
 		}
 		else if (args->Request->StreamDescriptor == videoStreamDescriptor && videoSampleProvider != nullptr)
 		{
-			args->Request->Sample = videoSampleProvider->GetNextSample();
+			if (threadBudgetId >= 0 && DecoderThreadBudget::Instance().GetGeneration() != threadBudgetGeneration)
+			{
+				// Another instance was opened, closed or changed priority
+				UpdateVideoDecoderThreads();
+			}
+
+			if (videoProducer != nullptr)
+			{
+				videoProducer->Serve(args->Request);
+			}
+			else
+			{
+				std::lock_guard<std::mutex> videoLock(videoMutex);
+				MediaStreamSample^ sample = videoSampleProvider->GetNextSample();
+				if (sample != nullptr)
+				{
+					videoSampleProvider->ApplySampleFormat(videoSampleProvider->TakeSampleFormat());
+				}
+				args->Request->Sample = sample;
+				if (sample != nullptr)
+				{
+					videoSampleProvider->RecordSampleHandoff(sample, videoSampleProvider->TakeSampleTiming());
+					MarkStartupPhase(StartupPhase::FirstVideoSample);
+				}
+			}
+
+			// Not under videoMutex, the worker holds it while it reads and decodes the next sample
+			auto uncompressedVideoSampleProvider = dynamic_cast<UncompressedVideoSampleProvider^>(videoSampleProvider);
+			if (uncompressedVideoSampleProvider != nullptr && uncompressedVideoSampleProvider->m_decodeQualityChanged.exchange(false))
+			{
+				qualityChangedArgs = ref new DecodeQualityChangedEventArgs(uncompressedVideoSampleProvider->m_decodeQuality.load(), uncompressedVideoSampleProvider->m_decodeLoad);
+			}
 		}
 		else
 		{
 			args->Request->Sample = nullptr;
 		}
+
+		if (m_pReader != nullptr && m_pReader->m_isLiveSource)
+		{
+			UpdateJitterBuffer();
+		}
+
+		if (m_pReader != nullptr && m_pReader->m_liveCatchUpPending.exchange(false))
+		{
+			TimeSpan latencyBefore = { m_pReader->m_latencyBeforeCatchUp * 10 };
+			TimeSpan latencyAfter = { m_pReader->m_latencyAfterCatchUp * 10 };
+			catchUpArgs = ref new LiveCatchUpEventArgs(latencyBefore, latencyAfter);
+		}
+	}
+	lock.unlock();
+
+	// Raise outside of the lock so handlers can query this instance
+	if (qualityChangedArgs != nullptr)
+	{
+		DecodeQualityChanged(this, qualityChangedArgs);
+	}
+	if (catchUpArgs != nullptr)
+	{
+		LiveCatchUp(this, catchUpArgs);
 	}
-	mutexGuard.unlock();
 }
 
 // Static function to read file stream and pass data to FFmpeg. Credit to Philipp Sch http://www.codeproject.com/Tips/489450/Creating-Custom-FFmpeg-IO-Context
@@ -801,6 +1469,29 @@ static int64_t FileStreamSeek(void* ptr, int64_t pos, int whence)
 	return out.QuadPart; // Return the new position:
 }
 
+// Static function polled by FFmpeg while it waits on the network, a non-zero return fails the read
+// Relative cost of decoding a pixel, H.264 is the unit
+static double GetVideoCodecComplexity(AVCodecID codecId)
+{
+	switch (codecId)
+	{
+	case AV_CODEC_ID_HEVC:
+	case AV_CODEC_ID_VP9:
+		return 1.5;
+	case AV_CODEC_ID_H264:
+	case AV_CODEC_ID_VP8:
+		return 1.0;
+	default:
+		// MPEG-2/MPEG-4 part 2 and older codecs are cheap to decode
+		return 0.6;
+	}
+}
+
+static int IsInterrupted(void* ptr)
+{
+	return reinterpret_cast<std::atomic<bool>*>(ptr)->load() ? 1 : 0;
+}
+
 static int lock_manager(void **mtx, enum AVLockOp op)
 {
 	switch (op)
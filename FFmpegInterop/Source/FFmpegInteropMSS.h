@@ -18,10 +18,19 @@
 
 #pragma once
 #include <queue>
+#include <memory>
 #include <mutex>
+#include <shared_mutex>
+#include "DecodeQualityChangedEventArgs.h"
+#include "FFmpegInteropConfig.h"
 #include "FFmpegReader.h"
+#include "LatencyStatistics.h"
+#include "LiveCatchUpEventArgs.h"
 #include "MediaSampleProvider.h"
 #include "MediaThumbnailData.h"
+#include "SampleProducer.h"
+#include "StartupTimings.h"
+#include "TelemetryUpdatedEventArgs.h"
 
 using namespace Platform;
 using namespace Windows::Foundation;
@@ -38,17 +47,35 @@ namespace FFmpegInterop
 	public ref class FFmpegInteropMSS sealed
 	{
 	public:
+		static FFmpegInteropMSS^ CreateFFmpegInteropMSSFromStream(IRandomAccessStream^ stream, bool forceAudioDecode, bool forceVideoDecode, PropertySet^ ffmpegOptions, MediaStreamSource^ mss, FFmpegInteropConfig^ config);
 		static FFmpegInteropMSS^ CreateFFmpegInteropMSSFromStream(IRandomAccessStream^ stream, bool forceAudioDecode, bool forceVideoDecode, PropertySet^ ffmpegOptions, MediaStreamSource^ mss);
 		static FFmpegInteropMSS^ CreateFFmpegInteropMSSFromStream(IRandomAccessStream^ stream, bool forceAudioDecode, bool forceVideoDecode, PropertySet^ ffmpegOptions);
 		static FFmpegInteropMSS^ CreateFFmpegInteropMSSFromStream(IRandomAccessStream^ stream, bool forceAudioDecode, bool forceVideoDecode);
+		static FFmpegInteropMSS^ CreateFFmpegInteropMSSFromUri(String^ uri, bool forceAudioDecode, bool forceVideoDecode, PropertySet^ ffmpegOptions, FFmpegInteropConfig^ config);
 		static FFmpegInteropMSS^ CreateFFmpegInteropMSSFromUri(String^ uri, bool forceAudioDecode, bool forceVideoDecode, PropertySet^ ffmpegOptions);
 		static FFmpegInteropMSS^ CreateFFmpegInteropMSSFromUri(String^ uri, bool forceAudioDecode, bool forceVideoDecode);
 		MediaThumbnailData^ ExtractThumbnail();
 
+		// Raised when the video decoder trades quality for speed or gets it back
+		event TypedEventHandler<FFmpegInteropMSS^, DecodeQualityChangedEventArgs^>^ DecodeQualityChanged;
+		// Raised after a live stream skipped ahead to get back to the live edge
+		event TypedEventHandler<FFmpegInteropMSS^, LiveCatchUpEventArgs^>^ LiveCatchUp;
+		// Raised every FFmpegInteropConfig::TelemetryInterval from a thread pool thread
+		event TypedEventHandler<FFmpegInteropMSS^, TelemetryUpdatedEventArgs^>^ TelemetryUpdated;
+
 		// Contructor
 		MediaStreamSource^ GetMediaStreamSource();
 		virtual ~FFmpegInteropMSS();
 
+		// Per stage latency of the samples handed out since the last reset, one entry per LatencyStage
+		IVectorView<LatencyStatistics^>^ GetAudioLatencyStatistics();
+		IVectorView<LatencyStatistics^>^ GetVideoLatencyStatistics();
+		// The statistics of both streams as JSON, times in microseconds
+		String^ ExportLatencyStatistics();
+		void ResetLatencyStatistics();
+		// How long each startup phase took to reach, phases still ahead are null
+		StartupTimings^ GetStartupTimings();
+
 		// Properties
 		property AudioStreamDescriptor^ AudioDescriptor
 		{
@@ -85,26 +112,130 @@ namespace FFmpegInterop
 				return audioCodecName;
 			};
 		};
+		// Latency profile in effect after resolving LatencyProfile::Auto against the opened source
+		property FFmpegInterop::LatencyProfile ActiveLatencyProfile
+		{
+			FFmpegInterop::LatencyProfile get()
+			{
+				return latencyProfile;
+			};
+		};
+		// Average time a video frame spends inside the software decoder, which grows with frame threading
+		property TimeSpan VideoDecodeLatency
+		{
+			TimeSpan get();
+		};
+		// Decoded video frames discarded before conversion because they were already late
+		property unsigned long long VideoFramesDropped
+		{
+			unsigned long long get();
+		};
+		// How far a live stream is behind its live edge
+		property TimeSpan LiveLatency
+		{
+			TimeSpan get();
+		};
+		// Smoothed interarrival jitter of a live source (RFC 3550)
+		property TimeSpan NetworkJitter
+		{
+			TimeSpan get();
+		};
+		// Media the MediaStreamSource currently buffers to absorb the jitter
+		property TimeSpan JitterBufferTime
+		{
+			TimeSpan get();
+		};
+		// Speed of decoded audio, above 1.0 while a live stream converges to FFmpegInteropConfig::TargetLiveLatency
+		property double AudioPlaybackRate
+		{
+			double get();
+		};
+		// Duration of the decoded or batched audio samples, 0 when audio is passed through frame by frame.
+		// See FFmpegInteropConfig::AudioSampleDuration and FFmpegInteropConfig::BatchPassthroughAudio.
+		property TimeSpan AudioSampleDuration
+		{
+			TimeSpan get();
+			void set(TimeSpan value);
+		};
+		// Snapshot of the pipeline counters of each stream, null if there is no such stream
+		property StreamTelemetry^ AudioTelemetry
+		{
+			StreamTelemetry^ get();
+		};
+		property StreamTelemetry^ VideoTelemetry
+		{
+			StreamTelemetry^ get();
+		};
+		// Current step of the video decode quality ladder
+		property FFmpegInterop::DecodeQuality VideoDecodeQuality
+		{
+			FFmpegInterop::DecodeQuality get();
+		};
+		// Weight of this instance in the decoder thread budget, a new share is applied on the next seek
+		property FFmpegInterop::DecoderPriority Priority
+		{
+			FFmpegInterop::DecoderPriority get()
+			{
+				return decoderPriority;
+			};
+			void set(FFmpegInterop::DecoderPriority value);
+		};
+		// Applies to the next seek, e.g. Fast while the user drags a slider and Accurate once it is released
+		property FFmpegInterop::SeekMode SeekMode
+		{
+			FFmpegInterop::SeekMode get()
+			{
+				return seekMode;
+			};
+			void set(FFmpegInterop::SeekMode value)
+			{
+				seekMode = value;
+			};
+		};
+		// Number of video decoder threads shared by all instances in the process
+		static property unsigned int TotalDecoderThreads
+		{
+			unsigned int get();
+			void set(unsigned int value);
+		};
 
 	internal:
 		int ReadPacket();
 
 	private:
-		FFmpegInteropMSS();
+		FFmpegInteropMSS(FFmpegInteropConfig^ config);
 
 		HRESULT CreateMediaStreamSource(IRandomAccessStream^ stream, bool forceAudioDecode, bool forceVideoDecode, PropertySet^ ffmpegOptions, MediaStreamSource^ mss);
 		HRESULT CreateMediaStreamSource(String^ uri, bool forceAudioDecode, bool forceVideoDecode, PropertySet^ ffmpegOptions);
 		HRESULT InitFFmpegContext(bool forceAudioDecode, bool forceVideoDecode);
 		HRESULT CreateAudioStreamDescriptor(bool forceAudioDecode);
+		MediaSampleProvider^ CreateCompressedAudioSampleProvider(LONGLONG sampleDuration);
 		HRESULT CreateVideoStreamDescriptor(bool forceVideoDecode);
 		HRESULT ConvertCodecName(const char* codecName, String^ *outputCodecName);
 		HRESULT ParseOptions(PropertySet^ ffmpegOptions);
+		unsigned int GetVideoDecoderThreadCount();
+		void SetVideoDecoderThreading(AVCodecContext* codecCtx);
+		void UpdateVideoDecoderThreads();
 		void OnStarting(MediaStreamSource ^sender, MediaStreamSourceStartingEventArgs ^args);
+		void SeekToKeyFrame(int streamIndex, TimeSpan& position);
+		void SetSeekTarget(TimeSpan position);
 		void OnSampleRequested(MediaStreamSource ^sender, MediaStreamSourceSampleRequestedEventArgs ^args);
+		void UpdateJitterBuffer();
+		void SetBufferTime(TimeSpan bufferTime);
+		static IVectorView<LatencyStatistics^>^ GetLatencyStatistics(MediaSampleProvider^ sampleProvider);
+		static std::wstring ExportLatencyStatistics(MediaSampleProvider^ sampleProvider);
+		void StartTelemetryTimer();
+		void StartSampleProducers();
+		// Record the first time a startup phase is reached
+		void MarkStartupPhase(StartupPhase phase);
+		void OnTelemetryTimer();
 
 		MediaStreamSource^ mss;
 		EventRegistrationToken startingRequestedToken;
 		EventRegistrationToken sampleRequestedToken;
+		Windows::System::Threading::ThreadPoolTimer^ telemetryTimer;
+		// av_gettime_relative when each startup phase was reached, INT64_MIN until then
+		std::atomic<int64_t> startupTimes[static_cast<int>(StartupPhase::Count)];
 
 		internal:
 		AVDictionary* avDict;
@@ -120,12 +251,32 @@ namespace FFmpegInterop
 		int videoStreamIndex;
 		int thumbnailStreamIndex;
 		
+		FFmpegInteropConfig^ config;
+		FFmpegInterop::LatencyProfile latencyProfile;
+		FFmpegInterop::DecoderPriority decoderPriority;
+		FFmpegInterop::SeekMode seekMode;
+		int threadBudgetId;
+		// Budget generation and thread count the video decoder was last set up with
+		unsigned int threadBudgetGeneration;
+		unsigned int videoDecoderThreads;
 		bool rotateVideo;
 		int rotationAngle;
-		std::recursive_mutex mutexGuard;
+		// Lock order: seekMutex, then audioMutex or videoMutex, then the reader and the packet queues.
+		// Sample requests hold seekMutex shared so audio and video are served in parallel, Starting
+		// and the destructor hold it exclusively.
+		std::shared_timed_mutex seekMutex;
+		std::mutex audioMutex;
+		std::mutex videoMutex;
 		
 		MediaSampleProvider^ audioSampleProvider;
 		MediaSampleProvider^ videoSampleProvider;
+		// Decode ahead of the sample requests, null when the ready queue of the stream is disabled
+		std::unique_ptr<AudioPriorityScheduler> audioScheduler;
+		bool isAudioThreadReserved;
+		// Set by the destructor, fails blocking reads so the worker threads can be joined
+		std::atomic<bool> isInterrupted;
+		std::unique_ptr<SampleProducer> audioProducer;
+		std::unique_ptr<SampleProducer> videoProducer;
 
 		String^ videoCodecName;
 		String^ audioCodecName;
@@ -0,0 +1,46 @@
+//*****************************************************************************
+//
+//	Copyright 2017 Microsoft Corporation
+//
+//	Licensed under the Apache License, Version 2.0 (the "License");
+//	you may not use this file except in compliance with the License.
+//	You may obtain a copy of the License at
+//
+//	http ://www.apache.org/licenses/LICENSE-2.0
+//
+//	Unless required by applicable law or agreed to in writing, software
+//	distributed under the License is distributed on an "AS IS" BASIS,
+//	WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//	See the License for the specific language governing permissions and
+//	limitations under the License.
+//
+//*****************************************************************************
+
+
+#include "pch.h"
+#include "FFmpegInteropTracing.h"
+#include "TraceRecorder.h"
+
+using namespace FFmpegInterop;
+using namespace Platform;
+
+FFmpegInteropTracing::FFmpegInteropTracing()
+{
+}
+
+void FFmpegInteropTracing::Start(TraceCategories categories)
+{
+	TraceRecorder::Instance().Start((unsigned int)categories);
+}
+
+void FFmpegInteropTracing::Stop()
+{
+	TraceRecorder::Instance().Stop();
+}
+
+String^ FFmpegInteropTracing::ExportChromeTrace()
+{
+	std::string json = TraceRecorder::Instance().ExportChromeTrace();
+	std::wstring jsonW(json.begin(), json.end());
+	return ref new String(jsonW.c_str());
+}
@@ -0,0 +1,49 @@
+//*****************************************************************************
+//
+//	Copyright 2017 Microsoft Corporation
+//
+//	Licensed under the Apache License, Version 2.0 (the "License");
+//	you may not use this file except in compliance with the License.
+//	You may obtain a copy of the License at
+//
+//	http ://www.apache.org/licenses/LICENSE-2.0
+//
+//	Unless required by applicable law or agreed to in writing, software
+//	distributed under the License is distributed on an "AS IS" BASIS,
+//	WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//	See the License for the specific language governing permissions and
+//	limitations under the License.
+//
+//*****************************************************************************
+
+
+#pragma once
+
+namespace FFmpegInterop
+{
+	// Areas of the pipeline that can be traced, values match TraceCategory in TraceRecorder.h
+	[Platform::Metadata::Flags]
+	public enum class TraceCategories : unsigned int
+	{
+		None = 0,
+		Demux = 1,
+		Decode = 2,
+		Convert = 4,
+		Sample = 8,
+		Seek = 16,
+		All = 31
+	};
+
+	public ref class FFmpegInteropTracing sealed
+	{
+	public:
+		// Discard the previous trace and record spans of the given categories on every thread
+		static void Start(TraceCategories categories);
+		static void Stop();
+		// The spans recorded since Start in Chrome trace-event format, for chrome://tracing or Perfetto
+		static Platform::String^ ExportChromeTrace();
+
+	private:
+		FFmpegInteropTracing();
+	};
+}
@@ -18,24 +18,92 @@
 
 #include "pch.h"
 #include "FFmpegReader.h"
+#include "TraceRecorder.h"
+
+extern "C"
+{
+#include <libavutil/time.h>
+}
 
 using namespace FFmpegInterop;
 
+// Latency a catch-up aims for (microseconds)
+const int64_t LIVECATCHUPTARGET = 500000;
+// Upper bound of packets read ahead in one catch-up, in case the source never reaches the target
+const int MAXCATCHUPPACKETS = 4096;
+// Longest a catch-up reads with the reader lock held (microseconds). Buffered packets are read well
+// within it, once reads wait on the network the backlog is used up.
+const int64_t MAXCATCHUPTIME = 100000;
+// After a catch-up that found no keyframe, wait this long or for the next video keyframe before
+// trying again, so a stream with a long GOP isn't read ahead for MAXCATCHUPTIME on every packet
+const int64_t LIVECATCHUPRETRYINTERVAL = 1000000;
+
 FFmpegReader::FFmpegReader(AVFormatContext* avFormatCtx)
 	: m_pAvFormatCtx(avFormatCtx)
 	, m_audioStreamIndex(AVERROR_STREAM_NOT_FOUND)
 	, m_videoStreamIndex(AVERROR_STREAM_NOT_FOUND)
+	, m_isLiveSource(false)
+	, m_networkJitter(0)
+	, m_jitterTargetDelay(0)
+	, m_targetLiveLatency(0)
+	, m_timeStretchOffset(0)
+	, m_liveLatency(0)
+	, m_latencyBeforeCatchUp(0)
+	, m_latencyAfterCatchUp(0)
+	, m_liveCatchUpPending(false)
+	, m_maxLiveLatency(0)
+	, m_liveStartTime(AV_NOPTS_VALUE)
+	, m_liveStartPts(AV_NOPTS_VALUE)
+	, m_liveEdgeLatency(0)
+	, m_catchUpRetryTime(0)
+	, m_pCapture(nullptr)
 {
 }
 
 FFmpegReader::~FFmpegReader()
 {
+	delete m_pCapture;
+}
+
+bool FFmpegReader::StartCapture(const char* path)
+{
+	delete m_pCapture;
+	m_pCapture = PacketCapture::Create(path, m_pAvFormatCtx, m_audioStreamIndex, m_videoStreamIndex);
+	return m_pCapture != nullptr;
+}
+
+void FFmpegReader::SetJitterBounds(int64_t minDelay, int64_t maxDelay)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	m_jitterEstimator.SetBounds(minDelay, maxDelay);
+	m_jitterTargetDelay = m_jitterEstimator.GetTargetDelay();
+}
+
+void FFmpegReader::SetMaxLiveLatency(int64_t maxLatency)
+{
+	m_maxLiveLatency = maxLatency;
+}
+
+int FFmpegReader::ReadPacket()
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+
+	int ret = ReadAndQueuePacket();
+
+	if (ret >= 0 && m_maxLiveLatency > 0 && m_liveLatency > m_maxLiveLatency && av_gettime_relative() >= m_catchUpRetryTime)
+	{
+		CatchUpToLiveEdge();
+	}
+
+	return ret;
 }
 
 // Read the next packet from the stream and push it into the appropriate
 // sample provider
-int FFmpegReader::ReadPacket()
+int FFmpegReader::ReadAndQueuePacket()
 {
+	TRACE_SPAN(TraceDemux, "ReadPacket");
+
 	int ret;
 	AVPacket avPacket;
 	av_init_packet(&avPacket);
@@ -48,6 +116,33 @@ int FFmpegReader::ReadPacket()
 		return ret;
 	}
 
+	if (m_pCapture != nullptr)
+	{
+		m_pCapture->Write(&avPacket, av_gettime_relative());
+	}
+
+	if (m_maxLiveLatency > 0)
+	{
+		UpdateLiveLatency(&avPacket);
+
+		if (avPacket.stream_index == m_videoStreamIndex && (avPacket.flags & AV_PKT_FLAG_KEY))
+		{
+			// Something to skip to now, a catch-up that is backing off can try again
+			m_catchUpRetryTime = 0;
+		}
+	}
+
+	// Packets are pulled as the decoders need them, not timestamped by the IO layer. At the live edge the
+	// reads wait on the network, so this is the arrival time; packets already buffered come in a burst.
+	// Packets are sent in decode order, with B-frames the pts would jump back and forth like jitter.
+	int64_t sendTime = avPacket.dts != AV_NOPTS_VALUE ? avPacket.dts : avPacket.pts;
+	if (m_isLiveSource && sendTime != AV_NOPTS_VALUE && avPacket.stream_index == (m_videoStreamIndex >= 0 ? m_videoStreamIndex : m_audioStreamIndex))
+	{
+		m_jitterEstimator.AddPacket(av_gettime_relative(), av_rescale_q(sendTime, m_pAvFormatCtx->streams[avPacket.stream_index]->time_base, AV_TIME_BASE_Q));
+		m_networkJitter = m_jitterEstimator.GetJitter();
+		m_jitterTargetDelay = m_jitterEstimator.GetTargetDelay();
+	}
+
 	// Push the packet to the appropriate
 	if (avPacket.stream_index == m_audioStreamIndex && m_audioSampleProvider != nullptr)
 	{
@@ -66,6 +161,90 @@ int FFmpegReader::ReadPacket()
 	return ret;
 }
 
+// Packets of a live source are produced in real time. Once reading falls behind, e.g. after a network
+// stall, the difference between elapsed wall time and elapsed pts grows and never shrinks again.
+void FFmpegReader::UpdateLiveLatency(AVPacket* avPacket)
+{
+	// Measure on video if there is any, audio packets are interleaved with some slack
+	int clockStreamIndex = m_videoStreamIndex >= 0 ? m_videoStreamIndex : m_audioStreamIndex;
+	if (avPacket->stream_index != clockStreamIndex || avPacket->pts == AV_NOPTS_VALUE)
+	{
+		return;
+	}
+
+	int64_t now = av_gettime_relative();
+	int64_t pts = av_rescale_q(avPacket->pts, m_pAvFormatCtx->streams[clockStreamIndex]->time_base, AV_TIME_BASE_Q);
+	if (m_liveStartTime == AV_NOPTS_VALUE)
+	{
+		m_liveStartTime = now;
+		m_liveStartPts = pts;
+	}
+
+	int64_t latency = (now - m_liveStartTime) - (pts - m_liveStartPts);
+	m_liveEdgeLatency = min(m_liveEdgeLatency, latency);
+	m_liveLatency = latency - m_liveEdgeLatency;
+}
+
+// Read the backlog the demuxer has buffered up to the live edge, then continue from its newest keyframe.
+// The skipped time is taken out of the sample timestamps so the renderer doesn't wait for it.
+void FFmpegReader::CatchUpToLiveEdge()
+{
+	int64_t latencyBefore = m_liveLatency;
+	int64_t playbackTime = AV_NOPTS_VALUE;
+	if (m_videoSampleProvider != nullptr)
+	{
+		playbackTime = m_videoSampleProvider->GetFirstPacketTime();
+	}
+	else if (m_audioSampleProvider != nullptr)
+	{
+		playbackTime = m_audioSampleProvider->GetFirstPacketTime();
+	}
+
+	int64_t deadline = av_gettime_relative() + MAXCATCHUPTIME;
+	for (int i = 0; i < MAXCATCHUPPACKETS && m_liveLatency > LIVECATCHUPTARGET && av_gettime_relative() < deadline; i++)
+	{
+		if (ReadAndQueuePacket() < 0)
+		{
+			break;
+		}
+	}
+
+	int64_t skipTime = AV_NOPTS_VALUE;
+	if (m_videoSampleProvider != nullptr)
+	{
+		skipTime = m_videoSampleProvider->DropPacketsBeforeLastKeyFrame();
+	}
+	else if (m_audioSampleProvider != nullptr)
+	{
+		// Audio frames can all be decoded independently, start right at the edge
+		skipTime = m_audioSampleProvider->GetFirstPacketTime() + latencyBefore - m_liveLatency;
+	}
+
+	if (skipTime == AV_NOPTS_VALUE || playbackTime == AV_NOPTS_VALUE || skipTime <= playbackTime)
+	{
+		// No keyframe in the backlog, keep playing in order and try again at the next keyframe
+		DebugMessage(L"Live catch-up found no keyframe to skip to\n");
+		m_catchUpRetryTime = av_gettime_relative() + LIVECATCHUPRETRYINTERVAL;
+		return;
+	}
+
+	// The decoders belong to the request threads, they flush and shift their timeline before the next packet
+	if (m_videoSampleProvider != nullptr)
+	{
+		m_videoSampleProvider->RequestSkip(skipTime - playbackTime);
+	}
+	if (m_audioSampleProvider != nullptr)
+	{
+		m_audioSampleProvider->DropPacketsBefore(skipTime);
+		m_audioSampleProvider->RequestSkip(skipTime - playbackTime);
+	}
+
+	m_latencyBeforeCatchUp = latencyBefore;
+	m_latencyAfterCatchUp = max(latencyBefore - (skipTime - playbackTime), 0LL);
+	m_liveLatency = m_latencyAfterCatchUp.load();
+	m_liveCatchUpPending = true;
+}
+
 void FFmpegReader::SetAudioStream(int audioStreamIndex, MediaSampleProvider^ audioSampleProvider)
 {
 	m_audioStreamIndex = audioStreamIndex;
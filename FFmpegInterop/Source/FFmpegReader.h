@@ -17,8 +17,12 @@
 //*****************************************************************************
 
 #pragma once
+#include <atomic>
+#include <mutex>
 
 #include "MediaSampleProvider.h"
+#include "JitterEstimator.h"
+#include "PacketCapture.h"
 
 namespace FFmpegInterop
 {
@@ -33,12 +37,56 @@ namespace FFmpegInterop
 
 	internal:
 		FFmpegReader(AVFormatContext* avFormatCtx);
+		// Enable live catch-up once the latency exceeds maxLatency (microseconds), 0 disables it
+		void SetMaxLiveLatency(int64_t maxLatency);
+		// Record the packets of the audio and video stream from now on
+		bool StartCapture(const char* path);
+
+		// Serializes demuxing between the audio and video request threads. ReadPacket takes it,
+		// anybody else touching the demuxer state or the jitter estimator must hold it too.
+		// It is held across network reads, so request and UI threads use the published values below.
+		std::mutex m_mutex;
+
+		// Live sources feed packet arrival times to the jitter estimator. The arrival time is when
+		// av_read_frame returned the packet, which matches the network only while reads wait for data.
+		bool m_isLiveSource;
+		JitterEstimator m_jitterEstimator;
+		void SetJitterBounds(int64_t minDelay, int64_t maxDelay);
+		// Jitter and buffer target of the estimator as of the last packet, in microseconds
+		std::atomic<int64_t> m_networkJitter;
+		std::atomic<int64_t> m_jitterTargetDelay;
+
+		// Latency the audio time-stretch converges to (microseconds), 0 disables it
+		int64_t m_targetLiveLatency;
+		// Media time taken out by the audio time-stretch, subtracted from all sample timestamps (microseconds)
+		std::atomic<int64_t> m_timeStretchOffset;
+
+		// How far the read position is behind the live edge, in microseconds
+		std::atomic<int64_t> m_liveLatency;
+		// Latency before and after the last catch-up, m_liveCatchUpPending is cleared by whoever reports it
+		std::atomic<int64_t> m_latencyBeforeCatchUp;
+		std::atomic<int64_t> m_latencyAfterCatchUp;
+		std::atomic<bool> m_liveCatchUpPending;
 
 	private:
+		int ReadAndQueuePacket();
+		void UpdateLiveLatency(AVPacket* avPacket);
+		void CatchUpToLiveEdge();
+
 		AVFormatContext* m_pAvFormatCtx;
 		MediaSampleProvider^ m_audioSampleProvider;
 		int m_audioStreamIndex;
 		MediaSampleProvider^ m_videoSampleProvider;
 		int m_videoStreamIndex;
+
+		int64_t m_maxLiveLatency;
+		// Wall clock and pts of the first packet, and the lowest latency seen, which is taken as the live edge
+		int64_t m_liveStartTime;
+		int64_t m_liveStartPts;
+		int64_t m_liveEdgeLatency;
+		// Wall clock time before which a catch-up that found no keyframe isn't tried again, 0 for none
+		int64_t m_catchUpRetryTime;
+
+		PacketCapture* m_pCapture;
 	};
 }
@@ -33,7 +33,7 @@ H264AVCSampleProvider::~H264AVCSampleProvider()
 {
 }
 
-HRESULT H264AVCSampleProvider::WriteAVPacketToStream(DataWriter^ dataWriter, AVPacket* avPacket)
+HRESULT H264AVCSampleProvider::WriteAVPacketToStream(SampleWriter* dataWriter, AVPacket* avPacket)
 {
 	HRESULT hr = S_OK;
 	// On a KeyFrame, write the SPS and PPS
@@ -52,7 +52,7 @@ HRESULT H264AVCSampleProvider::WriteAVPacketToStream(DataWriter^ dataWriter, AVP
 	return hr;
 }
 
-HRESULT H264AVCSampleProvider::GetSPSAndPPSBuffer(DataWriter^ dataWriter)
+HRESULT H264AVCSampleProvider::GetSPSAndPPSBuffer(SampleWriter* dataWriter)
 {
 	HRESULT hr = S_OK;
 	int spsLength = 0;
@@ -76,8 +76,6 @@ HRESULT H264AVCSampleProvider::GetSPSAndPPSBuffer(DataWriter^ dataWriter)
 		}
 		else
 		{
-			auto vSPS = ref new Platform::Array<uint8_t>(spsPos, spsLength);
-
 			// Write the NAL unit for the SPS
 			dataWriter->WriteByte(0);
 			dataWriter->WriteByte(0);
@@ -85,7 +83,7 @@ HRESULT H264AVCSampleProvider::GetSPSAndPPSBuffer(DataWriter^ dataWriter)
 			dataWriter->WriteByte(1);
 
 			// Write the SPS
-			dataWriter->WriteBytes(vSPS);
+			dataWriter->WriteBytes(spsPos, spsLength);
 		}
 	}
 
@@ -107,8 +105,6 @@ HRESULT H264AVCSampleProvider::GetSPSAndPPSBuffer(DataWriter^ dataWriter)
 			}
 			else
 			{
-				auto vPPS = ref new Platform::Array<uint8_t>(ppsPos, ppsLength);
-
 				// Write the NAL unit for the PPS
 				dataWriter->WriteByte(0);
 				dataWriter->WriteByte(0);
@@ -116,7 +112,7 @@ HRESULT H264AVCSampleProvider::GetSPSAndPPSBuffer(DataWriter^ dataWriter)
 				dataWriter->WriteByte(1);
 
 				// Write the PPS
-				dataWriter->WriteBytes(vPPS);
+				dataWriter->WriteBytes(ppsPos, ppsLength);
 			}
 		}
 	}
@@ -125,7 +121,7 @@ HRESULT H264AVCSampleProvider::GetSPSAndPPSBuffer(DataWriter^ dataWriter)
 }
 
 // Write out an H.264 packet converting stream offsets to start-codes
-HRESULT H264AVCSampleProvider::WriteNALPacket(DataWriter^ dataWriter, AVPacket* avPacket)
+HRESULT H264AVCSampleProvider::WriteNALPacket(SampleWriter* dataWriter, AVPacket* avPacket)
 {
 	HRESULT hr = S_OK;
 	uint32 index = 0;
@@ -159,8 +155,7 @@ HRESULT H264AVCSampleProvider::WriteNALPacket(DataWriter^ dataWriter, AVPacket*
 		}
 
 		// Write the rest of the packet to the stream
-		auto vBuffer = ref new Platform::Array<uint8_t>(&(avPacket->data[index]), size);
-		dataWriter->WriteBytes(vBuffer);
+		dataWriter->WriteBytes(&(avPacket->data[index]), size);
 		index += size;
 	} while (index < packetSize);
 
@@ -28,14 +28,14 @@ namespace FFmpegInterop
 		virtual ~H264AVCSampleProvider();
 
 	private:
-		HRESULT WriteNALPacket(DataWriter^ dataWriter, AVPacket* avPacket);
-		HRESULT GetSPSAndPPSBuffer(DataWriter^ dataWriter);
+		HRESULT WriteNALPacket(SampleWriter* dataWriter, AVPacket* avPacket);
+		HRESULT GetSPSAndPPSBuffer(SampleWriter* dataWriter);
 
 	internal:
 		H264AVCSampleProvider(
 			FFmpegReader^ reader,
 			AVFormatContext* avFormatCtx,
 			AVCodecContext* avCodecCtx);
-		virtual HRESULT WriteAVPacketToStream(DataWriter^ writer, AVPacket* avPacket) override;
+		virtual HRESULT WriteAVPacketToStream(SampleWriter* writer, AVPacket* avPacket) override;
 	};
 }
@@ -33,7 +33,7 @@ H264SampleProvider::~H264SampleProvider()
 {
 }
 
-HRESULT H264SampleProvider::WriteAVPacketToStream(DataWriter^ dataWriter, AVPacket* avPacket)
+HRESULT H264SampleProvider::WriteAVPacketToStream(SampleWriter* dataWriter, AVPacket* avPacket)
 {
 	HRESULT hr = S_OK;
 	// On a KeyFrame, write the SPS and PPS
@@ -52,7 +52,7 @@ HRESULT H264SampleProvider::WriteAVPacketToStream(DataWriter^ dataWriter, AVPack
 	return hr;
 }
 
-HRESULT H264SampleProvider::GetSPSAndPPSBuffer(DataWriter^ dataWriter)
+HRESULT H264SampleProvider::GetSPSAndPPSBuffer(SampleWriter* dataWriter)
 {
 	HRESULT hr = S_OK;
 
@@ -64,8 +64,7 @@ HRESULT H264SampleProvider::GetSPSAndPPSBuffer(DataWriter^ dataWriter)
 	else
 	{
 		// Write both SPS and PPS sequence as is from extradata
-		auto vSPSPPS = ref new Platform::Array<uint8_t>(m_pAvCodecCtx->extradata, m_pAvCodecCtx->extradata_size);
-		dataWriter->WriteBytes(vSPSPPS);
+		dataWriter->WriteBytes(m_pAvCodecCtx->extradata, m_pAvCodecCtx->extradata_size);
 	}
 
 	return hr;
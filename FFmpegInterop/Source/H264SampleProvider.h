@@ -28,13 +28,13 @@ namespace FFmpegInterop
 		virtual ~H264SampleProvider();
 
 	private:
-		HRESULT GetSPSAndPPSBuffer(DataWriter^ dataWriter);
+		HRESULT GetSPSAndPPSBuffer(SampleWriter* dataWriter);
 
 	internal:
 		H264SampleProvider(
 			FFmpegReader^ reader,
 			AVFormatContext* avFormatCtx,
 			AVCodecContext* avCodecCtx);
-		virtual HRESULT WriteAVPacketToStream(DataWriter^ writer, AVPacket* avPacket) override;
+		virtual HRESULT WriteAVPacketToStream(SampleWriter* writer, AVPacket* avPacket) override;
 	};
 }
@@ -0,0 +1,118 @@
+//*****************************************************************************
+//
+//	Copyright 2017 Microsoft Corporation
+//
+//	Licensed under the Apache License, Version 2.0 (the "License");
+//	you may not use this file except in compliance with the License.
+//	You may obtain a copy of the License at
+//
+//	http ://www.apache.org/licenses/LICENSE-2.0
+//
+//	Unless required by applicable law or agreed to in writing, software
+//	distributed under the License is distributed on an "AS IS" BASIS,
+//	WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//	See the License for the specific language governing permissions and
+//	limitations under the License.
+//
+//*****************************************************************************
+
+#include "pch.h"
+#include "JitterEstimator.h"
+
+using namespace FFmpegInterop;
+
+// Length of a baseline window (microseconds)
+const int64_t TRANSITWINDOW = 5000000;
+// The peak delay decays by this fraction of the elapsed time, so a single spike is forgotten in about a minute
+const double PEAKDECAY = 1.0 / 64;
+// Buffer in multiples of the smoothed jitter when no larger peak was seen
+const double JITTERMULTIPLIER = 4.0;
+
+JitterEstimator::JitterEstimator()
+	: m_minDelay(0)
+	, m_maxDelay(INT64_MAX)
+{
+	Reset();
+}
+
+void JitterEstimator::SetBounds(int64_t minDelay, int64_t maxDelay)
+{
+	m_minDelay = minDelay;
+	m_maxDelay = maxDelay > minDelay ? maxDelay : minDelay;
+}
+
+void JitterEstimator::Reset()
+{
+	m_packetCount = 0;
+	m_lastArrivalTime = 0;
+	m_lastTransit = 0;
+	m_jitter = 0;
+	m_peakDelay = 0;
+	m_windowStart = 0;
+	m_windowMinTransit = INT64_MAX;
+	m_previousWindowMinTransit = INT64_MAX;
+}
+
+void JitterEstimator::AddPacket(int64_t arrivalTime, int64_t timestamp)
+{
+	// Transit time up to an unknown constant, the sender clock is the timestamp
+	int64_t transit = arrivalTime - timestamp;
+
+	if (m_packetCount > 0)
+	{
+		// RFC 3550 6.4.1
+		int64_t difference = transit - m_lastTransit;
+		m_jitter += ((difference < 0 ? -difference : difference) - m_jitter) / 16;
+
+		m_peakDelay -= (arrivalTime - m_lastArrivalTime) * PEAKDECAY;
+		if (m_peakDelay < 0)
+		{
+			m_peakDelay = 0;
+		}
+	}
+	else
+	{
+		m_windowStart = arrivalTime;
+	}
+
+	if (arrivalTime - m_windowStart >= TRANSITWINDOW)
+	{
+		m_previousWindowMinTransit = m_windowMinTransit;
+		m_windowMinTransit = INT64_MAX;
+		m_windowStart = arrivalTime;
+	}
+	if (transit < m_windowMinTransit)
+	{
+		m_windowMinTransit = transit;
+	}
+
+	int64_t baseline = m_windowMinTransit < m_previousWindowMinTransit ? m_windowMinTransit : m_previousWindowMinTransit;
+	double delay = (double)(transit - baseline);
+	if (delay > m_peakDelay)
+	{
+		m_peakDelay = delay;
+	}
+
+	m_lastArrivalTime = arrivalTime;
+	m_lastTransit = transit;
+	m_packetCount++;
+}
+
+int64_t JitterEstimator::GetTargetDelay()
+{
+	double target = m_jitter * JITTERMULTIPLIER;
+	if (m_peakDelay > target)
+	{
+		target = m_peakDelay;
+	}
+
+	if (target < m_minDelay)
+	{
+		return m_minDelay;
+	}
+	if (target > m_maxDelay)
+	{
+		return m_maxDelay;
+	}
+	return (int64_t)target;
+}
@@ -0,0 +1,67 @@
+//*****************************************************************************
+//
+//	Copyright 2017 Microsoft Corporation
+//
+//	Licensed under the Apache License, Version 2.0 (the "License");
+//	you may not use this file except in compliance with the License.
+//	You may obtain a copy of the License at
+//
+//	http ://www.apache.org/licenses/LICENSE-2.0
+//
+//	Unless required by applicable law or agreed to in writing, software
+//	distributed under the License is distributed on an "AS IS" BASIS,
+//	WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//	See the License for the specific language governing permissions and
+//	limitations under the License.
+//
+//*****************************************************************************
+
+#pragma once
+#include <stdint.h>
+
+namespace FFmpegInterop
+{
+	//////////////////////////////////////////////////////////////////////////
+	//  JitterEstimator
+	//  Description: Estimates network jitter of a live source from packet
+	//               arrival times and timestamps, and derives how much media
+	//               has to be buffered to ride it out. Plain C++ without
+	//               FFmpeg or WinRT dependencies so it can be driven by
+	//               recorded arrival traces. All times are in microseconds.
+	//////////////////////////////////////////////////////////////////////////
+
+	class JitterEstimator
+	{
+	public:
+		JitterEstimator();
+
+		void SetBounds(int64_t minDelay, int64_t maxDelay);
+		// The timestamp has to follow the order packets are sent in, i.e. the dts of reordered video
+		void AddPacket(int64_t arrivalTime, int64_t timestamp);
+		void Reset();
+
+		// Smoothed interarrival jitter as defined by RFC 3550
+		int64_t GetJitter() { return (int64_t)m_jitter; }
+		// Largest recent delay of a packet behind the fastest one, decaying over time
+		int64_t GetPeakDelay() { return (int64_t)m_peakDelay; }
+		// Buffer needed to absorb the jitter, within the bounds
+		int64_t GetTargetDelay();
+		uint64_t GetPacketCount() { return m_packetCount; }
+
+	private:
+		int64_t m_minDelay;
+		int64_t m_maxDelay;
+
+		uint64_t m_packetCount;
+		int64_t m_lastArrivalTime;
+		int64_t m_lastTransit;
+		double m_jitter;
+		double m_peakDelay;
+
+		// Lowest transit time of the current and the previous window, the baseline delays are measured against.
+		// Windows let the baseline follow clock drift and route changes.
+		int64_t m_windowStart;
+		int64_t m_windowMinTransit;
+		int64_t m_previousWindowMinTransit;
+	};
+}
@@ -0,0 +1,122 @@
+//*****************************************************************************
+//
+//	Copyright 2017 Microsoft Corporation
+//
+//	Licensed under the Apache License, Version 2.0 (the "License");
+//	you may not use this file except in compliance with the License.
+//	You may obtain a copy of the License at
+//
+//	http ://www.apache.org/licenses/LICENSE-2.0
+//
+//	Unless required by applicable law or agreed to in writing, software
+//	distributed under the License is distributed on an "AS IS" BASIS,
+//	WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//	See the License for the specific language governing permissions and
+//	limitations under the License.
+//
+//*****************************************************************************
+
+
+#include "pch.h"
+#include "LatencyHistogram.h"
+
+extern "C"
+{
+#include <libavutil/common.h>
+}
+
+using namespace FFmpegInterop;
+
+LatencyHistogram::LatencyHistogram()
+{
+	Reset();
+}
+
+// Values below SubBuckets get a bucket each, above that every power of two is split into SubBuckets
+int LatencyHistogram::GetBucket(int64_t latency)
+{
+	if (latency < SubBuckets)
+	{
+		return latency < 0 ? 0 : (int)latency;
+	}
+
+	unsigned int value = latency > UINT32_MAX ? UINT32_MAX : (unsigned int)latency;
+	int exponent = av_log2(value);
+	return (exponent - SubBucketBits + 1) * SubBuckets + (int)(value >> (exponent - SubBucketBits)) - SubBuckets;
+}
+
+int64_t LatencyHistogram::GetBucketUpperBound(int bucket)
+{
+	if (bucket < SubBuckets)
+	{
+		return bucket;
+	}
+
+	int shift = bucket / SubBuckets - 1;
+	return ((int64_t)(SubBuckets + bucket % SubBuckets + 1) << shift) - 1;
+}
+
+void LatencyHistogram::Add(int64_t latency)
+{
+	m_buckets[GetBucket(latency)].fetch_add(1, std::memory_order_relaxed);
+	m_count.fetch_add(1, std::memory_order_relaxed);
+
+	int64_t max = m_max.load(std::memory_order_relaxed);
+	while (latency > max && !m_max.compare_exchange_weak(max, latency, std::memory_order_relaxed))
+	{
+	}
+}
+
+void LatencyHistogram::Reset()
+{
+	for (auto& bucket : m_buckets)
+	{
+		bucket.store(0, std::memory_order_relaxed);
+	}
+	m_count.store(0, std::memory_order_relaxed);
+	m_max.store(0, std::memory_order_relaxed);
+}
+
+uint64_t LatencyHistogram::GetCount()
+{
+	return m_count.load(std::memory_order_relaxed);
+}
+
+int64_t LatencyHistogram::GetMax()
+{
+	return m_max.load(std::memory_order_relaxed);
+}
+
+int64_t LatencyHistogram::GetPercentile(double fraction)
+{
+	// Take a snapshot first, the buckets keep changing while we walk them
+	uint64_t counts[BucketCount];
+	uint64_t total = 0;
+	for (int i = 0; i < BucketCount; i++)
+	{
+		counts[i] = m_buckets[i].load(std::memory_order_relaxed);
+		total += counts[i];
+	}
+
+	if (total == 0)
+	{
+		return 0;
+	}
+
+	uint64_t rank = (uint64_t)(fraction * total + 0.5);
+	rank = rank < 1 ? 1 : (rank > total ? total : rank);
+
+	uint64_t seen = 0;
+	for (int i = 0; i < BucketCount; i++)
+	{
+		seen += counts[i];
+		if (seen >= rank)
+		{
+			// The bucket bound can overshoot the largest value actually seen, the last bucket is open ended
+			int64_t max = GetMax();
+			int64_t bound = GetBucketUpperBound(i);
+			return bound < max && i < BucketCount - 1 ? bound : max;
+		}
+	}
+	return GetMax();
+}
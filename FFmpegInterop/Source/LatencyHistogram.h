@@ -0,0 +1,60 @@
+//*****************************************************************************
+//
+//	Copyright 2017 Microsoft Corporation
+//
+//	Licensed under the Apache License, Version 2.0 (the "License");
+//	you may not use this file except in compliance with the License.
+//	You may obtain a copy of the License at
+//
+//	http ://www.apache.org/licenses/LICENSE-2.0
+//
+//	Unless required by applicable law or agreed to in writing, software
+//	distributed under the License is distributed on an "AS IS" BASIS,
+//	WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//	See the License for the specific language governing permissions and
+//	limitations under the License.
+//
+//*****************************************************************************
+
+
+#pragma once
+#include <atomic>
+#include <stdint.h>
+
+namespace FFmpegInterop
+{
+	//////////////////////////////////////////////////////////////////////////
+	//  LatencyHistogram
+	//  Description: Lock-free histogram of latencies in microseconds. Buckets
+	//               are logarithmic with 8 sub-buckets per power of two, so
+	//               percentiles are accurate to 12.5%. Safe to update from the
+	//               sample thread while another thread reads it.
+	//////////////////////////////////////////////////////////////////////////
+
+	class LatencyHistogram
+	{
+	public:
+		LatencyHistogram();
+
+		void Add(int64_t latency);
+		void Reset();
+
+		uint64_t GetCount();
+		int64_t GetMax();
+		// Upper bound of the bucket holding the given fraction (0..1) of the samples, 0 without samples
+		int64_t GetPercentile(double fraction);
+
+	private:
+		static const int SubBucketBits = 3;
+		static const int SubBuckets = 1 << SubBucketBits;
+		// Up to 2^32 microseconds, longer latencies go to the last bucket
+		static const int BucketCount = (32 - SubBucketBits + 1) * SubBuckets;
+
+		static int GetBucket(int64_t latency);
+		static int64_t GetBucketUpperBound(int bucket);
+
+		std::atomic<uint64_t> m_buckets[BucketCount];
+		std::atomic<uint64_t> m_count;
+		std::atomic<int64_t> m_max;
+	};
+}
@@ -0,0 +1,106 @@
+//*****************************************************************************
+//
+//	Copyright 2017 Microsoft Corporation
+//
+//	Licensed under the Apache License, Version 2.0 (the "License");
+//	you may not use this file except in compliance with the License.
+//	You may obtain a copy of the License at
+//
+//	http ://www.apache.org/licenses/LICENSE-2.0
+//
+//	Unless required by applicable law or agreed to in writing, software
+//	distributed under the License is distributed on an "AS IS" BASIS,
+//	WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//	See the License for the specific language governing permissions and
+//	limitations under the License.
+//
+//*****************************************************************************
+
+
+#pragma once
+using namespace Windows::Foundation;
+
+namespace FFmpegInterop
+{
+	// Stages a sample passes from reading its packet to handing it to the MediaStreamSource
+	public enum class LatencyStage
+	{
+		// Packet read until it is sent to the decoder (or written out, for compressed samples)
+		Queue,
+		// Packet sent to the decoder until the frame comes out
+		Decode,
+		// Frame out of the decoder until it is converted/resampled into the sample buffer
+		Convert,
+		// Sample buffer complete until the sample is handed to the MediaStreamSource
+		Handoff,
+		// Packet read until handoff
+		Total
+	};
+
+	public ref class LatencyStatistics sealed
+	{
+		LatencyStage _stage;
+		unsigned long long _count;
+		TimeSpan _p50;
+		TimeSpan _p95;
+		TimeSpan _p99;
+		TimeSpan _max;
+
+	public:
+
+		property LatencyStage Stage
+		{
+			LatencyStage get()
+			{
+				return _stage;
+			}
+		}
+		property unsigned long long Count
+		{
+			unsigned long long get()
+			{
+				return _count;
+			}
+		}
+		property TimeSpan P50
+		{
+			TimeSpan get()
+			{
+				return _p50;
+			}
+		}
+		property TimeSpan P95
+		{
+			TimeSpan get()
+			{
+				return _p95;
+			}
+		}
+		property TimeSpan P99
+		{
+			TimeSpan get()
+			{
+				return _p99;
+			}
+		}
+		property TimeSpan Max
+		{
+			TimeSpan get()
+			{
+				return _max;
+			}
+		}
+
+	internal:
+		// Times are in microseconds
+		LatencyStatistics(LatencyStage stage, unsigned long long count, int64_t p50, int64_t p95, int64_t p99, int64_t max)
+		{
+			this->_stage = stage;
+			this->_count = count;
+			this->_p50.Duration = p50 * 10;
+			this->_p95.Duration = p95 * 10;
+			this->_p99.Duration = p99 * 10;
+			this->_max.Duration = max * 10;
+		}
+	};
+}
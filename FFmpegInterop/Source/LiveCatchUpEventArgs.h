@@ -0,0 +1,55 @@
+//*****************************************************************************
+//
+//	Copyright 2017 Microsoft Corporation
+//
+//	Licensed under the Apache License, Version 2.0 (the "License");
+//	you may not use this file except in compliance with the License.
+//	You may obtain a copy of the License at
+//
+//	http ://www.apache.org/licenses/LICENSE-2.0
+//
+//	Unless required by applicable law or agreed to in writing, software
+//	distributed under the License is distributed on an "AS IS" BASIS,
+//	WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//	See the License for the specific language governing permissions and
+//	limitations under the License.
+//
+//*****************************************************************************
+
+#pragma once
+using namespace Windows::Foundation;
+
+namespace FFmpegInterop
+{
+	public ref class LiveCatchUpEventArgs sealed
+	{
+		TimeSpan _latencyBefore;
+		TimeSpan _latencyAfter;
+
+	public:
+
+		// Distance to the live edge when the catch-up was triggered
+		property TimeSpan LatencyBefore
+		{
+			TimeSpan get()
+			{
+				return _latencyBefore;
+			}
+		}
+		// Distance to the live edge once playback continues from the skipped to keyframe
+		property TimeSpan LatencyAfter
+		{
+			TimeSpan get()
+			{
+				return _latencyAfter;
+			}
+		}
+
+	internal:
+		LiveCatchUpEventArgs(TimeSpan latencyBefore, TimeSpan latencyAfter)
+		{
+			this->_latencyBefore = latencyBefore;
+			this->_latencyAfter = latencyAfter;
+		}
+	};
+}
@@ -0,0 +1,153 @@
+//*****************************************************************************
+//
+//	Copyright 2017 Microsoft Corporation
+//
+//	Licensed under the Apache License, Version 2.0 (the "License");
+//	you may not use this file except in compliance with the License.
+//	You may obtain a copy of the License at
+//
+//	http ://www.apache.org/licenses/LICENSE-2.0
+//
+//	Unless required by applicable law or agreed to in writing, software
+//	distributed under the License is distributed on an "AS IS" BASIS,
+//	WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//	See the License for the specific language governing permissions and
+//	limitations under the License.
+//
+//*****************************************************************************
+
+#include "pch.h"
+#include "LogRing.h"
+#include <string.h>
+
+using namespace FFmpegInterop;
+
+LogRing::LogRing()
+	: m_enqueuePos(0)
+	, m_dequeuePos(0)
+	, m_isOpen(false)
+	, m_blockWhenFull(false)
+	, m_dropped(0)
+{
+	for (size_t i = 0; i < Capacity; i++)
+	{
+		m_slots[i].sequence.store(i, std::memory_order_relaxed);
+	}
+}
+
+void LogRing::Open()
+{
+	m_isOpen = true;
+}
+
+void LogRing::Close()
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	m_isOpen = false;
+	m_spaceFreed.notify_all();
+}
+
+void LogRing::SetBlockWhenFull(bool blockWhenFull)
+{
+	m_blockWhenFull.store(blockWhenFull, std::memory_order_relaxed);
+}
+
+uint64_t LogRing::GetDroppedCount()
+{
+	return m_dropped.load(std::memory_order_relaxed);
+}
+
+size_t LogRing::GetCount()
+{
+	// Dequeue first, it never passes the enqueue position
+	size_t dequeuePos = m_dequeuePos.load(std::memory_order_relaxed);
+	return m_enqueuePos.load(std::memory_order_relaxed) - dequeuePos;
+}
+
+LogRing::Slot* LogRing::Claim(int level, size_t& pos)
+{
+	if (!m_isOpen.load(std::memory_order_relaxed))
+	{
+		m_dropped.fetch_add(1, std::memory_order_relaxed);
+		return nullptr;
+	}
+
+	pos = m_enqueuePos.load(std::memory_order_relaxed);
+	bool blockWhenFull = m_blockWhenFull.load(std::memory_order_relaxed);
+
+	for (;;)
+	{
+		if (!blockWhenFull && level > WarningLevel && pos - m_dequeuePos.load(std::memory_order_relaxed) >= Capacity - ReservedForWarnings)
+		{
+			m_dropped.fetch_add(1, std::memory_order_relaxed);
+			return nullptr;
+		}
+
+		Slot* slot = &m_slots[pos % Capacity];
+		intptr_t diff = (intptr_t)slot->sequence.load(std::memory_order_acquire) - (intptr_t)pos;
+		if (diff == 0)
+		{
+			// The slot is free, claim it unless another producer was faster
+			if (m_enqueuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+			{
+				return slot;
+			}
+		}
+		else if (diff < 0)
+		{
+			// Full, the consumer hasn't freed this slot yet
+			if (!blockWhenFull || !m_isOpen.load(std::memory_order_relaxed))
+			{
+				m_dropped.fetch_add(1, std::memory_order_relaxed);
+				return nullptr;
+			}
+			WaitForSpace();
+			pos = m_enqueuePos.load(std::memory_order_relaxed);
+		}
+		else
+		{
+			pos = m_enqueuePos.load(std::memory_order_relaxed);
+		}
+	}
+}
+
+void LogRing::WaitForSpace()
+{
+	std::unique_lock<std::mutex> lock(m_mutex);
+	m_spaceFreed.wait(lock, [this]()
+	{
+		return GetCount() < Capacity || !m_isOpen.load(std::memory_order_relaxed);
+	});
+}
+
+size_t LogRing::Pop(Line* lines, size_t maxLines)
+{
+	size_t pos = m_dequeuePos.load(std::memory_order_relaxed);
+	size_t count = 0;
+	while (count < maxLines)
+	{
+		Slot& slot = m_slots[pos % Capacity];
+		if (slot.sequence.load(std::memory_order_acquire) != pos + 1)
+		{
+			// Empty, or the producer that claimed the slot is still writing it
+			break;
+		}
+
+		size_t length = strnlen(slot.text, LineSize - 1);
+		lines[count].level = slot.level;
+		memcpy(lines[count].text, slot.text, length);
+		lines[count].text[length] = 0;
+		count++;
+
+		slot.sequence.store(pos + Capacity, std::memory_order_release);
+		m_dequeuePos.store(++pos, std::memory_order_relaxed);
+	}
+
+	if (count > 0)
+	{
+		// Under the lock, so a producer between its check and its wait doesn't miss it
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_spaceFreed.notify_all();
+	}
+	return count;
+}
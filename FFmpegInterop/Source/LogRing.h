@@ -0,0 +1,109 @@
+//*****************************************************************************
+//
+//	Copyright 2017 Microsoft Corporation
+//
+//	Licensed under the Apache License, Version 2.0 (the "License");
+//	you may not use this file except in compliance with the License.
+//	You may obtain a copy of the License at
+//
+//	http ://www.apache.org/licenses/LICENSE-2.0
+//
+//	Unless required by applicable law or agreed to in writing, software
+//	distributed under the License is distributed on an "AS IS" BASIS,
+//	WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//	See the License for the specific language governing permissions and
+//	limitations under the License.
+//
+//*****************************************************************************
+
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <stddef.h>
+#include <stdint.h>
+
+namespace FFmpegInterop
+{
+	//////////////////////////////////////////////////////////////////////////
+	//  LogRing
+	//  Description: Bounded lock-free ring of log lines (MPSC, one sequence
+	//               number per slot). Producers format straight into a slot
+	//               and return, one consumer pops the lines in batches.
+	//               Plain C++ apart from pch.h, LogSink delivers the lines.
+	//////////////////////////////////////////////////////////////////////////
+
+	class LogRing
+	{
+	public:
+		static const int LineSize = 512;
+		static const size_t Capacity = 1024;
+		// Under the drop policy lines less severe than a warning can't take the last quarter of the ring
+		static const size_t ReservedForWarnings = Capacity / 4;
+		// AV_LOG_WARNING, lower levels are more severe
+		static const int WarningLevel = 24;
+
+		struct Line
+		{
+			int level;
+			char text[LineSize];
+		};
+
+		LogRing();
+
+		// Lines are dropped until the ring is opened. Closing drops new lines and releases blocked producers.
+		void Open();
+		void Close();
+		// Wait for a free slot instead of dropping the line when the ring is full
+		void SetBlockWhenFull(bool blockWhenFull);
+		uint64_t GetDroppedCount();
+		// Lines pushed and not popped yet
+		size_t GetCount();
+
+		// Any number of producer threads. format(char* text, int size) writes the line into the slot.
+		// Returns the number of queued lines including this one, 0 if the line was dropped.
+		template <typename Format>
+		size_t Push(int level, Format format)
+		{
+			size_t pos;
+			Slot* slot = Claim(level, pos);
+			if (slot == nullptr)
+			{
+				return 0;
+			}
+
+			slot->level = level;
+			format(slot->text, LineSize);
+			// Counted before publishing, the consumer can't have taken this line yet
+			size_t count = pos + 1 - m_dequeuePos.load(std::memory_order_relaxed);
+			slot->sequence.store(pos + 1, std::memory_order_release);
+			return count;
+		}
+
+		// The single consumer thread: copies up to maxLines lines out and frees their slots
+		size_t Pop(Line* lines, size_t maxLines);
+
+	private:
+		struct Slot
+		{
+			std::atomic<size_t> sequence;
+			int level;
+			char text[LineSize];
+		};
+
+		// Returns nullptr if the line is dropped
+		Slot* Claim(int level, size_t& pos);
+		// Block policy: wait until the consumer freed a slot
+		void WaitForSpace();
+
+		Slot m_slots[Capacity];
+		std::atomic<size_t> m_enqueuePos;
+		std::atomic<size_t> m_dequeuePos;
+		std::atomic<bool> m_isOpen;
+		std::atomic<bool> m_blockWhenFull;
+		std::atomic<uint64_t> m_dropped;
+
+		std::mutex m_mutex;
+		std::condition_variable m_spaceFreed;
+	};
+}
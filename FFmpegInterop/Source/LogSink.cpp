@@ -0,0 +1,151 @@
+//*****************************************************************************
+//
+//	Copyright 2017 Microsoft Corporation
+//
+//	Licensed under the Apache License, Version 2.0 (the "License");
+//	you may not use this file except in compliance with the License.
+//	You may obtain a copy of the License at
+//
+//	http ://www.apache.org/licenses/LICENSE-2.0
+//
+//	Unless required by applicable law or agreed to in writing, software
+//	distributed under the License is distributed on an "AS IS" BASIS,
+//	WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//	See the License for the specific language governing permissions and
+//	limitations under the License.
+//
+//*****************************************************************************
+
+
+#include "pch.h"
+#include "LogSink.h"
+
+extern "C"
+{
+#include <libavutil/log.h>
+}
+
+using namespace FFmpegInterop;
+
+// Delivery batches lines that arrive within this interval
+const int LOGDELIVERYINTERVAL = 20;
+
+LogSink& LogSink::Instance()
+{
+	// Never destroyed, so the delivery thread is not joined while the module unloads
+	static LogSink* sink = new LogSink();
+	return *sink;
+}
+
+LogSink::LogSink()
+	: m_droppedReported(0)
+	, m_stop(false)
+{
+}
+
+void LogSink::Push(void* avcl, int level, const char* fmt, va_list vl)
+{
+	// The arguments can point to temporary data, so the line is formatted here and not on the delivery thread
+	size_t count = m_ring.Push(level, [&](char* text, int size)
+	{
+		int printPrefix = 1;
+		av_log_format_line(avcl, level, fmt, vl, text, size, &printPrefix);
+	});
+
+	if (count == WakeUpThreshold)
+	{
+		// Deliver before the ring fills up instead of waiting for the interval. Notified under the
+		// lock, so the delivery thread can't miss it between checking the count and waiting.
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_wakeUp.notify_one();
+	}
+}
+
+void LogSink::SetProvider(ILogProvider^ provider)
+{
+	std::unique_lock<std::mutex> lock(m_mutex);
+
+	if (provider != nullptr)
+	{
+		m_provider = provider;
+		if (!m_thread.joinable())
+		{
+			m_stop = false;
+			m_ring.Open();
+			m_thread = std::thread(&LogSink::Run, this);
+		}
+	}
+	else if (m_thread.joinable())
+	{
+		// The thread delivers what is queued to the old provider before it exits. New lines are
+		// dropped from now on and blocked producers give up.
+		m_ring.Close();
+		m_stop = true;
+		m_wakeUp.notify_one();
+		lock.unlock();
+		m_thread.join();
+		lock.lock();
+		m_provider = nullptr;
+	}
+}
+
+void LogSink::SetBlockWhenFull(bool blockWhenFull)
+{
+	m_ring.SetBlockWhenFull(blockWhenFull);
+}
+
+uint64_t LogSink::GetDroppedCount()
+{
+	return m_ring.GetDroppedCount();
+}
+
+void LogSink::Run()
+{
+	std::unique_lock<std::mutex> lock(m_mutex);
+	while (!m_stop)
+	{
+		m_wakeUp.wait_for(lock, std::chrono::milliseconds(LOGDELIVERYINTERVAL), [this]()
+		{
+			return m_stop || m_ring.GetCount() >= WakeUpThreshold;
+		});
+
+		// The provider can take its time or log itself, so it is called without the lock
+		ILogProvider^ provider = m_provider;
+		lock.unlock();
+		Deliver(provider);
+		lock.lock();
+	}
+
+	// Lines queued before the provider was removed
+	ILogProvider^ provider = m_provider;
+	lock.unlock();
+	Deliver(provider);
+}
+
+void LogSink::Deliver(ILogProvider^ provider)
+{
+	// At most one ring's worth, so a flood of lines can't keep the thread here forever
+	size_t delivered = 0;
+	size_t count;
+	while (delivered < LogRing::Capacity && (count = m_ring.Pop(m_batch, BatchSize)) > 0)
+	{
+		delivered += count;
+		for (size_t i = 0; i < count && provider != nullptr; i++)
+		{
+			wchar_t wLine[LogRing::LineSize];
+			if (MultiByteToWideChar(CP_ACP, MB_PRECOMPOSED, m_batch[i].text, -1, wLine, LogRing::LineSize) != 0)
+			{
+				provider->Log((LogLevel)m_batch[i].level, ref new String(wLine));
+			}
+		}
+	}
+
+	uint64_t dropped = m_ring.GetDroppedCount();
+	if (dropped != m_droppedReported && provider != nullptr)
+	{
+		wchar_t wLine[LogRing::LineSize];
+		swprintf_s(wLine, L"%llu log messages dropped\n", dropped - m_droppedReported);
+		provider->Log(LogLevel::Warning, ref new String(wLine));
+		m_droppedReported = dropped;
+	}
+}
@@ -0,0 +1,76 @@
+//*****************************************************************************
+//
+//	Copyright 2017 Microsoft Corporation
+//
+//	Licensed under the Apache License, Version 2.0 (the "License");
+//	you may not use this file except in compliance with the License.
+//	You may obtain a copy of the License at
+//
+//	http ://www.apache.org/licenses/LICENSE-2.0
+//
+//	Unless required by applicable law or agreed to in writing, software
+//	distributed under the License is distributed on an "AS IS" BASIS,
+//	WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//	See the License for the specific language governing permissions and
+//	limitations under the License.
+//
+//*****************************************************************************
+
+
+#pragma once
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <stdarg.h>
+#include <stdint.h>
+#include "ILogProvider.h"
+#include "LogRing.h"
+
+namespace FFmpegInterop
+{
+	//////////////////////////////////////////////////////////////////////////
+	//  LogSink
+	//  Description: Takes FFmpeg log lines off the decoder threads. Producers
+	//               format into the LogRing and return; a background thread
+	//               converts and delivers them to the ILogProvider in batches,
+	//               without holding a lock while the provider runs.
+	//////////////////////////////////////////////////////////////////////////
+
+	class LogSink
+	{
+	public:
+		// Lives for the rest of the process once created
+		static LogSink& Instance();
+
+		// Called on FFmpeg's threads from the av_log callback
+		void Push(void* avcl, int level, const char* fmt, va_list vl);
+
+		// Starts the delivery thread, or stops it after delivering what is queued when provider is null
+		void SetProvider(ILogProvider^ provider);
+		// Wait for a free slot instead of dropping the line when the ring is full
+		void SetBlockWhenFull(bool blockWhenFull);
+		uint64_t GetDroppedCount();
+
+	private:
+		LogSink();
+		void Run();
+		// Called on the delivery thread without m_mutex
+		void Deliver(ILogProvider^ provider);
+
+		// The delivery thread is woken early once this many lines are queued
+		static const size_t WakeUpThreshold = LogRing::Capacity / 2;
+		static const size_t BatchSize = 32;
+
+		LogRing m_ring;
+		// Lines copied out of the ring for delivery, only used by the delivery thread
+		LogRing::Line m_batch[BatchSize];
+		uint64_t m_droppedReported;
+
+		// Guards m_stop and m_provider
+		std::mutex m_mutex;
+		std::condition_variable m_wakeUp;
+		std::thread m_thread;
+		bool m_stop;
+		ILogProvider^ m_provider;
+	};
+}
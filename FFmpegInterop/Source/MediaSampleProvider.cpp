@@ -20,6 +20,7 @@
 #include "MediaSampleProvider.h"
 #include "FFmpegInteropMSS.h"
 #include "FFmpegReader.h"
+#include "TraceRecorder.h"
 
 extern "C"
 {
@@ -39,7 +40,12 @@ MediaSampleProvider::MediaSampleProvider(
 	, m_startOffset(AV_NOPTS_VALUE)
 	, m_nextFramePts(0)
 	, m_isEnabled(true)
+	, m_isSkipPending(false)
+	, m_pendingSkip(0)
 	, m_isDiscontinuous(false)
+	, m_packetReadTime(AV_NOPTS_VALUE)
+	, m_sampleReadTime(AV_NOPTS_VALUE)
+	, m_sampleConvertTime(AV_NOPTS_VALUE)
 {
 	DebugMessage(L"MediaSampleProvider\n");
 }
@@ -72,29 +78,29 @@ void MediaSampleProvider::SetCurrentStreamIndex(int streamIndex)
 
 MediaStreamSample^ MediaSampleProvider::GetNextSample()
 {
-	DebugMessage(L"GetNextSample\n");
+	TRACE_SPAN(TraceSample, "GetNextSample");
 
 	HRESULT hr = S_OK;
 
 	MediaStreamSample^ sample;
 	if (m_isEnabled)
 	{
-		DataWriter^ dataWriter = ref new DataWriter();
-
 		LONGLONG pts = 0;
 		LONGLONG dur = 0;
 
-		hr = GetNextPacket(dataWriter, pts, dur, true);
+		hr = GetNextPacket(&m_sampleWriter, pts, dur, true);
 
 		if (hr == S_OK)
 		{
-			sample = MediaStreamSample::CreateFromBuffer(dataWriter->DetachBuffer(), { pts });
+			sample = MediaStreamSample::CreateFromBuffer(m_sampleWriter.DetachBuffer(), { pts });
 			sample->Duration = { dur };
 			sample->Discontinuous = m_isDiscontinuous;
 			m_isDiscontinuous = false;
 		}
 		else
 		{
+			// Drop anything a failed packet left behind in the writer
+			m_sampleWriter.Clear();
 			DebugMessage(L"Too many broken packets - disable stream\n");
 			DisableStream();
 		}
@@ -103,16 +109,15 @@ MediaStreamSample^ MediaSampleProvider::GetNextSample()
 	return sample;
 }
 
-HRESULT MediaSampleProvider::WriteAVPacketToStream(DataWriter^ dataWriter, AVPacket* avPacket)
+HRESULT MediaSampleProvider::WriteAVPacketToStream(SampleWriter* dataWriter, AVPacket* avPacket)
 {
 	// This is the simplest form of transfer. Copy the packet directly to the stream
 	// This works for most compressed formats
-	auto aBuffer = ref new Platform::Array<uint8_t>(avPacket->data, avPacket->size);
-	dataWriter->WriteBytes(aBuffer);
+	dataWriter->WriteBytes(avPacket->data, avPacket->size);
 	return S_OK;
 }
 
-HRESULT MediaSampleProvider::DecodeAVPacket(DataWriter^ dataWriter, AVPacket *avPacket, int64_t &framePts, int64_t &frameDuration)
+HRESULT MediaSampleProvider::DecodeAVPacket(SampleWriter* dataWriter, AVPacket *avPacket, int64_t &framePts, int64_t &frameDuration)
 {
 	// For the simple case of compressed samples, each packet is a sample
 	if (avPacket != nullptr)
@@ -136,37 +141,50 @@ HRESULT MediaSampleProvider::DecodeAVPacket(DataWriter^ dataWriter, AVPacket *av
 
 void MediaSampleProvider::QueuePacket(AVPacket packet)
 {
-	DebugMessage(L" - QueuePacket\n");
+	TRACE_SPAN_VERBOSE(TraceDemux, "QueuePacket");
+	m_counters.packetsRead++;
+	m_counters.bytesRead += packet.size;
 
+	std::lock_guard<std::mutex> lock(m_queueMutex);
 	if (m_isEnabled)
 	{
 		m_packetQueue.push_back(packet);
+		m_packetReadTimes.push_back(av_gettime_relative());
+		m_counters.queueDepth = (unsigned int)m_packetQueue.size();
 	}
 	else
 	{
+		m_counters.droppedPackets++;
 		av_packet_unref(&packet);
 	}
 }
 
-AVPacket MediaSampleProvider::PopPacket()
+bool MediaSampleProvider::PopPacket(AVPacket* avPacket)
 {
-	DebugMessage(L" - PopPacket\n");
+	TRACE_SPAN_VERBOSE(TraceDecode, "PopPacket");
 
-	AVPacket avPacket;
-	av_init_packet(&avPacket);
-	avPacket.data = NULL;
-	avPacket.size = 0;
-
-	if (!m_packetQueue.empty())
+	std::lock_guard<std::mutex> lock(m_queueMutex);
+	if (m_packetQueue.empty())
 	{
-		avPacket = m_packetQueue.front();
-		m_packetQueue.erase(m_packetQueue.begin());
+		return false;
 	}
 
-	return avPacket;
+	*avPacket = m_packetQueue.front();
+	m_packetQueue.erase(m_packetQueue.begin());
+	m_packetReadTime = m_packetReadTimes.front();
+	m_packetReadTimes.erase(m_packetReadTimes.begin());
+	m_counters.queueDepth = (unsigned int)m_packetQueue.size();
+
+	return true;
 }
 
-HRESULT FFmpegInterop::MediaSampleProvider::GetNextPacket(DataWriter ^ writer, LONGLONG & pts, LONGLONG & dur, bool allowSkip)
+bool MediaSampleProvider::IsPacketQueueEmpty()
+{
+	std::lock_guard<std::mutex> lock(m_queueMutex);
+	return m_packetQueue.empty();
+}
+
+HRESULT FFmpegInterop::MediaSampleProvider::GetNextPacket(SampleWriter* writer, LONGLONG & pts, LONGLONG & dur, bool allowSkip)
 {
 	HRESULT hr = S_OK;
 
@@ -183,7 +201,7 @@ HRESULT FFmpegInterop::MediaSampleProvider::GetNextPacket(DataWriter ^ writer, L
 	while (SUCCEEDED(hr) && !frameComplete)
 	{
 		// Continue reading until there is an appropriate packet in the stream
-		while (m_packetQueue.empty())
+		while (IsPacketQueueEmpty())
 		{
 			if (m_pReader->ReadPacket() < 0)
 			{
@@ -193,10 +211,13 @@ HRESULT FFmpegInterop::MediaSampleProvider::GetNextPacket(DataWriter ^ writer, L
 			}
 		}
 
-		if (!m_packetQueue.empty())
+		ApplyPendingSkip();
+
+		// A live catch-up on the other stream's thread can empty the queue again, then read on
+		if (SUCCEEDED(hr) && PopPacket(&avPacket))
 		{
 			// Pick the packets from the queue one at a time
-			avPacket = PopPacket();
+			m_latencyHistograms[static_cast<int>(LatencyStage::Queue)].Add(av_gettime_relative() - m_packetReadTime);
 			framePts = avPacket.pts;
 			frameDuration = avPacket.duration;
 
@@ -207,11 +228,13 @@ HRESULT FFmpegInterop::MediaSampleProvider::GetNextPacket(DataWriter ^ writer, L
 			if (!frameComplete)
 			{
 				m_isDiscontinuous = true;
+				m_counters.decodeErrors++;
 				if (allowSkip )
 					//&& errorCount++ < 10)
 				{
 					// skip a few broken packets (maybe make this configurable later)
 					DebugMessage(L"Skipping broken packet\n");
+					m_counters.skippedPackets++;
 					hr = S_OK;
 				}
 			}
@@ -221,29 +244,16 @@ HRESULT FFmpegInterop::MediaSampleProvider::GetNextPacket(DataWriter ^ writer, L
 	if (SUCCEEDED(hr))
 	{
 		// Write the packet out
+		TRACE_SPAN(TraceConvert, "WritePacket");
 		hr = WriteAVPacketToStream(writer, &avPacket);
+		ConvertTimestamps(framePts, frameDuration, pts, dur);
 
-		if (m_startOffset == AV_NOPTS_VALUE)
+		// Compressed samples are not decoded or converted, they are complete once written
+		if (m_sampleReadTime == AV_NOPTS_VALUE)
 		{
-			//if we havent set m_startOffset already
-			DebugMessage(L"Saving m_startOffset\n");
-
-			//in some real-time streams framePts is less than 0 so we need to make sure m_startOffset is never negative
-			m_startOffset = framePts < 0 ? 0 : framePts;
-
-			double startSeconds = LONGLONG(av_q2d(m_pAvFormatCtx->streams[m_streamIndex]->time_base) * m_startOffset);
-			double avSeconds = av_gettime() / 1000000.0;
-			
-			wchar_t buffer[250];
-			swprintf_s(buffer, L"first video frame arrived at: %f", avSeconds);
-			DebugMessage(buffer);
-
-			
+			m_sampleReadTime = m_packetReadTime;
 		}
-
-		pts = LONGLONG(av_q2d(m_pAvFormatCtx->streams[m_streamIndex]->time_base) * 10000000 * (framePts - m_startOffset));
-
-		dur = LONGLONG(av_q2d(m_pAvFormatCtx->streams[m_streamIndex]->time_base) * 10000000 * frameDuration);
+		m_sampleConvertTime = av_gettime_relative();
 	}
 
 	av_packet_unref(&avPacket);
@@ -251,19 +261,206 @@ HRESULT FFmpegInterop::MediaSampleProvider::GetNextPacket(DataWriter ^ writer, L
 	return hr;
 }
 
+void MediaSampleProvider::ConvertTimestamps(int64_t framePts, int64_t frameDuration, LONGLONG& pts, LONGLONG& dur)
+{
+	if (m_startOffset == AV_NOPTS_VALUE)
+	{
+		//if we havent set m_startOffset already
+		DebugMessage(L"Saving m_startOffset\n");
+
+		//in some real-time streams framePts is less than 0 so we need to make sure m_startOffset is never negative
+		m_startOffset = framePts < 0 ? 0 : framePts;
+	}
+
+	pts = LONGLONG(av_q2d(m_pAvFormatCtx->streams[m_streamIndex]->time_base) * 10000000 * (framePts - m_startOffset));
+	// Keep video in step with audio played faster than real time
+	pts -= m_pReader->m_timeStretchOffset * 10;
+
+	dur = LONGLONG(av_q2d(m_pAvFormatCtx->streams[m_streamIndex]->time_base) * 10000000 * frameDuration);
+}
+
 void MediaSampleProvider::Flush()
 {
 	DebugMessage(L"Flush\n");
-	while (!m_packetQueue.empty())
+	AVPacket avPacket;
+	while (PopPacket(&avPacket))
+	{
+		av_packet_unref(&avPacket);
+	}
 	{
-		av_packet_unref(&PopPacket());
+		std::lock_guard<std::mutex> lock(m_queueMutex);
+		m_isSkipPending = false;
+		m_pendingSkip = 0;
 	}
+	m_sampleReadTime = AV_NOPTS_VALUE;
+	FlushDecoder();
+}
+
+void MediaSampleProvider::FlushDecoder()
+{
 	m_isDiscontinuous = true;
 }
 
+int64_t MediaSampleProvider::GetFirstPacketTime()
+{
+	std::lock_guard<std::mutex> lock(m_queueMutex);
+	for (auto& avPacket : m_packetQueue)
+	{
+		if (avPacket.pts != AV_NOPTS_VALUE)
+		{
+			return av_rescale_q(avPacket.pts, m_pAvFormatCtx->streams[m_streamIndex]->time_base, AV_TIME_BASE_Q);
+		}
+	}
+	return AV_NOPTS_VALUE;
+}
+
+bool MediaSampleProvider::GetFirstPacketPosition(LONGLONG& position)
+{
+	int64_t pts = AV_NOPTS_VALUE;
+	{
+		std::lock_guard<std::mutex> lock(m_queueMutex);
+		for (auto& avPacket : m_packetQueue)
+		{
+			if (avPacket.pts != AV_NOPTS_VALUE)
+			{
+				pts = avPacket.pts;
+				break;
+			}
+		}
+	}
+
+	if (pts == AV_NOPTS_VALUE)
+	{
+		return false;
+	}
+
+	LONGLONG dur = 0;
+	ConvertTimestamps(pts, 0, position, dur);
+	return true;
+}
+
+int64_t MediaSampleProvider::ConvertPosition(LONGLONG position)
+{
+	int64_t startOffset = m_startOffset != AV_NOPTS_VALUE ? m_startOffset : 0;
+	position += m_pReader->m_timeStretchOffset * 10;
+	return startOffset + (int64_t)(position / (av_q2d(m_pAvFormatCtx->streams[m_streamIndex]->time_base) * 10000000));
+}
+
+// Returns the time of the keyframe the queue now starts with, AV_NOPTS_VALUE if there is none
+int64_t MediaSampleProvider::DropPacketsBeforeLastKeyFrame()
+{
+	std::lock_guard<std::mutex> lock(m_queueMutex);
+	for (size_t i = m_packetQueue.size(); i-- > 0;)
+	{
+		if ((m_packetQueue[i].flags & AV_PKT_FLAG_KEY) && m_packetQueue[i].pts != AV_NOPTS_VALUE)
+		{
+			for (size_t j = 0; j < i; j++)
+			{
+				av_packet_unref(&m_packetQueue[j]);
+			}
+			m_packetQueue.erase(m_packetQueue.begin(), m_packetQueue.begin() + i);
+			m_packetReadTimes.erase(m_packetReadTimes.begin(), m_packetReadTimes.begin() + i);
+			m_counters.queueDepth = (unsigned int)m_packetQueue.size();
+			return av_rescale_q(m_packetQueue.front().pts, m_pAvFormatCtx->streams[m_streamIndex]->time_base, AV_TIME_BASE_Q);
+		}
+	}
+	return AV_NOPTS_VALUE;
+}
+
+void MediaSampleProvider::DropPacketsBefore(int64_t time)
+{
+	int64_t pts = av_rescale_q(time, AV_TIME_BASE_Q, m_pAvFormatCtx->streams[m_streamIndex]->time_base);
+
+	std::lock_guard<std::mutex> lock(m_queueMutex);
+	size_t count = 0;
+	while (count < m_packetQueue.size() && (m_packetQueue[count].pts == AV_NOPTS_VALUE || m_packetQueue[count].pts < pts))
+	{
+		av_packet_unref(&m_packetQueue[count]);
+		count++;
+	}
+	m_packetQueue.erase(m_packetQueue.begin(), m_packetQueue.begin() + count);
+	m_packetReadTimes.erase(m_packetReadTimes.begin(), m_packetReadTimes.begin() + count);
+	m_counters.queueDepth = (unsigned int)m_packetQueue.size();
+}
+
+void MediaSampleProvider::RequestSkip(int64_t duration)
+{
+	std::lock_guard<std::mutex> lock(m_queueMutex);
+	m_isSkipPending = true;
+	m_pendingSkip += duration;
+}
+
+bool MediaSampleProvider::IsSkipPending()
+{
+	std::lock_guard<std::mutex> lock(m_queueMutex);
+	return m_isSkipPending;
+}
+
+void MediaSampleProvider::ApplyPendingSkip()
+{
+	int64_t duration = 0;
+	{
+		std::lock_guard<std::mutex> lock(m_queueMutex);
+		if (!m_isSkipPending)
+		{
+			return;
+		}
+		duration = m_pendingSkip;
+		m_isSkipPending = false;
+		m_pendingSkip = 0;
+	}
+
+	FlushDecoder();
+	SkipTimeline(duration);
+}
+
+void MediaSampleProvider::SkipTimeline(int64_t duration)
+{
+	if (m_startOffset != AV_NOPTS_VALUE)
+	{
+		m_startOffset += av_rescale_q(duration, AV_TIME_BASE_Q, m_pAvFormatCtx->streams[m_streamIndex]->time_base);
+	}
+}
+
+SampleTiming MediaSampleProvider::TakeSampleTiming()
+{
+	SampleTiming timing = { m_sampleReadTime, m_sampleConvertTime };
+	m_sampleReadTime = AV_NOPTS_VALUE;
+	return timing;
+}
+
+SampleFormat MediaSampleProvider::TakeSampleFormat()
+{
+	SampleFormat format = { false, 0, 0, { 0, 1 } };
+	return format;
+}
+
+void MediaSampleProvider::ApplySampleFormat(const SampleFormat& format)
+{
+}
+
+void MediaSampleProvider::RecordSampleHandoff(MediaStreamSample^ sample, const SampleTiming& timing)
+{
+	m_counters.samplesDelivered++;
+
+	if (timing.readTime != AV_NOPTS_VALUE)
+	{
+		int64_t now = av_gettime_relative();
+		m_latencyHistograms[static_cast<int>(LatencyStage::Handoff)].Add(now - timing.convertTime);
+		m_latencyHistograms[static_cast<int>(LatencyStage::Total)].Add(now - timing.readTime);
+	}
+}
+
 void MediaSampleProvider::DisableStream()
 {
 	DebugMessage(L"DisableStream\n");
 	Flush();
+	std::lock_guard<std::mutex> lock(m_queueMutex);
 	m_isEnabled = false;
+	m_counters.isDisabled = true;
+}
+
+bool MediaSampleProvider::IsEnabled()
+{
+	return m_isEnabled;
 }
\ No newline at end of file
@@ -17,7 +17,13 @@
 //*****************************************************************************
 
 #pragma once
+#include <atomic>
 #include <queue>
+#include <mutex>
+#include "LatencyHistogram.h"
+#include "LatencyStatistics.h"
+#include "SampleWriter.h"
+#include "StreamTelemetry.h"
 
 extern "C"
 {
@@ -32,6 +38,23 @@ namespace FFmpegInterop
 	ref class FFmpegInteropMSS;
 	ref class FFmpegReader;
 
+	// Read time of the oldest packet and conversion end of a sample (av_gettime_relative),
+	// readTime is AV_NOPTS_VALUE if it is unknown
+	struct SampleTiming
+	{
+		int64_t readTime;
+		int64_t convertTime;
+	};
+
+	// Video output format that takes effect with a sample, isChanged is false if it is the same as before
+	struct SampleFormat
+	{
+		bool isChanged;
+		int width;
+		int height;
+		AVRational aspectRatio;
+	};
+
 	ref class MediaSampleProvider
 	{
 	public:
@@ -41,16 +64,55 @@ namespace FFmpegInterop
 		virtual void SetCurrentStreamIndex(int streamIndex);
 
 	internal:
+		// Called by the reader, which can run on the request thread of the other stream
 		void QueuePacket(AVPacket packet);
-		AVPacket PopPacket();
+		// Returns false if the queue is empty
+		bool PopPacket(AVPacket* avPacket);
 		void DisableStream();
+		bool IsEnabled();
+		// Drop the decoder state but keep the queued packets
+		virtual void FlushDecoder();
+		// Live catch-up: drop queued packets, times are in AV_TIME_BASE units
+		int64_t GetFirstPacketTime();
+		int64_t DropPacketsBeforeLastKeyFrame();
+		void DropPacketsBefore(int64_t time);
+		// Seek: position of the first queued packet on the sample timeline, false if no packet has a timestamp
+		bool GetFirstPacketPosition(LONGLONG& position);
+		// Stream timestamp of a position on the sample timeline, the inverse of ConvertTimestamps
+		int64_t ConvertPosition(LONGLONG position);
+		// Shift sample timestamps back so the timeline continues across skipped media
+		void SkipTimeline(int64_t duration);
+		// Called by the reader: flush the decoder and skip the timeline before the next packet is decoded
+		void RequestSkip(int64_t duration);
+		bool IsSkipPending();
+		// Called by the stream's own request thread before it pops a packet
+		void ApplyPendingSkip();
+		// Timing of the sample GetNextSample just returned, called under the stream lock before the next one
+		SampleTiming TakeSampleTiming();
+		// Count a sample given to the platform and record the time from conversion end and from packet read
+		// to now. Any thread, a sample decoded ahead is handed out long after it was created.
+		virtual void RecordSampleHandoff(MediaStreamSample^ sample, const SampleTiming& timing);
+		// Format change of the sample GetNextSample just returned, taken like its timing
+		virtual SampleFormat TakeSampleFormat();
+		// Put a format change on the stream descriptor, right before its sample is handed out. Samples
+		// decoded ahead in the old format may still be waiting in front of it.
+		virtual void ApplySampleFormat(const SampleFormat& format);
+
+		// Per stage latency of the samples handed out, indexed by LatencyStage
+		LatencyHistogram m_latencyHistograms[static_cast<int>(LatencyStage::Total) + 1];
+		StreamCounters m_counters;
 
 	private:
+		// Guards the packet queue and the pending skip. Never held while calling out.
+		// m_isEnabled is written under it too, so no packet is queued after DisableStream.
+		std::mutex m_queueMutex;
 		std::vector<AVPacket> m_packetQueue;
-		int m_streamIndex;
+		// Wall clock time the reader pulled each queued packet from the demuxer (av_gettime_relative)
+		std::vector<int64_t> m_packetReadTimes;
 		int64 m_startOffset;
-		int64 m_nextFramePts;
-		bool m_isEnabled;
+		std::atomic<bool> m_isEnabled;
+		bool m_isSkipPending;
+		int64_t m_pendingSkip;
 
 	internal:
 		// The FFmpeg context. Because they are complex types
@@ -59,7 +121,17 @@ namespace FFmpegInterop
 		FFmpegReader^ m_pReader;
 		AVFormatContext* m_pAvFormatCtx;
 		AVCodecContext* m_pAvCodecCtx;
-		bool m_isDiscontinuous;
+		int m_streamIndex;
+		int64 m_nextFramePts;
+		// Set by whichever thread decodes, cleared with the next sample
+		std::atomic<bool> m_isDiscontinuous;
+		// Reused for every sample, the sample memory is recycled once the pipeline releases a sample
+		SampleWriter m_sampleWriter;
+		// Read time of the last popped packet, and read time of the oldest packet and conversion end
+		// of the sample being built, AV_NOPTS_VALUE before its first packet
+		int64_t m_packetReadTime;
+		int64_t m_sampleReadTime;
+		int64_t m_sampleConvertTime;
 
 	internal:
 		MediaSampleProvider(
@@ -67,8 +139,10 @@ namespace FFmpegInterop
 			AVFormatContext* avFormatCtx,
 			AVCodecContext* avCodecCtx);
 		virtual HRESULT AllocateResources();
-		virtual HRESULT WriteAVPacketToStream(DataWriter^ writer, AVPacket* avPacket);
-		virtual HRESULT DecodeAVPacket(DataWriter^ dataWriter, AVPacket* avPacket, int64_t& framePts, int64_t& frameDuration);
-		virtual HRESULT GetNextPacket(DataWriter^ writer, LONGLONG& pts, LONGLONG& dur, bool allowSkip);
+		virtual HRESULT WriteAVPacketToStream(SampleWriter* writer, AVPacket* avPacket);
+		virtual HRESULT DecodeAVPacket(SampleWriter* dataWriter, AVPacket* avPacket, int64_t& framePts, int64_t& frameDuration);
+		virtual HRESULT GetNextPacket(SampleWriter* writer, LONGLONG& pts, LONGLONG& dur, bool allowSkip);
+		bool IsPacketQueueEmpty();
+		void ConvertTimestamps(int64_t framePts, int64_t frameDuration, LONGLONG& pts, LONGLONG& dur);
 	};
 }
\ No newline at end of file
@@ -0,0 +1,315 @@
+//*****************************************************************************
+//
+//	Copyright 2017 Microsoft Corporation
+//
+//	Licensed under the Apache License, Version 2.0 (the "License");
+//	you may not use this file except in compliance with the License.
+//	You may obtain a copy of the License at
+//
+//	http ://www.apache.org/licenses/LICENSE-2.0
+//
+//	Unless required by applicable law or agreed to in writing, software
+//	distributed under the License is distributed on an "AS IS" BASIS,
+//	WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//	See the License for the specific language governing permissions and
+//	limitations under the License.
+//
+//*****************************************************************************
+
+#include "pch.h"
+#include "PacketCapture.h"
+#include <stddef.h>
+#include <string.h>
+
+extern "C"
+{
+#include <libavutil/opt.h>
+#include <libavutil/time.h>
+}
+
+using namespace FFmpegInterop;
+
+static const char CaptureMagic[8] = { 'F', 'F', 'I', 'C', 'A', 'P', '0', '1' };
+
+PacketCapture::PacketCapture(AVIOContext* avIOCtx)
+	: m_pAvIOCtx(avIOCtx)
+	, m_startTime(AV_NOPTS_VALUE)
+{
+}
+
+PacketCapture::~PacketCapture()
+{
+	avio_closep(&m_pAvIOCtx);
+}
+
+PacketCapture* PacketCapture::Create(const char* path, AVFormatContext* avFormatCtx, int audioStreamIndex, int videoStreamIndex)
+{
+	AVIOContext* avIOCtx = nullptr;
+	if (avio_open(&avIOCtx, path, AVIO_FLAG_WRITE) < 0)
+	{
+		return nullptr;
+	}
+
+	PacketCapture* capture = new PacketCapture(avIOCtx);
+	capture->m_streamMap.assign(avFormatCtx->nb_streams, -1);
+
+	int streamCount = 0;
+	int streams[] = { videoStreamIndex, audioStreamIndex };
+	for (int streamIndex : streams)
+	{
+		if (streamIndex >= 0 && (unsigned int)streamIndex < avFormatCtx->nb_streams)
+		{
+			capture->m_streamMap[streamIndex] = streamCount++;
+		}
+	}
+
+	avio_write(avIOCtx, (const unsigned char*)CaptureMagic, sizeof(CaptureMagic));
+	avio_wb32(avIOCtx, streamCount);
+	for (int streamIndex : streams)
+	{
+		if (streamIndex < 0 || (unsigned int)streamIndex >= avFormatCtx->nb_streams)
+		{
+			continue;
+		}
+
+		AVStream* avStream = avFormatCtx->streams[streamIndex];
+		AVCodecParameters* codecPar = avStream->codecpar;
+		avio_wb32(avIOCtx, codecPar->codec_type);
+		avio_wb32(avIOCtx, codecPar->codec_id);
+		avio_wb32(avIOCtx, codecPar->codec_tag);
+		avio_wb32(avIOCtx, codecPar->format);
+		avio_wb64(avIOCtx, codecPar->bit_rate);
+		avio_wb32(avIOCtx, codecPar->width);
+		avio_wb32(avIOCtx, codecPar->height);
+		avio_wb32(avIOCtx, codecPar->sample_aspect_ratio.num);
+		avio_wb32(avIOCtx, codecPar->sample_aspect_ratio.den);
+		avio_wb32(avIOCtx, codecPar->sample_rate);
+		avio_wb32(avIOCtx, codecPar->channels);
+		avio_wb64(avIOCtx, codecPar->channel_layout);
+		avio_wb32(avIOCtx, avStream->time_base.num);
+		avio_wb32(avIOCtx, avStream->time_base.den);
+		avio_wb32(avIOCtx, codecPar->extradata_size);
+		if (codecPar->extradata_size > 0)
+		{
+			avio_write(avIOCtx, codecPar->extradata, codecPar->extradata_size);
+		}
+	}
+
+	return capture;
+}
+
+void PacketCapture::Write(const AVPacket* avPacket, int64_t arrivalTime)
+{
+	if (avPacket->stream_index < 0 || (size_t)avPacket->stream_index >= m_streamMap.size() || m_streamMap[avPacket->stream_index] < 0)
+	{
+		return;
+	}
+
+	if (m_startTime == AV_NOPTS_VALUE)
+	{
+		m_startTime = arrivalTime;
+	}
+
+	avio_w8(m_pAvIOCtx, m_streamMap[avPacket->stream_index]);
+	avio_w8(m_pAvIOCtx, avPacket->flags & AV_PKT_FLAG_KEY);
+	avio_wb64(m_pAvIOCtx, avPacket->pts);
+	avio_wb64(m_pAvIOCtx, avPacket->dts);
+	avio_wb64(m_pAvIOCtx, avPacket->duration);
+	avio_wb64(m_pAvIOCtx, arrivalTime - m_startTime);
+	avio_wb32(m_pAvIOCtx, avPacket->size);
+	avio_write(m_pAvIOCtx, avPacket->data, avPacket->size);
+}
+
+// Replay demuxer
+
+struct ReplayContext
+{
+	const AVClass* avClass;
+	// 1.0 replays with the recorded timing, 2.0 twice as fast, 0 as fast as possible
+	double speed;
+	// Random extra delay of up to this many microseconds per packet, from a generator seeded with seed
+	int64_t jitter;
+	int seed;
+
+	int64_t startTime;
+	int64_t lastReleaseTime;
+	uint32_t random;
+};
+
+static AVOption ReplayOptions[4];
+static AVClass ReplayClass;
+static AVInputFormat ReplayFormat;
+
+static int ReplayProbe(AVProbeData* probeData)
+{
+	if (probeData->buf_size >= (int)sizeof(CaptureMagic) && memcmp(probeData->buf, CaptureMagic, sizeof(CaptureMagic)) == 0)
+	{
+		return AVPROBE_SCORE_MAX;
+	}
+	return 0;
+}
+
+static int ReplayReadHeader(AVFormatContext* avFormatCtx)
+{
+	ReplayContext* replay = (ReplayContext*)avFormatCtx->priv_data;
+	AVIOContext* pb = avFormatCtx->pb;
+
+	avio_skip(pb, sizeof(CaptureMagic));
+	unsigned int streamCount = avio_rb32(pb);
+	for (unsigned int i = 0; i < streamCount; i++)
+	{
+		AVStream* avStream = avformat_new_stream(avFormatCtx, NULL);
+		if (avStream == nullptr)
+		{
+			return AVERROR(ENOMEM);
+		}
+
+		AVCodecParameters* codecPar = avStream->codecpar;
+		codecPar->codec_type = (AVMediaType)avio_rb32(pb);
+		codecPar->codec_id = (AVCodecID)avio_rb32(pb);
+		codecPar->codec_tag = avio_rb32(pb);
+		codecPar->format = (int)avio_rb32(pb);
+		codecPar->bit_rate = avio_rb64(pb);
+		codecPar->width = avio_rb32(pb);
+		codecPar->height = avio_rb32(pb);
+		codecPar->sample_aspect_ratio.num = avio_rb32(pb);
+		codecPar->sample_aspect_ratio.den = avio_rb32(pb);
+		codecPar->sample_rate = avio_rb32(pb);
+		codecPar->channels = avio_rb32(pb);
+		codecPar->channel_layout = avio_rb64(pb);
+		avStream->time_base.num = avio_rb32(pb);
+		avStream->time_base.den = avio_rb32(pb);
+		avStream->pts_wrap_bits = 64;
+
+		int extradataSize = avio_rb32(pb);
+		if (extradataSize > 0)
+		{
+			codecPar->extradata = (uint8_t*)av_mallocz(extradataSize + AV_INPUT_BUFFER_PADDING_SIZE);
+			if (codecPar->extradata == nullptr)
+			{
+				return AVERROR(ENOMEM);
+			}
+			codecPar->extradata_size = extradataSize;
+			avio_read(pb, codecPar->extradata, extradataSize);
+		}
+	}
+
+	replay->startTime = AV_NOPTS_VALUE;
+	replay->lastReleaseTime = 0;
+	replay->random = (uint32_t)replay->seed;
+
+	return pb->error;
+}
+
+static int ReplayReadPacket(AVFormatContext* avFormatCtx, AVPacket* avPacket)
+{
+	ReplayContext* replay = (ReplayContext*)avFormatCtx->priv_data;
+	AVIOContext* pb = avFormatCtx->pb;
+
+	if (avio_feof(pb))
+	{
+		return AVERROR_EOF;
+	}
+
+	int streamIndex = avio_r8(pb);
+	int flags = avio_r8(pb);
+	int64_t pts = avio_rb64(pb);
+	int64_t dts = avio_rb64(pb);
+	int64_t duration = avio_rb64(pb);
+	int64_t arrivalTime = avio_rb64(pb);
+	int size = avio_rb32(pb);
+
+	if (avio_feof(pb) || (unsigned int)streamIndex >= avFormatCtx->nb_streams || size < 0)
+	{
+		return AVERROR_EOF;
+	}
+
+	int ret = av_get_packet(pb, avPacket, size);
+	if (ret < 0)
+	{
+		return ret;
+	}
+
+	avPacket->stream_index = streamIndex;
+	avPacket->flags |= flags & AV_PKT_FLAG_KEY;
+	avPacket->pts = pts;
+	avPacket->dts = dts;
+	avPacket->duration = duration;
+
+	if (replay->speed > 0)
+	{
+		int64_t now = av_gettime_relative();
+		if (replay->startTime == AV_NOPTS_VALUE)
+		{
+			replay->startTime = now;
+		}
+
+		int64_t releaseTime = (int64_t)(arrivalTime / replay->speed);
+		if (replay->jitter > 0)
+		{
+			// Numerical Recipes LCG, the same seed gives the same delays on every platform
+			replay->random = replay->random * 1664525 + 1013904223;
+			releaseTime += (int64_t)((replay->random >> 8) % (uint32_t)(replay->jitter + 1));
+		}
+
+		// Packets still come out in order, a delayed packet holds back the ones behind it
+		releaseTime = max(releaseTime, replay->lastReleaseTime);
+		replay->lastReleaseTime = releaseTime;
+
+		int64_t wait = replay->startTime + releaseTime - now;
+		if (wait > 0)
+		{
+			av_usleep((unsigned int)wait);
+		}
+	}
+
+	return ret;
+}
+
+void PacketCapture::RegisterReplayFormat()
+{
+	const int flags = AV_OPT_FLAG_DECODING_PARAM;
+
+	ReplayOptions[0].name = "replay_speed";
+	ReplayOptions[0].help = "timing scale of the replay, 0 replays as fast as possible";
+	ReplayOptions[0].offset = offsetof(ReplayContext, speed);
+	ReplayOptions[0].type = AV_OPT_TYPE_DOUBLE;
+	ReplayOptions[0].default_val.dbl = 1.0;
+	ReplayOptions[0].min = 0;
+	ReplayOptions[0].max = 1000;
+	ReplayOptions[0].flags = flags;
+
+	ReplayOptions[1].name = "replay_jitter";
+	ReplayOptions[1].help = "maximum random delay added to each packet in microseconds";
+	ReplayOptions[1].offset = offsetof(ReplayContext, jitter);
+	ReplayOptions[1].type = AV_OPT_TYPE_INT64;
+	ReplayOptions[1].default_val.i64 = 0;
+	ReplayOptions[1].min = 0;
+	ReplayOptions[1].max = INT64_MAX;
+	ReplayOptions[1].flags = flags;
+
+	ReplayOptions[2].name = "replay_seed";
+	ReplayOptions[2].help = "seed of the jitter";
+	ReplayOptions[2].offset = offsetof(ReplayContext, seed);
+	ReplayOptions[2].type = AV_OPT_TYPE_INT;
+	ReplayOptions[2].default_val.i64 = 1;
+	ReplayOptions[2].min = INT_MIN;
+	ReplayOptions[2].max = INT_MAX;
+	ReplayOptions[2].flags = flags;
+
+	ReplayClass.class_name = "FFmpegInterop capture replay";
+	ReplayClass.item_name = av_default_item_name;
+	ReplayClass.option = ReplayOptions;
+	ReplayClass.version = LIBAVUTIL_VERSION_INT;
+
+	ReplayFormat.name = "ffinteropcapture";
+	ReplayFormat.long_name = "FFmpegInterop packet capture";
+	ReplayFormat.extensions = "fficap";
+	ReplayFormat.priv_class = &ReplayClass;
+	ReplayFormat.priv_data_size = sizeof(ReplayContext);
+	ReplayFormat.read_probe = ReplayProbe;
+	ReplayFormat.read_header = ReplayReadHeader;
+	ReplayFormat.read_packet = ReplayReadPacket;
+
+	av_register_input_format(&ReplayFormat);
+}
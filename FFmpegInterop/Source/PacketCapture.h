@@ -0,0 +1,64 @@
+//*****************************************************************************
+//
+//	Copyright 2017 Microsoft Corporation
+//
+//	Licensed under the Apache License, Version 2.0 (the "License");
+//	you may not use this file except in compliance with the License.
+//	You may obtain a copy of the License at
+//
+//	http ://www.apache.org/licenses/LICENSE-2.0
+//
+//	Unless required by applicable law or agreed to in writing, software
+//	distributed under the License is distributed on an "AS IS" BASIS,
+//	WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//	See the License for the specific language governing permissions and
+//	limitations under the License.
+//
+//*****************************************************************************
+
+#pragma once
+#include <vector>
+
+extern "C"
+{
+#include <libavformat/avformat.h>
+}
+
+namespace FFmpegInterop
+{
+	//////////////////////////////////////////////////////////////////////////
+	//  PacketCapture
+	//  Description: Records the demuxed packets of the selected streams
+	//               together with their wall clock arrival time. The capture
+	//               is opened again like any other media through a demuxer
+	//               that replays it with the recorded, a scaled or a jittered
+	//               timing (options replay_speed, replay_jitter and
+	//               replay_seed). Only depends on FFmpeg.
+	//
+	//  File layout, big endian:
+	//    "FFICAP01", u32 stream count, per stream its codec parameters
+	//    per packet: u8 stream, u8 flags, i64 pts, i64 dts, i64 duration,
+	//                i64 arrival time (us since the first packet), u32 size, data
+	//////////////////////////////////////////////////////////////////////////
+
+	class PacketCapture
+	{
+	public:
+		// Returns nullptr if the file can't be created
+		static PacketCapture* Create(const char* path, AVFormatContext* avFormatCtx, int audioStreamIndex, int videoStreamIndex);
+		~PacketCapture();
+
+		void Write(const AVPacket* avPacket, int64_t arrivalTime);
+
+		// Makes the replay demuxer available to avformat_open_input, call once after av_register_all
+		static void RegisterReplayFormat();
+
+	private:
+		PacketCapture(AVIOContext* avIOCtx);
+
+		AVIOContext* m_pAvIOCtx;
+		// Capture stream index for each stream of the source, -1 for streams that aren't recorded
+		std::vector<int> m_streamMap;
+		int64_t m_startTime;
+	};
+}
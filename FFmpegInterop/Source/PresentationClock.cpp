@@ -0,0 +1,83 @@
+//*****************************************************************************
+//
+//	Copyright 2017 Microsoft Corporation
+//
+//	Licensed under the Apache License, Version 2.0 (the "License");
+//	you may not use this file except in compliance with the License.
+//	You may obtain a copy of the License at
+//
+//	http ://www.apache.org/licenses/LICENSE-2.0
+//
+//	Unless required by applicable law or agreed to in writing, software
+//	distributed under the License is distributed on an "AS IS" BASIS,
+//	WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//	See the License for the specific language governing permissions and
+//	limitations under the License.
+//
+//*****************************************************************************
+
+#include "pch.h"
+#include "PresentationClock.h"
+
+using namespace FFmpegInterop;
+
+// A frame is late when the presentation clock is past its end by more than this
+const int64_t LATEFRAMETHRESHOLD = 40000;
+// Being this far behind means the renderer stalled (buffering, debugger) rather than the decoder
+const int64_t CLOCKSTALLTHRESHOLD = 2000000;
+// Deliver a late frame anyway after this many drops so the picture doesn't freeze
+const int MAXCONSECUTIVELATEFRAMES = 8;
+
+PresentationClock::PresentationClock()
+	: m_startTime(NotRunning)
+	, m_startPosition(0)
+	, m_bufferTime(0)
+	, m_consecutiveLateFrames(0)
+{
+}
+
+void PresentationClock::Start(int64_t wallTime, int64_t position)
+{
+	if (m_startTime.load(std::memory_order_acquire) == NotRunning)
+	{
+		m_startPosition.store(position, std::memory_order_relaxed);
+		m_startTime.store(wallTime, std::memory_order_release);
+	}
+}
+
+void PresentationClock::Stop()
+{
+	m_startTime.store(NotRunning, std::memory_order_relaxed);
+	m_consecutiveLateFrames = 0;
+}
+
+int64_t PresentationClock::GetLateness(int64_t wallTime, int64_t frameEnd)
+{
+	int64_t startTime = m_startTime.load(std::memory_order_acquire);
+	if (startTime == NotRunning)
+	{
+		return 0;
+	}
+
+	// Samples handed out within the buffer time of the start are still waiting to be presented
+	int64_t position = m_startPosition.load(std::memory_order_relaxed) + (wallTime - startTime) - GetBufferTime();
+	return position - frameEnd;
+}
+
+bool PresentationClock::IsFrameLate(int64_t wallTime, int64_t frameEnd)
+{
+	bool isLate = false;
+	int64_t lateness = GetLateness(wallTime, frameEnd);
+	if (lateness > CLOCKSTALLTHRESHOLD)
+	{
+		// Playback stopped for a while, the next sample handed out starts over instead of dropping everything
+		m_startTime.store(NotRunning, std::memory_order_relaxed);
+	}
+	else if (lateness > LATEFRAMETHRESHOLD && m_consecutiveLateFrames < MAXCONSECUTIVELATEFRAMES)
+	{
+		isLate = true;
+	}
+
+	m_consecutiveLateFrames = isLate ? m_consecutiveLateFrames + 1 : 0;
+	return isLate;
+}
@@ -0,0 +1,65 @@
+//*****************************************************************************
+//
+//	Copyright 2017 Microsoft Corporation
+//
+//	Licensed under the Apache License, Version 2.0 (the "License");
+//	you may not use this file except in compliance with the License.
+//	You may obtain a copy of the License at
+//
+//	http ://www.apache.org/licenses/LICENSE-2.0
+//
+//	Unless required by applicable law or agreed to in writing, software
+//	distributed under the License is distributed on an "AS IS" BASIS,
+//	WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//	See the License for the specific language governing permissions and
+//	limitations under the License.
+//
+//*****************************************************************************
+
+#pragma once
+#include <atomic>
+#include <stdint.h>
+
+namespace FFmpegInterop
+{
+	//////////////////////////////////////////////////////////////////////////
+	//  PresentationClock
+	//  Description: Tracks where the renderer is on the sample timeline and
+	//               decides whether a decoded frame is already too late to be
+	//               shown. The renderer starts presenting once it holds
+	//               BufferTime worth of samples, so the clock runs that far
+	//               behind the first sample handed out. Plain C++ so it can be
+	//               driven by simulated delivery. All times are in microseconds.
+	//////////////////////////////////////////////////////////////////////////
+
+	class PresentationClock
+	{
+	public:
+		PresentationClock();
+
+		// Anchors the clock to the sample handed out at wallTime, unless it is already running
+		void Start(int64_t wallTime, int64_t position);
+		// The next Start anchors the clock again
+		void Stop();
+		bool IsRunning() { return m_startTime.load(std::memory_order_acquire) != NotRunning; }
+		void SetBufferTime(int64_t bufferTime) { m_bufferTime.store(bufferTime, std::memory_order_relaxed); }
+		int64_t GetBufferTime() { return m_bufferTime.load(std::memory_order_relaxed); }
+
+		// How far the renderer is past the end of a frame at wallTime, negative while the frame is ahead.
+		// Zero while the clock isn't running.
+		int64_t GetLateness(int64_t wallTime, int64_t frameEnd);
+		// Called once per decoded frame by the decoding thread. Stops the clock instead when the renderer
+		// stalled, and lets a frame through after a run of drops so the picture doesn't freeze.
+		bool IsFrameLate(int64_t wallTime, int64_t frameEnd);
+
+	private:
+		static const int64_t NotRunning = INT64_MIN;
+
+		// Written by the request thread, read by the decoding thread
+		std::atomic<int64_t> m_startTime;
+		std::atomic<int64_t> m_startPosition;
+		std::atomic<int64_t> m_bufferTime;
+		// Decoding thread only
+		int m_consecutiveLateFrames;
+	};
+}
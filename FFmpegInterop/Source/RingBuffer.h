@@ -0,0 +1,89 @@
+//*****************************************************************************
+//
+//	Copyright 2017 Microsoft Corporation
+//
+//	Licensed under the Apache License, Version 2.0 (the "License");
+//	you may not use this file except in compliance with the License.
+//	You may obtain a copy of the License at
+//
+//	http ://www.apache.org/licenses/LICENSE-2.0
+//
+//	Unless required by applicable law or agreed to in writing, software
+//	distributed under the License is distributed on an "AS IS" BASIS,
+//	WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//	See the License for the specific language governing permissions and
+//	limitations under the License.
+//
+//*****************************************************************************
+
+#pragma once
+#include <vector>
+#include <stddef.h>
+
+namespace FFmpegInterop
+{
+	//////////////////////////////////////////////////////////////////////////
+	//  RingBuffer
+	//  Description: FIFO queue on a ring that only grows. Unlike std::deque
+	//               it keeps its memory, so a queue cycling through the same
+	//               number of items doesn't allocate once it has warmed up.
+	//               Not thread safe.
+	//////////////////////////////////////////////////////////////////////////
+
+	template <typename T>
+	class RingBuffer
+	{
+	public:
+		RingBuffer()
+			: m_head(0)
+			, m_count(0)
+		{
+		}
+
+		bool IsEmpty() const { return m_count == 0; }
+		size_t GetSize() const { return m_count; }
+		T& Front() { return m_items[m_head]; }
+
+		void PushBack(const T& item)
+		{
+			if (m_count == m_items.size())
+			{
+				Grow();
+			}
+			m_items[(m_head + m_count) % m_items.size()] = item;
+			m_count++;
+		}
+
+		void PopFront()
+		{
+			// Don't hold on to references of items that left the queue
+			m_items[m_head] = T();
+			m_head = (m_head + 1) % m_items.size();
+			m_count--;
+		}
+
+		void Clear()
+		{
+			while (!IsEmpty())
+			{
+				PopFront();
+			}
+		}
+
+	private:
+		void Grow()
+		{
+			std::vector<T> items(m_items.size() > 0 ? m_items.size() * 2 : 4);
+			for (size_t i = 0; i < m_count; i++)
+			{
+				items[i] = m_items[(m_head + i) % m_items.size()];
+			}
+			m_items.swap(items);
+			m_head = 0;
+		}
+
+		std::vector<T> m_items;
+		size_t m_head;
+		size_t m_count;
+	};
+}
@@ -0,0 +1,50 @@
+//*****************************************************************************
+//
+//	Copyright 2017 Microsoft Corporation
+//
+//	Licensed under the Apache License, Version 2.0 (the "License");
+//	you may not use this file except in compliance with the License.
+//	You may obtain a copy of the License at
+//
+//	http ://www.apache.org/licenses/LICENSE-2.0
+//
+//	Unless required by applicable law or agreed to in writing, software
+//	distributed under the License is distributed on an "AS IS" BASIS,
+//	WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//	See the License for the specific language governing permissions and
+//	limitations under the License.
+//
+//*****************************************************************************
+
+#include "pch.h"
+#include "SampleBufferPool.h"
+
+using namespace FFmpegInterop;
+
+SampleBufferPool::SampleBufferPool()
+{
+	m_freeBuffers.reserve(MaxFreeBuffers);
+}
+
+std::vector<uint8_t> SampleBufferPool::Acquire()
+{
+	std::vector<uint8_t> data;
+	std::lock_guard<std::mutex> lock(m_mutex);
+	if (!m_freeBuffers.empty())
+	{
+		data = std::move(m_freeBuffers.back());
+		m_freeBuffers.pop_back();
+	}
+	return data;
+}
+
+// Called on whichever thread releases the sample last
+void SampleBufferPool::Release(std::vector<uint8_t>&& data)
+{
+	data.clear();
+	std::lock_guard<std::mutex> lock(m_mutex);
+	if (m_freeBuffers.size() < MaxFreeBuffers)
+	{
+		m_freeBuffers.push_back(std::move(data));
+	}
+}
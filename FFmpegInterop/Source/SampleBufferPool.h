@@ -0,0 +1,49 @@
+//*****************************************************************************
+//
+//	Copyright 2017 Microsoft Corporation
+//
+//	Licensed under the Apache License, Version 2.0 (the "License");
+//	you may not use this file except in compliance with the License.
+//	You may obtain a copy of the License at
+//
+//	http ://www.apache.org/licenses/LICENSE-2.0
+//
+//	Unless required by applicable law or agreed to in writing, software
+//	distributed under the License is distributed on an "AS IS" BASIS,
+//	WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//	See the License for the specific language governing permissions and
+//	limitations under the License.
+//
+//*****************************************************************************
+
+#pragma once
+#include <mutex>
+#include <vector>
+#include <stdint.h>
+
+namespace FFmpegInterop
+{
+	//////////////////////////////////////////////////////////////////////////
+	//  SampleBufferPool
+	//  Description: Sample memory kept for reuse, shared by a SampleWriter
+	//               and the buffers it handed out. Memory comes back with its
+	//               capacity, so after warm-up writing a sample of at most
+	//               the largest size seen doesn't allocate.
+	//////////////////////////////////////////////////////////////////////////
+
+	class SampleBufferPool
+	{
+	public:
+		SampleBufferPool();
+
+		std::vector<uint8_t> Acquire();
+		void Release(std::vector<uint8_t>&& data);
+
+	private:
+		// A few samples are in flight in the pipeline at any time, more than that is freed
+		static const size_t MaxFreeBuffers = 8;
+
+		std::mutex m_mutex;
+		std::vector<std::vector<uint8_t>> m_freeBuffers;
+	};
+}
@@ -0,0 +1,246 @@
+//*****************************************************************************
+//
+//	Copyright 2017 Microsoft Corporation
+//
+//	Licensed under the Apache License, Version 2.0 (the "License");
+//	you may not use this file except in compliance with the License.
+//	You may obtain a copy of the License at
+//
+//	http ://www.apache.org/licenses/LICENSE-2.0
+//
+//	Unless required by applicable law or agreed to in writing, software
+//	distributed under the License is distributed on an "AS IS" BASIS,
+//	WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//	See the License for the specific language governing permissions and
+//	limitations under the License.
+//
+//*****************************************************************************
+
+
+#include "pch.h"
+#include "SampleProducer.h"
+#include "TraceRecorder.h"
+
+using namespace FFmpegInterop;
+using namespace Windows::Media::Core;
+
+// Longest a video worker waits for audio per frame, so a stalled audio stream can't freeze video (microseconds)
+const int64_t MAXVIDEOYIELD = 20000;
+
+SampleProducer::SampleProducer(MediaSampleProvider^ provider, std::shared_timed_mutex& seekMutex, std::mutex& streamMutex,
+	size_t maxSamples, int64_t maxDuration, std::function<void()> sampleDelivered,
+	AudioPriorityScheduler* scheduler, bool isAudio)
+	: m_provider(provider)
+	, m_seekMutex(seekMutex)
+	, m_streamMutex(streamMutex)
+	, m_maxSamples(maxSamples)
+	, m_maxDuration(maxDuration)
+	, m_sampleDelivered(sampleDelivered)
+	, m_scheduler(scheduler)
+	, m_isAudio(isAudio)
+	, m_duration(0)
+	, m_isStarted(false)
+	, m_isEndOfStream(false)
+	, m_stop(false)
+{
+	m_thread = std::thread(&SampleProducer::Run, this);
+}
+
+SampleProducer::~SampleProducer()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_stop = true;
+		m_wakeUp.notify_one();
+	}
+	m_thread.join();
+
+	// Nothing will be decoded for a request still waiting, end the stream for it
+	if (m_deferral != nullptr)
+	{
+		m_request->Sample = nullptr;
+		m_deferral->Complete();
+	}
+}
+
+void SampleProducer::Serve(MediaStreamSourceSampleRequest^ request)
+{
+	MediaStreamSample^ sample = nullptr;
+	SampleTiming timing = { AV_NOPTS_VALUE, AV_NOPTS_VALUE };
+	SampleFormat format = { false };
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_isStarted = true;
+
+		if (!m_samples.IsEmpty())
+		{
+			sample = m_samples.Front().sample;
+			timing = m_samples.Front().timing;
+			format = m_samples.Front().format;
+			m_samples.PopFront();
+			m_duration -= sample->Duration.Duration;
+			ReportAudioBuffer();
+		}
+		else if (!m_isEndOfStream)
+		{
+			m_request = request;
+			m_deferral = request->GetDeferral();
+			ReportAudioBuffer();
+			m_wakeUp.notify_one();
+			return;
+		}
+
+		// There is room for one more sample now
+		m_wakeUp.notify_one();
+	}
+
+	if (sample != nullptr)
+	{
+		// The samples queued in front of it still had the old format
+		m_provider->ApplySampleFormat(format);
+	}
+	request->Sample = sample;
+	if (sample != nullptr)
+	{
+		HandOff(sample, timing);
+	}
+}
+
+// Samples count as delivered once the platform has them, the ones dropped by a flush never do
+void SampleProducer::HandOff(MediaStreamSample^ sample, const SampleTiming& timing)
+{
+	m_provider->RecordSampleHandoff(sample, timing);
+	if (m_sampleDelivered)
+	{
+		m_sampleDelivered();
+	}
+}
+
+void SampleProducer::Flush()
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	while (!m_samples.IsEmpty())
+	{
+		// Nothing older is left to play, the format of the dropped samples applies to the ones after them
+		m_provider->ApplySampleFormat(m_samples.Front().format);
+		m_samples.PopFront();
+	}
+	m_duration = 0;
+	m_isEndOfStream = false;
+	ReportAudioBuffer();
+	m_wakeUp.notify_one();
+}
+
+void SampleProducer::PreRoll()
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	m_isStarted = true;
+	ReportAudioBuffer();
+	m_wakeUp.notify_one();
+}
+
+// Called with m_mutex held
+void SampleProducer::ReportAudioBuffer()
+{
+	if (m_scheduler == nullptr || !m_isAudio || !m_isStarted)
+	{
+		return;
+	}
+
+	if (m_isEndOfStream)
+	{
+		m_scheduler->SetAudioIdle();
+	}
+	else
+	{
+		m_scheduler->SetAudioBuffer(m_duration, m_maxDuration, !m_provider->IsPacketQueueEmpty());
+	}
+}
+
+bool SampleProducer::IsFull()
+{
+	return (m_maxSamples > 0 && m_samples.GetSize() >= m_maxSamples) || (m_maxDuration > 0 && m_duration >= m_maxDuration);
+}
+
+void SampleProducer::Run()
+{
+	if (m_scheduler != nullptr && m_isAudio)
+	{
+		SetThreadPriority(GetCurrentThread(), THREAD_PRIORITY_ABOVE_NORMAL);
+	}
+
+	std::unique_lock<std::mutex> lock(m_mutex);
+	while (!m_stop)
+	{
+		// Don't decode before the first request or pre-roll, the initial Starting seek would throw the samples away
+		if (!m_isStarted || m_isEndOfStream || (m_request == nullptr && IsFull()))
+		{
+			m_wakeUp.wait(lock);
+			continue;
+		}
+		lock.unlock();
+
+		if (m_scheduler != nullptr && !m_isAudio)
+		{
+			// Let video run late rather than audio run dry
+			m_scheduler->YieldToAudio(MAXVIDEOYIELD);
+		}
+
+		MediaStreamSourceSampleRequest^ request = nullptr;
+		MediaStreamSourceSampleRequestDeferral^ deferral = nullptr;
+		MediaStreamSample^ sample;
+		SampleTiming timing;
+		SampleFormat format;
+		{
+			// A seek can't run between decoding the sample and queueing it
+			std::shared_lock<std::shared_timed_mutex> seekLock(m_seekMutex);
+			{
+				TRACE_SPAN(TraceSample, "ProduceSample");
+				std::lock_guard<std::mutex> streamLock(m_streamMutex);
+				sample = m_provider->GetNextSample();
+				timing = m_provider->TakeSampleTiming();
+				format = m_provider->TakeSampleFormat();
+			}
+
+			lock.lock();
+			if (sample == nullptr)
+			{
+				m_isEndOfStream = true;
+			}
+
+			if (m_request != nullptr)
+			{
+				// Hand the sample straight to the waiting request
+				request = m_request;
+				deferral = m_deferral;
+				m_request = nullptr;
+				m_deferral = nullptr;
+				if (sample != nullptr)
+				{
+					m_provider->ApplySampleFormat(format);
+				}
+				request->Sample = sample;
+			}
+			else if (sample != nullptr)
+			{
+				ReadySample readySample = { sample, timing, format };
+				m_samples.PushBack(readySample);
+				m_duration += sample->Duration.Duration;
+			}
+			ReportAudioBuffer();
+			lock.unlock();
+		}
+
+		// Complete outside of the locks, the platform may request the next sample right away
+		if (deferral != nullptr)
+		{
+			deferral->Complete();
+			if (sample != nullptr)
+			{
+				HandOff(sample, timing);
+			}
+		}
+
+		lock.lock();
+	}
+}
@@ -0,0 +1,93 @@
+//*****************************************************************************
+//
+//	Copyright 2017 Microsoft Corporation
+//
+//	Licensed under the Apache License, Version 2.0 (the "License");
+//	you may not use this file except in compliance with the License.
+//	You may obtain a copy of the License at
+//
+//	http ://www.apache.org/licenses/LICENSE-2.0
+//
+//	Unless required by applicable law or agreed to in writing, software
+//	distributed under the License is distributed on an "AS IS" BASIS,
+//	WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//	See the License for the specific language governing permissions and
+//	limitations under the License.
+//
+//*****************************************************************************
+
+
+#pragma once
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <shared_mutex>
+#include <thread>
+#include "AudioPriorityScheduler.h"
+#include "MediaSampleProvider.h"
+#include "RingBuffer.h"
+
+namespace FFmpegInterop
+{
+	//////////////////////////////////////////////////////////////////////////
+	//  SampleProducer
+	//  Description: Decodes one stream ahead on a worker thread into a small
+	//               queue of ready samples. A request that finds the queue
+	//               empty takes a deferral, the worker completes it as soon as
+	//               the next sample is decoded.
+	//////////////////////////////////////////////////////////////////////////
+
+	class SampleProducer
+	{
+	public:
+		// The worker decodes with seekMutex held shared and streamMutex held. The queue is full at
+		// maxSamples samples or maxDuration of media (100 ns units), 0 means no limit.
+		// With a scheduler an audio worker runs at a raised priority and reports its fill level,
+		// a video worker yields to audio that falls behind.
+		SampleProducer(MediaSampleProvider^ provider, std::shared_timed_mutex& seekMutex, std::mutex& streamMutex,
+			size_t maxSamples, int64_t maxDuration, std::function<void()> sampleDelivered,
+			AudioPriorityScheduler* scheduler, bool isAudio);
+		~SampleProducer();
+
+		// Sets the sample of the request if one is ready, otherwise defers the request
+		void Serve(Windows::Media::Core::MediaStreamSourceSampleRequest^ request);
+		// Drops the samples decoded before a seek, called with seekMutex held exclusively
+		void Flush();
+		// Starts decoding without waiting for a request, once the reader is at the start position
+		void PreRoll();
+
+	private:
+		// A decoded sample waiting for its request
+		struct ReadySample
+		{
+			Windows::Media::Core::MediaStreamSample^ sample;
+			SampleTiming timing;
+			SampleFormat format;
+		};
+
+		void Run();
+		void HandOff(Windows::Media::Core::MediaStreamSample^ sample, const SampleTiming& timing);
+		bool IsFull();
+		void ReportAudioBuffer();
+
+		MediaSampleProvider^ m_provider;
+		std::shared_timed_mutex& m_seekMutex;
+		std::mutex& m_streamMutex;
+		size_t m_maxSamples;
+		int64_t m_maxDuration;
+		std::function<void()> m_sampleDelivered;
+		AudioPriorityScheduler* m_scheduler;
+		bool m_isAudio;
+
+		std::mutex m_mutex;
+		std::condition_variable m_wakeUp;
+		RingBuffer<ReadySample> m_samples;
+		int64_t m_duration;
+		Windows::Media::Core::MediaStreamSourceSampleRequest^ m_request;
+		Windows::Media::Core::MediaStreamSourceSampleRequestDeferral^ m_deferral;
+		bool m_isStarted;
+		bool m_isEndOfStream;
+		bool m_stop;
+		std::thread m_thread;
+	};
+}
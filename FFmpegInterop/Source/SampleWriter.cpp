@@ -0,0 +1,105 @@
+//*****************************************************************************
+//
+//	Copyright 2017 Microsoft Corporation
+//
+//	Licensed under the Apache License, Version 2.0 (the "License");
+//	you may not use this file except in compliance with the License.
+//	You may obtain a copy of the License at
+//
+//	http ://www.apache.org/licenses/LICENSE-2.0
+//
+//	Unless required by applicable law or agreed to in writing, software
+//	distributed under the License is distributed on an "AS IS" BASIS,
+//	WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//	See the License for the specific language governing permissions and
+//	limitations under the License.
+//
+//*****************************************************************************
+
+#include "pch.h"
+#include "SampleWriter.h"
+
+using namespace FFmpegInterop;
+
+PooledBuffer::PooledBuffer(std::shared_ptr<SampleBufferPool> pool, std::vector<uint8_t>&& data)
+	: m_pool(pool)
+	, m_data(std::move(data))
+{
+}
+
+PooledBuffer::~PooledBuffer()
+{
+	m_pool->Release(std::move(m_data));
+}
+
+STDMETHODIMP PooledBuffer::get_Capacity(UINT32* value)
+{
+	*value = (UINT32)m_data.capacity();
+	return S_OK;
+}
+
+STDMETHODIMP PooledBuffer::get_Length(UINT32* value)
+{
+	*value = (UINT32)m_data.size();
+	return S_OK;
+}
+
+STDMETHODIMP PooledBuffer::put_Length(UINT32 value)
+{
+	if (value > m_data.capacity())
+	{
+		return E_INVALIDARG;
+	}
+	m_data.resize(value);
+	return S_OK;
+}
+
+STDMETHODIMP PooledBuffer::Buffer(byte** value)
+{
+	*value = m_data.data();
+	return S_OK;
+}
+
+SampleWriter::SampleWriter()
+	: m_pool(std::make_shared<SampleBufferPool>())
+	, m_hasData(false)
+{
+}
+
+void SampleWriter::WriteByte(uint8_t value)
+{
+	WriteBytes(&value, 1);
+}
+
+void SampleWriter::WriteBytes(const uint8_t* data, size_t size)
+{
+	if (!m_hasData)
+	{
+		// Recycled memory keeps its capacity, so it only grows until it fits the largest sample
+		m_data = m_pool->Acquire();
+		m_hasData = true;
+	}
+	m_data.insert(m_data.end(), data, data + size);
+}
+
+size_t SampleWriter::GetLength()
+{
+	return m_data.size();
+}
+
+Windows::Storage::Streams::IBuffer^ SampleWriter::DetachBuffer()
+{
+	auto pooledBuffer = Microsoft::WRL::Make<PooledBuffer>(m_pool, std::move(m_data));
+	m_data.clear();
+	m_hasData = false;
+
+	// Taking the hat adds the reference that keeps the buffer alive after pooledBuffer is released
+	IInspectable* inspectable = static_cast<ABI::Windows::Storage::Streams::IBuffer*>(pooledBuffer.Get());
+	Windows::Storage::Streams::IBuffer^ buffer = reinterpret_cast<Windows::Storage::Streams::IBuffer^>(inspectable);
+	return buffer;
+}
+
+void SampleWriter::Clear()
+{
+	m_data.clear();
+}
@@ -0,0 +1,84 @@
+//*****************************************************************************
+//
+//	Copyright 2017 Microsoft Corporation
+//
+//	Licensed under the Apache License, Version 2.0 (the "License");
+//	you may not use this file except in compliance with the License.
+//	You may obtain a copy of the License at
+//
+//	http ://www.apache.org/licenses/LICENSE-2.0
+//
+//	Unless required by applicable law or agreed to in writing, software
+//	distributed under the License is distributed on an "AS IS" BASIS,
+//	WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//	See the License for the specific language governing permissions and
+//	limitations under the License.
+//
+//*****************************************************************************
+
+#pragma once
+#include <memory>
+#include <vector>
+#include <stdint.h>
+#include <wrl.h>
+#include <robuffer.h>
+#include <windows.storage.streams.h>
+#include "SampleBufferPool.h"
+
+namespace FFmpegInterop
+{
+	// IBuffer over pooled memory, the memory goes back to the pool with the last reference
+	class PooledBuffer : public Microsoft::WRL::RuntimeClass<
+		Microsoft::WRL::RuntimeClassFlags<Microsoft::WRL::RuntimeClassType::WinRtClassicComMix>,
+		ABI::Windows::Storage::Streams::IBuffer,
+		Windows::Storage::Streams::IBufferByteAccess>
+	{
+		InspectableClass(L"FFmpegInterop.PooledBuffer", BaseTrust)
+
+	public:
+		PooledBuffer(std::shared_ptr<SampleBufferPool> pool, std::vector<uint8_t>&& data);
+		virtual ~PooledBuffer();
+
+		// IBuffer
+		STDMETHODIMP get_Capacity(UINT32* value) override;
+		STDMETHODIMP get_Length(UINT32* value) override;
+		STDMETHODIMP put_Length(UINT32 value) override;
+
+		// IBufferByteAccess
+		STDMETHODIMP Buffer(byte** value) override;
+
+	private:
+		std::shared_ptr<SampleBufferPool> m_pool;
+		std::vector<uint8_t> m_data;
+	};
+
+	//////////////////////////////////////////////////////////////////////////
+	//  SampleWriter
+	//  Description: Collects the bytes of a sample and hands them out as an
+	//               IBuffer. The memory is recycled once the pipeline releases
+	//               the sample, so steady state playback doesn't allocate
+	//               sample data. The small PooledBuffer object is still
+	//               created per sample. Used by one thread at a time.
+	//////////////////////////////////////////////////////////////////////////
+
+	class SampleWriter
+	{
+	public:
+		SampleWriter();
+
+		void WriteByte(uint8_t value);
+		void WriteBytes(const uint8_t* data, size_t size);
+		// Bytes written since the last DetachBuffer or Clear
+		size_t GetLength();
+
+		// The bytes written so far as the buffer of a sample, the next write starts a new one
+		Windows::Storage::Streams::IBuffer^ DetachBuffer();
+		// Drop the bytes written so far
+		void Clear();
+
+	private:
+		std::shared_ptr<SampleBufferPool> m_pool;
+		std::vector<uint8_t> m_data;
+		bool m_hasData;
+	};
+}
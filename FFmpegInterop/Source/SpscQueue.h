@@ -0,0 +1,88 @@
+//*****************************************************************************
+//
+//	Copyright 2017 Microsoft Corporation
+//
+//	Licensed under the Apache License, Version 2.0 (the "License");
+//	you may not use this file except in compliance with the License.
+//	You may obtain a copy of the License at
+//
+//	http ://www.apache.org/licenses/LICENSE-2.0
+//
+//	Unless required by applicable law or agreed to in writing, software
+//	distributed under the License is distributed on an "AS IS" BASIS,
+//	WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//	See the License for the specific language governing permissions and
+//	limitations under the License.
+//
+//*****************************************************************************
+
+
+#pragma once
+#include <atomic>
+#include <vector>
+#include <stddef.h>
+
+namespace FFmpegInterop
+{
+	//////////////////////////////////////////////////////////////////////////
+	//  SpscQueue
+	//  Description: Bounded lock-free ring between exactly one producer and
+	//               one consumer thread. Callers that need to wait pair it
+	//               with a condition variable of their own.
+	//////////////////////////////////////////////////////////////////////////
+
+	template <typename T>
+	class SpscQueue
+	{
+	public:
+		explicit SpscQueue(size_t capacity)
+			: m_items(capacity + 1)
+			, m_head(0)
+			, m_tail(0)
+		{
+		}
+
+		// Producer side, returns false if the queue is full
+		bool TryPush(const T& item)
+		{
+			size_t tail = m_tail.load(std::memory_order_relaxed);
+			size_t next = (tail + 1) % m_items.size();
+			if (next == m_head.load(std::memory_order_acquire))
+			{
+				return false;
+			}
+			m_items[tail] = item;
+			m_tail.store(next, std::memory_order_release);
+			return true;
+		}
+
+		// Consumer side, returns false if the queue is empty
+		bool TryPop(T& item)
+		{
+			size_t head = m_head.load(std::memory_order_relaxed);
+			if (head == m_tail.load(std::memory_order_acquire))
+			{
+				return false;
+			}
+			item = m_items[head];
+			m_head.store((head + 1) % m_items.size(), std::memory_order_release);
+			return true;
+		}
+
+		bool IsEmpty()
+		{
+			return m_head.load(std::memory_order_acquire) == m_tail.load(std::memory_order_acquire);
+		}
+
+		bool IsFull()
+		{
+			return (m_tail.load(std::memory_order_acquire) + 1) % m_items.size() == m_head.load(std::memory_order_acquire);
+		}
+
+	private:
+		// One slot stays empty to tell a full ring from an empty one
+		std::vector<T> m_items;
+		std::atomic<size_t> m_head;
+		std::atomic<size_t> m_tail;
+	};
+}
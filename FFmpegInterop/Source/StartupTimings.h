@@ -0,0 +1,156 @@
+//*****************************************************************************
+//
+//	Copyright 2017 Microsoft Corporation
+//
+//	Licensed under the Apache License, Version 2.0 (the "License");
+//	you may not use this file except in compliance with the License.
+//	You may obtain a copy of the License at
+//
+//	http ://www.apache.org/licenses/LICENSE-2.0
+//
+//	Unless required by applicable law or agreed to in writing, software
+//	distributed under the License is distributed on an "AS IS" BASIS,
+//	WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//	See the License for the specific language governing permissions and
+//	limitations under the License.
+//
+//*****************************************************************************
+
+
+#pragma once
+#include <atomic>
+#include <stdint.h>
+using namespace Windows::Foundation;
+
+namespace FFmpegInterop
+{
+	// Points during startup, in the order they are normally reached
+	enum class StartupPhase
+	{
+		// The FFmpegInteropMSS instance was constructed, all other phases are relative to it
+		Start,
+		OpenInput,
+		FindStreamInfo,
+		OpenAudioDecoder,
+		AllocateAudioResources,
+		OpenVideoDecoder,
+		AllocateVideoResources,
+		CreateMediaStreamSource,
+		FirstSampleRequest,
+		FirstAudioSample,
+		FirstVideoSample,
+		Count
+	};
+
+	// Time from the start of CreateFFmpegInteropMSSFrom* to each startup phase, null for phases
+	// that were not reached (yet) or don't apply, e.g. audio phases for media without audio
+	public ref class StartupTimings sealed
+	{
+		int64_t _times[static_cast<int>(StartupPhase::Count)];
+
+		Platform::IBox<TimeSpan>^ GetPhase(StartupPhase phase)
+		{
+			int64_t start = _times[static_cast<int>(StartupPhase::Start)];
+			int64_t time = _times[static_cast<int>(phase)];
+			if (start == INT64_MIN || time == INT64_MIN)
+			{
+				return nullptr;
+			}
+			TimeSpan elapsed = { (time - start) * 10 };
+			return ref new Platform::Box<TimeSpan>(elapsed);
+		}
+
+	public:
+
+		// avformat_open_input returned
+		property Platform::IBox<TimeSpan>^ OpenInput
+		{
+			Platform::IBox<TimeSpan>^ get()
+			{
+				return GetPhase(StartupPhase::OpenInput);
+			}
+		}
+		// avformat_find_stream_info returned
+		property Platform::IBox<TimeSpan>^ FindStreamInfo
+		{
+			Platform::IBox<TimeSpan>^ get()
+			{
+				return GetPhase(StartupPhase::FindStreamInfo);
+			}
+		}
+		// avcodec_open2 returned for the audio stream
+		property Platform::IBox<TimeSpan>^ OpenAudioDecoder
+		{
+			Platform::IBox<TimeSpan>^ get()
+			{
+				return GetPhase(StartupPhase::OpenAudioDecoder);
+			}
+		}
+		// The audio sample provider allocated its resources
+		property Platform::IBox<TimeSpan>^ AllocateAudioResources
+		{
+			Platform::IBox<TimeSpan>^ get()
+			{
+				return GetPhase(StartupPhase::AllocateAudioResources);
+			}
+		}
+		// avcodec_open2 returned for the video stream
+		property Platform::IBox<TimeSpan>^ OpenVideoDecoder
+		{
+			Platform::IBox<TimeSpan>^ get()
+			{
+				return GetPhase(StartupPhase::OpenVideoDecoder);
+			}
+		}
+		// The video sample provider allocated its resources
+		property Platform::IBox<TimeSpan>^ AllocateVideoResources
+		{
+			Platform::IBox<TimeSpan>^ get()
+			{
+				return GetPhase(StartupPhase::AllocateVideoResources);
+			}
+		}
+		// The MediaStreamSource was created and set up
+		property Platform::IBox<TimeSpan>^ CreateMediaStreamSource
+		{
+			Platform::IBox<TimeSpan>^ get()
+			{
+				return GetPhase(StartupPhase::CreateMediaStreamSource);
+			}
+		}
+		// The MediaStreamSource asked for its first sample
+		property Platform::IBox<TimeSpan>^ FirstSampleRequest
+		{
+			Platform::IBox<TimeSpan>^ get()
+			{
+				return GetPhase(StartupPhase::FirstSampleRequest);
+			}
+		}
+		// The first audio sample was handed out
+		property Platform::IBox<TimeSpan>^ FirstAudioSample
+		{
+			Platform::IBox<TimeSpan>^ get()
+			{
+				return GetPhase(StartupPhase::FirstAudioSample);
+			}
+		}
+		// The first video sample was handed out
+		property Platform::IBox<TimeSpan>^ FirstVideoSample
+		{
+			Platform::IBox<TimeSpan>^ get()
+			{
+				return GetPhase(StartupPhase::FirstVideoSample);
+			}
+		}
+
+	internal:
+		// Monotonic times in microseconds, INT64_MIN for phases not reached
+		StartupTimings(std::atomic<int64_t>* times)
+		{
+			for (int i = 0; i < static_cast<int>(StartupPhase::Count); i++)
+			{
+				this->_times[i] = times[i].load();
+			}
+		}
+	};
+}
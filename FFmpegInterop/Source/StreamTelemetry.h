@@ -0,0 +1,160 @@
+//*****************************************************************************
+//
+//	Copyright 2017 Microsoft Corporation
+//
+//	Licensed under the Apache License, Version 2.0 (the "License");
+//	you may not use this file except in compliance with the License.
+//	You may obtain a copy of the License at
+//
+//	http ://www.apache.org/licenses/LICENSE-2.0
+//
+//	Unless required by applicable law or agreed to in writing, software
+//	distributed under the License is distributed on an "AS IS" BASIS,
+//	WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//	See the License for the specific language governing permissions and
+//	limitations under the License.
+//
+//*****************************************************************************
+
+
+#pragma once
+#include <atomic>
+#include <stdint.h>
+using namespace Windows::Foundation;
+
+namespace FFmpegInterop
+{
+	// Counters a sample provider updates as it goes, read from any thread through StreamTelemetry
+	struct StreamCounters
+	{
+		std::atomic<uint64_t> packetsRead;
+		std::atomic<uint64_t> bytesRead;
+		std::atomic<unsigned int> queueDepth;
+		std::atomic<uint64_t> decodeErrors;
+		std::atomic<uint64_t> skippedPackets;
+		std::atomic<uint64_t> droppedPackets;
+		std::atomic<uint64_t> droppedFrames;
+		std::atomic<uint64_t> samplesDelivered;
+		// Microseconds
+		std::atomic<int64_t> conversionTime;
+		std::atomic<bool> isDisabled;
+
+		StreamCounters()
+			: packetsRead(0), bytesRead(0), queueDepth(0), decodeErrors(0), skippedPackets(0)
+			, droppedPackets(0), droppedFrames(0), samplesDelivered(0), conversionTime(0), isDisabled(false)
+		{
+		}
+	};
+
+	// Snapshot of the counters of one stream
+	public ref class StreamTelemetry sealed
+	{
+		unsigned long long _packetsRead;
+		unsigned long long _bytesRead;
+		unsigned int _queueDepth;
+		unsigned long long _decodeErrors;
+		unsigned long long _skippedPackets;
+		unsigned long long _droppedPackets;
+		unsigned long long _droppedFrames;
+		unsigned long long _samplesDelivered;
+		TimeSpan _conversionTime;
+		bool _isDisabled;
+
+	public:
+
+		// Packets the demuxer returned for this stream
+		property unsigned long long PacketsRead
+		{
+			unsigned long long get()
+			{
+				return _packetsRead;
+			}
+		}
+		property unsigned long long BytesRead
+		{
+			unsigned long long get()
+			{
+				return _bytesRead;
+			}
+		}
+		// Packets read but not decoded yet
+		property unsigned int QueueDepth
+		{
+			unsigned int get()
+			{
+				return _queueDepth;
+			}
+		}
+		// Packets the decoder failed on
+		property unsigned long long DecodeErrors
+		{
+			unsigned long long get()
+			{
+				return _decodeErrors;
+			}
+		}
+		// Broken packets skipped to keep playing
+		property unsigned long long SkippedPackets
+		{
+			unsigned long long get()
+			{
+				return _skippedPackets;
+			}
+		}
+		// Packets freed unread because the stream was disabled
+		property unsigned long long DroppedPackets
+		{
+			unsigned long long get()
+			{
+				return _droppedPackets;
+			}
+		}
+		// Decoded frames discarded because they were late
+		property unsigned long long DroppedFrames
+		{
+			unsigned long long get()
+			{
+				return _droppedFrames;
+			}
+		}
+		// Samples handed to the MediaStreamSource
+		property unsigned long long SamplesDelivered
+		{
+			unsigned long long get()
+			{
+				return _samplesDelivered;
+			}
+		}
+		// Total time spent converting/resampling decoded frames into samples
+		property TimeSpan ConversionTime
+		{
+			TimeSpan get()
+			{
+				return _conversionTime;
+			}
+		}
+		// Set once the stream gave up after too many errors
+		property bool IsDisabled
+		{
+			bool get()
+			{
+				return _isDisabled;
+			}
+		}
+
+	internal:
+		StreamTelemetry(StreamCounters& counters)
+		{
+			this->_packetsRead = counters.packetsRead.load(std::memory_order_relaxed);
+			this->_bytesRead = counters.bytesRead.load(std::memory_order_relaxed);
+			this->_queueDepth = counters.queueDepth.load(std::memory_order_relaxed);
+			this->_decodeErrors = counters.decodeErrors.load(std::memory_order_relaxed);
+			this->_skippedPackets = counters.skippedPackets.load(std::memory_order_relaxed);
+			this->_droppedPackets = counters.droppedPackets.load(std::memory_order_relaxed);
+			this->_droppedFrames = counters.droppedFrames.load(std::memory_order_relaxed);
+			this->_samplesDelivered = counters.samplesDelivered.load(std::memory_order_relaxed);
+			this->_conversionTime.Duration = counters.conversionTime.load(std::memory_order_relaxed) * 10;
+			this->_isDisabled = counters.isDisabled.load(std::memory_order_relaxed);
+		}
+	};
+}
@@ -0,0 +1,56 @@
+//*****************************************************************************
+//
+//	Copyright 2017 Microsoft Corporation
+//
+//	Licensed under the Apache License, Version 2.0 (the "License");
+//	you may not use this file except in compliance with the License.
+//	You may obtain a copy of the License at
+//
+//	http ://www.apache.org/licenses/LICENSE-2.0
+//
+//	Unless required by applicable law or agreed to in writing, software
+//	distributed under the License is distributed on an "AS IS" BASIS,
+//	WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//	See the License for the specific language governing permissions and
+//	limitations under the License.
+//
+//*****************************************************************************
+
+
+#pragma once
+#include "StreamTelemetry.h"
+
+namespace FFmpegInterop
+{
+	public ref class TelemetryUpdatedEventArgs sealed
+	{
+		StreamTelemetry^ _audio;
+		StreamTelemetry^ _video;
+
+	public:
+
+		// Null when the media has no audio stream
+		property StreamTelemetry^ Audio
+		{
+			StreamTelemetry^ get()
+			{
+				return _audio;
+			}
+		}
+		// Null when the media has no video stream
+		property StreamTelemetry^ Video
+		{
+			StreamTelemetry^ get()
+			{
+				return _video;
+			}
+		}
+
+	internal:
+		TelemetryUpdatedEventArgs(StreamTelemetry^ audio, StreamTelemetry^ video)
+		{
+			this->_audio = audio;
+			this->_video = video;
+		}
+	};
+}
@@ -0,0 +1,185 @@
+//*****************************************************************************
+//
+//	Copyright 2017 Microsoft Corporation
+//
+//	Licensed under the Apache License, Version 2.0 (the "License");
+//	you may not use this file except in compliance with the License.
+//	You may obtain a copy of the License at
+//
+//	http ://www.apache.org/licenses/LICENSE-2.0
+//
+//	Unless required by applicable law or agreed to in writing, software
+//	distributed under the License is distributed on an "AS IS" BASIS,
+//	WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//	See the License for the specific language governing permissions and
+//	limitations under the License.
+//
+//*****************************************************************************
+
+
+#include "pch.h"
+#include "TraceRecorder.h"
+#include <algorithm>
+#include <stdio.h>
+
+using namespace FFmpegInterop;
+
+static const char* GetCategoryName(unsigned int category)
+{
+	switch (category)
+	{
+	case TraceDemux:
+		return "demux";
+	case TraceDecode:
+		return "decode";
+	case TraceConvert:
+		return "convert";
+	case TraceSample:
+		return "sample";
+	case TraceSeek:
+		return "seek";
+	default:
+		return "other";
+	}
+}
+
+TraceRecorder& TraceRecorder::Instance()
+{
+	// Never destroyed, thread buffers may still be written while the module unloads
+	static TraceRecorder* recorder = new TraceRecorder();
+	return *recorder;
+}
+
+TraceRecorder::TraceRecorder()
+	: m_mask(0)
+	, m_epoch(0)
+	, m_startTime(0)
+	, m_nextThreadId(1)
+{
+}
+
+void TraceRecorder::Start(unsigned int mask)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+
+	// Buffers of threads that exited were kept for the last export
+	auto exited = std::remove_if(m_buffers.begin(), m_buffers.end(), [](ThreadBuffer* buffer)
+	{
+		if (buffer->exited.load(std::memory_order_acquire))
+		{
+			FreeThreadBuffer(buffer);
+			return true;
+		}
+		return false;
+	});
+	m_buffers.erase(exited, m_buffers.end());
+
+	m_startTime = Now();
+	m_epoch.fetch_add(1, std::memory_order_relaxed);
+	m_mask.store(mask, std::memory_order_release);
+}
+
+void TraceRecorder::Stop()
+{
+	m_mask.store(0, std::memory_order_release);
+}
+
+TraceRecorder::ThreadBufferOwner::~ThreadBufferOwner()
+{
+	if (buffer != nullptr)
+	{
+		buffer->exited.store(true, std::memory_order_release);
+	}
+}
+
+TraceRecorder::ThreadBuffer* TraceRecorder::GetThreadBuffer()
+{
+	// A thread that never records allocates nothing, one that does grows its buffer a chunk (8 KB) at a time
+	static thread_local ThreadBufferOwner owner = { nullptr };
+	if (owner.buffer == nullptr)
+	{
+		ThreadBuffer* buffer = new ThreadBuffer();
+		buffer->epoch = m_epoch.load(std::memory_order_relaxed);
+		buffer->count = 0;
+		buffer->exited = false;
+		std::fill(buffer->chunks, buffer->chunks + ChunksPerThread, nullptr);
+
+		std::lock_guard<std::mutex> lock(m_mutex);
+		buffer->threadId = m_nextThreadId++;
+		m_buffers.push_back(buffer);
+		owner.buffer = buffer;
+	}
+	return owner.buffer;
+}
+
+void TraceRecorder::FreeThreadBuffer(ThreadBuffer* buffer)
+{
+	for (auto chunk : buffer->chunks)
+	{
+		delete[] chunk;
+	}
+	delete buffer;
+}
+
+void TraceRecorder::Record(unsigned int category, const char* name, int64_t start, int64_t end)
+{
+	ThreadBuffer* buffer = GetThreadBuffer();
+
+	unsigned int epoch = m_epoch.load(std::memory_order_relaxed);
+	if (buffer->epoch.load(std::memory_order_relaxed) != epoch)
+	{
+		// Events from an earlier recording
+		buffer->count.store(0, std::memory_order_relaxed);
+		buffer->epoch.store(epoch, std::memory_order_release);
+	}
+
+	size_t count = buffer->count.load(std::memory_order_relaxed);
+	if (count < EventsPerChunk * ChunksPerThread)
+	{
+		Event*& chunk = buffer->chunks[count / EventsPerChunk];
+		if (chunk == nullptr)
+		{
+			// Published to the exporter by the release store of the count below
+			chunk = new Event[EventsPerChunk];
+		}
+
+		Event& event = chunk[count % EventsPerChunk];
+		event.name = name;
+		event.category = category;
+		event.start = start;
+		event.end = end;
+		buffer->count.store(count + 1, std::memory_order_release);
+	}
+}
+
+std::string TraceRecorder::ExportChromeTrace()
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	unsigned int epoch = m_epoch.load(std::memory_order_relaxed);
+
+	std::string json = "{\"traceEvents\":[";
+	bool first = true;
+	for (auto buffer : m_buffers)
+	{
+		if (buffer->epoch.load(std::memory_order_acquire) != epoch)
+		{
+			continue;
+		}
+
+		size_t count = buffer->count.load(std::memory_order_acquire);
+		for (size_t i = 0; i < count; i++)
+		{
+			const Event& event = buffer->chunks[i / EventsPerChunk][i % EventsPerChunk];
+			// Complete events, timestamps and durations in microseconds with nanosecond fraction
+			char line[256];
+			snprintf(line, sizeof(line), "%s{\"name\":\"%s\",\"cat\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f}",
+				first ? "" : ",", event.name, GetCategoryName(event.category), buffer->threadId,
+				(event.start - m_startTime) / 1000.0, (event.end - event.start) / 1000.0);
+			json += line;
+			first = false;
+		}
+	}
+	json += "]}";
+
+	return json;
+}
@@ -0,0 +1,156 @@
+//*****************************************************************************
+//
+//	Copyright 2017 Microsoft Corporation
+//
+//	Licensed under the Apache License, Version 2.0 (the "License");
+//	you may not use this file except in compliance with the License.
+//	You may obtain a copy of the License at
+//
+//	http ://www.apache.org/licenses/LICENSE-2.0
+//
+//	Unless required by applicable law or agreed to in writing, software
+//	distributed under the License is distributed on an "AS IS" BASIS,
+//	WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//	See the License for the specific language governing permissions and
+//	limitations under the License.
+//
+//*****************************************************************************
+
+
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <stdint.h>
+
+// Trace spans compiled in: 0 none, 1 per sample and per packet stages, 2 also fine grained spans
+#ifndef FFMPEGINTEROP_TRACE_LEVEL
+#define FFMPEGINTEROP_TRACE_LEVEL 1
+#endif
+
+#define FFMPEGINTEROP_TRACE_CONCAT2(a, b) a##b
+#define FFMPEGINTEROP_TRACE_CONCAT(a, b) FFMPEGINTEROP_TRACE_CONCAT2(a, b)
+
+#if FFMPEGINTEROP_TRACE_LEVEL >= 1
+#define TRACE_SPAN(category, name) FFmpegInterop::TraceSpan FFMPEGINTEROP_TRACE_CONCAT(traceSpan, __LINE__)(category, name)
+#else
+#define TRACE_SPAN(category, name)
+#endif
+
+#if FFMPEGINTEROP_TRACE_LEVEL >= 2
+#define TRACE_SPAN_VERBOSE(category, name) TRACE_SPAN(category, name)
+#else
+#define TRACE_SPAN_VERBOSE(category, name)
+#endif
+
+namespace FFmpegInterop
+{
+	// Bit values match the public TraceCategories flags
+	enum TraceCategory : unsigned int
+	{
+		TraceDemux = 1,
+		TraceDecode = 2,
+		TraceConvert = 4,
+		TraceSample = 8,
+		TraceSeek = 16
+	};
+
+	//////////////////////////////////////////////////////////////////////////
+	//  TraceRecorder
+	//  Description: Collects spans into one buffer per thread, so recording
+	//               needs no lock, and exports them as Chrome trace-event JSON
+	//               (chrome://tracing, Perfetto). Plain C++ apart from pch.h.
+	//////////////////////////////////////////////////////////////////////////
+
+	class TraceRecorder
+	{
+	public:
+		static TraceRecorder& Instance();
+
+		// Discard what was recorded and record the categories in mask, 0 stops recording
+		void Start(unsigned int mask);
+		void Stop();
+		bool IsEnabled(unsigned int category)
+		{
+			return (m_mask.load(std::memory_order_relaxed) & category) != 0;
+		}
+
+		void Record(unsigned int category, const char* name, int64_t start, int64_t end);
+		std::string ExportChromeTrace();
+
+		// Nanoseconds on a monotonic clock
+		static int64_t Now()
+		{
+			return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+		}
+
+	private:
+		TraceRecorder();
+
+		struct Event
+		{
+			const char* name;
+			unsigned int category;
+			int64_t start;
+			int64_t end;
+		};
+
+		static const size_t EventsPerChunk = 256;
+		static const size_t ChunksPerThread = 256;
+
+		// Written only by its thread. The thread resets it when it notices a new recording epoch.
+		// Chunks are allocated as the count grows and kept for later recordings.
+		struct ThreadBuffer
+		{
+			int threadId;
+			std::atomic<unsigned int> epoch;
+			std::atomic<size_t> count;
+			std::atomic<bool> exited;
+			Event* chunks[ChunksPerThread];
+		};
+
+		// Marks the buffer of its thread when the thread exits, Start frees it
+		struct ThreadBufferOwner
+		{
+			ThreadBuffer* buffer;
+			~ThreadBufferOwner();
+		};
+
+		ThreadBuffer* GetThreadBuffer();
+		static void FreeThreadBuffer(ThreadBuffer* buffer);
+
+		std::atomic<unsigned int> m_mask;
+		std::atomic<unsigned int> m_epoch;
+		int64_t m_startTime;
+		int m_nextThreadId;
+		std::mutex m_mutex;
+		std::vector<ThreadBuffer*> m_buffers;
+	};
+
+	// Records the time from construction to destruction when its category is enabled
+	class TraceSpan
+	{
+	public:
+		TraceSpan(unsigned int category, const char* name)
+			: m_category(category)
+			, m_name(name)
+			, m_start(TraceRecorder::Instance().IsEnabled(category) ? TraceRecorder::Now() : 0)
+		{
+		}
+
+		~TraceSpan()
+		{
+			if (m_start != 0)
+			{
+				TraceRecorder::Instance().Record(m_category, m_name, m_start, TraceRecorder::Now());
+			}
+		}
+
+	private:
+		unsigned int m_category;
+		const char* m_name;
+		int64_t m_start;
+	};
+}
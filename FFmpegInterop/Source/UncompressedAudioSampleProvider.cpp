@@ -19,11 +19,20 @@
 #include "pch.h"
 
 #include "UncompressedAudioSampleProvider.h"
+#include "TraceRecorder.h"
 
 using namespace FFmpegInterop;
 
-// Minimum duration for uncompressed audio samples (50 ms)
-const LONGLONG MINAUDIOSAMPLEDURATION = 500000;
+// Default duration for uncompressed audio samples (50 ms)
+const LONGLONG DEFAULTAUDIOSAMPLEDURATION = 500000;
+// Live samples are handed out once they have this much and the next packet hasn't arrived yet (10 ms)
+const LONGLONG MINLIVEAUDIOSAMPLEDURATION = 100000;
+// Speed range of the live latency time-stretch and the latency excess (microseconds) at which the top speed is reached
+const double MINSTRETCHRATE = 1.03;
+const double MAXSTRETCHRATE = 1.10;
+const int64_t MAXSTRETCHEXCESS = 2000000;
+// Latency above the target before stretching starts, stretching continues down to the target
+const int64_t STRETCHHYSTERESIS = 250000;
 
 UncompressedAudioSampleProvider::UncompressedAudioSampleProvider(
 	FFmpegReader^ reader,
@@ -31,6 +40,13 @@ UncompressedAudioSampleProvider::UncompressedAudioSampleProvider(
 	AVCodecContext* avCodecCtx)
 	: UncompressedSampleProvider(reader, avFormatCtx, avCodecCtx)
 	, m_pSwrCtx(nullptr)
+	, m_pResampledData(nullptr)
+	, m_resampledDataSize(0)
+	, m_playbackRate(1.0)
+	, m_sampleDuration(DEFAULTAUDIOSAMPLEDURATION)
+	, m_pTimeStretcher(nullptr)
+	, m_isTimeStretched(false)
+	, m_nextSamplePts(0)
 {
 }
 
@@ -71,64 +87,140 @@ HRESULT UncompressedAudioSampleProvider::AllocateResources()
 		}
 	}
 
+	if (SUCCEEDED(hr) && m_pReader->m_targetLiveLatency > 0)
+	{
+		m_pTimeStretcher = new AudioTimeStretcher(m_pAvCodecCtx->sample_rate, m_pAvCodecCtx->channels);
+	}
+
 	return hr;
 }
 
 UncompressedAudioSampleProvider::~UncompressedAudioSampleProvider()
 {
-	if (m_pAvFrame)
-	{
-		av_frame_free(&m_pAvFrame);
-	}
-
 	// Free 
 	swr_free(&m_pSwrCtx);
+	av_freep(&m_pResampledData);
+	delete m_pTimeStretcher;
 }
 
-HRESULT UncompressedAudioSampleProvider::WriteAVPacketToStream(DataWriter^ dataWriter, AVPacket* avPacket)
+void UncompressedAudioSampleProvider::FlushDecoder()
 {
-	// Because each packet can contain multiple frames, we have already written the packet to the stream
-	// during the decode stage.
-	return S_OK;
+	UncompressedSampleProvider::FlushDecoder();
+
+	if (m_pTimeStretcher != nullptr)
+	{
+		m_pTimeStretcher->Reset();
+	}
+	m_isTimeStretched = false;
+}
+
+// Play slightly faster while a live stream is behind its target latency, faster the further behind it is
+void UncompressedAudioSampleProvider::UpdatePlaybackRate()
+{
+	int64_t latency = m_pReader->m_liveLatency;
+	int64_t target = m_pReader->m_targetLiveLatency;
+
+	if (latency <= target)
+	{
+		m_playbackRate = 1.0;
+	}
+	else if (m_playbackRate > 1.0 || latency > target + STRETCHHYSTERESIS)
+	{
+		double excess = min((double)(latency - target) / MAXSTRETCHEXCESS, 1.0);
+		m_playbackRate = MINSTRETCHRATE + (MAXSTRETCHRATE - MINSTRETCHRATE) * excess;
+	}
+
+	m_pTimeStretcher->SetRate(m_playbackRate);
 }
 
-HRESULT UncompressedAudioSampleProvider::ProcessDecodedFrame(DataWriter^ dataWriter)
+HRESULT UncompressedAudioSampleProvider::ProcessDecodedFrame(SampleWriter* dataWriter)
 {
-	// Resample uncompressed frame to AV_SAMPLE_FMT_S16 PCM format that is expected by Media Element
-	uint8_t *resampledData = nullptr;
-	unsigned int aBufferSize = av_samples_alloc(&resampledData, NULL, m_pAvFrame->channels, m_pAvFrame->nb_samples, AV_SAMPLE_FMT_S16, 0);
-	int resampledDataSize = swr_convert(m_pSwrCtx, &resampledData, aBufferSize, (const uint8_t **)m_pAvFrame->extended_data, m_pAvFrame->nb_samples);
-	auto aBuffer = ref new Platform::Array<uint8_t>(resampledData, min(aBufferSize, (unsigned int)(resampledDataSize * m_pAvFrame->channels * av_get_bytes_per_sample(AV_SAMPLE_FMT_S16))));
-	dataWriter->WriteBytes(aBuffer);
-	av_freep(&resampledData);
-	av_frame_unref(m_pAvFrame);
-	av_frame_free(&m_pAvFrame);
-
-	return S_OK;
+	HRESULT hr = S_OK;
+
+	// Make sure the scratch buffer can hold the resampled frame, only growing it when a larger frame shows up
+	int outSamples = swr_get_out_samples(m_pSwrCtx, m_pAvFrame->nb_samples);
+	int bufferSize = av_samples_get_buffer_size(NULL, m_pAvFrame->channels, outSamples, AV_SAMPLE_FMT_S16, 1);
+	if (bufferSize < 0)
+	{
+		hr = E_FAIL;
+	}
+	else if (bufferSize > m_resampledDataSize)
+	{
+		av_freep(&m_pResampledData);
+		m_resampledDataSize = 0;
+		if (av_samples_alloc(&m_pResampledData, NULL, m_pAvFrame->channels, outSamples, AV_SAMPLE_FMT_S16, 1) < 0)
+		{
+			hr = E_OUTOFMEMORY;
+		}
+		else
+		{
+			m_resampledDataSize = bufferSize;
+		}
+	}
+
+	if (SUCCEEDED(hr))
+	{
+		// Resample uncompressed frame to AV_SAMPLE_FMT_S16 PCM format that is expected by Media Element
+		int resampledDataSize = swr_convert(m_pSwrCtx, &m_pResampledData, outSamples, (const uint8_t **)m_pAvFrame->extended_data, m_pAvFrame->nb_samples);
+		if (resampledDataSize < 0)
+		{
+			hr = E_FAIL;
+		}
+		else if (m_pTimeStretcher != nullptr && (m_playbackRate != 1.0 || m_pTimeStretcher->IsActive()))
+		{
+			m_stretchedData.clear();
+			m_pTimeStretcher->Process((const int16_t*)m_pResampledData, resampledDataSize, m_stretchedData);
+			m_pReader->m_timeStretchOffset += av_rescale(m_pTimeStretcher->TakeRemovedFrames(), AV_TIME_BASE, m_pAvCodecCtx->sample_rate);
+			m_isTimeStretched = true;
+
+			if (!m_stretchedData.empty())
+			{
+				dataWriter->WriteBytes((const uint8_t*)m_stretchedData.data(), m_stretchedData.size() * sizeof(int16_t));
+			}
+		}
+		else
+		{
+			int bytesWritten = min(m_resampledDataSize, resampledDataSize * m_pAvFrame->channels * av_get_bytes_per_sample(AV_SAMPLE_FMT_S16));
+			dataWriter->WriteBytes(m_pResampledData, bytesWritten);
+		}
+	}
+
+	ReleaseFrame(m_pAvFrame);
+	m_pAvFrame = nullptr;
+
+	return hr;
 }
 
 MediaStreamSample^ UncompressedAudioSampleProvider::GetNextSample()
 {
 	// Similar to GetNextSample in MediaSampleProvider, 
 	// but we concatenate samples until reaching a minimum duration
-	DebugMessage(L"GetNextSample\n");
+	TRACE_SPAN(TraceSample, "GetNextSample");
 
 	HRESULT hr = S_OK;
 
 	MediaStreamSample^ sample;
-	DataWriter^ dataWriter = ref new DataWriter();
 
 	LONGLONG finalPts = -1;
 	LONGLONG finalDur = 0;
 	bool isFirstPacket = true;
 	bool isDiscontinuous;
+	LONGLONG sampleDuration = m_sampleDuration;
+	bool isLive = m_pReader->m_isLiveSource;
+
+	if (m_pTimeStretcher != nullptr)
+	{
+		UpdatePlaybackRate();
+		// Set again by ProcessDecodedFrame while the stretcher runs, afterwards the frame timestamps apply again
+		m_isTimeStretched = false;
+	}
 
 	do
 	{
 		LONGLONG pts = 0;
 		LONGLONG dur = 0;
 
-		hr = GetNextPacket(dataWriter, pts, dur, isFirstPacket);
+		hr = GetNextPacket(&m_sampleWriter, pts, dur, isFirstPacket);
 		if (isFirstPacket)
 		{
 			isDiscontinuous = m_isDiscontinuous;
@@ -144,14 +236,23 @@ MediaStreamSample^ UncompressedAudioSampleProvider::GetNextSample()
 			finalDur += dur;
 		}
 
-	} while (SUCCEEDED(hr) && finalDur < MINAUDIOSAMPLEDURATION);
+	} while (SUCCEEDED(hr) && finalDur < sampleDuration &&
+		!(isLive && finalDur >= MINLIVEAUDIOSAMPLEDURATION && !HasBufferedInput()));
+
+	if (m_isTimeStretched && finalDur > 0)
+	{
+		// Frame durations no longer match what was written, take pts and duration from the output itself
+		int64_t frames = m_sampleWriter.GetLength() / (m_pAvCodecCtx->channels * av_get_bytes_per_sample(AV_SAMPLE_FMT_S16));
+		finalPts = isDiscontinuous ? finalPts : m_nextSamplePts;
+		finalDur = max(av_rescale(frames, 10000000, m_pAvCodecCtx->sample_rate), 1LL);
+	}
 
 	if (finalDur > 0)
 	{
-		sample = MediaStreamSample::CreateFromBuffer(dataWriter->DetachBuffer(), { finalPts });
+		m_nextSamplePts = finalPts + finalDur;
+		sample = MediaStreamSample::CreateFromBuffer(m_sampleWriter.DetachBuffer(), { finalPts });
 		sample->Duration = { finalDur };
 		sample->Discontinuous = isDiscontinuous;
-		;
 		if (SUCCEEDED(hr))
 		{
 			// only reset flag if last packet was read successfully
@@ -161,6 +262,7 @@ MediaStreamSample^ UncompressedAudioSampleProvider::GetNextSample()
 	else
 	{
 		// flush stream and disable any further processing
+		m_sampleWriter.Clear();
 		DebugMessage(L"Too many broken packets - disable stream\n");
 		DisableStream();
 	}
@@ -18,6 +18,7 @@
 
 #pragma once
 #include "UncompressedSampleProvider.h"
+#include "AudioTimeStretcher.h"
 
 extern "C"
 {
@@ -37,12 +38,29 @@ namespace FFmpegInterop
 			FFmpegReader^ reader,
 			AVFormatContext* avFormatCtx,
 			AVCodecContext* avCodecCtx);
-		virtual HRESULT WriteAVPacketToStream(DataWriter^ writer, AVPacket* avPacket) override;
-		virtual HRESULT ProcessDecodedFrame(DataWriter^ dataWriter) override;
+		virtual HRESULT ProcessDecodedFrame(SampleWriter* dataWriter) override;
 		virtual HRESULT AllocateResources() override;
+		virtual void FlushDecoder() override;
+
+		// Current audio speed, above 1.0 while converging to the target live latency
+		double m_playbackRate;
+		// Decoded audio is collected into samples of this duration (100 ns units), can change during playback.
+		// Live sources hand out a shorter sample rather than wait for the network.
+		std::atomic<int64_t> m_sampleDuration;
 
 	private:
+		void UpdatePlaybackRate();
+
 		SwrContext* m_pSwrCtx;
+		// Resampler output, grown to the largest frame seen and reused afterwards
+		uint8_t* m_pResampledData;
+		int m_resampledDataSize;
+
+		AudioTimeStretcher* m_pTimeStretcher;
+		std::vector<int16_t> m_stretchedData;
+		// Once stretched, samples follow each other instead of their frame timestamps
+		bool m_isTimeStretched;
+		LONGLONG m_nextSamplePts;
 	};
 }
 
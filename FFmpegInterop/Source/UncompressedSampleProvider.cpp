@@ -18,172 +18,678 @@
 
 #include "pch.h"
 #include "UncompressedSampleProvider.h"
+#include "TraceRecorder.h"
+
+extern "C"
+{
+#include <libavutil/time.h>
+}
 
 using namespace FFmpegInterop;
 
 UncompressedSampleProvider::UncompressedSampleProvider(FFmpegReader^ reader, AVFormatContext* avFormatCtx, AVCodecContext* avCodecCtx)
 	: MediaSampleProvider(reader, avFormatCtx, avCodecCtx)
 	, m_pAvFrame(nullptr)
+	, m_decodeLatency(0)
+	, m_decodeLoad(0)
+	, m_seekTarget(AV_NOPTS_VALUE)
+	, m_requestedThreadCount(0)
+	, m_isDecoderDrained(false)
+	, m_pendingPacketStart(0)
+	, m_pendingPacketCount(0)
+	, m_decodeTime(0)
+	, m_decodedDuration(0)
+	, m_decodePauseCount(0)
+	, m_isDecodeStarted(false)
+	, m_isDecoding(false)
+	, m_stopDecoding(false)
+	, m_decodeResult(S_OK)
 {
 }
 
-HRESULT UncompressedSampleProvider::ProcessDecodedFrame(DataWriter^ dataWriter)
+UncompressedSampleProvider::~UncompressedSampleProvider()
 {
+	if (m_pAvFrame)
+	{
+		av_frame_free(&m_pAvFrame);
+	}
+
+	ClearDecodedFrames();
+	for (auto avFrame : m_framePool)
+	{
+		av_frame_free(&avFrame);
+	}
+	m_framePool.clear();
+}
+
+AVFrame* UncompressedSampleProvider::AcquireFrame()
+{
+	std::lock_guard<std::mutex> lock(m_poolMutex);
+	AVFrame* avFrame = nullptr;
+	if (!m_framePool.empty())
+	{
+		avFrame = m_framePool.back();
+		m_framePool.pop_back();
+	}
+	else
+	{
+		avFrame = av_frame_alloc();
+	}
+
+	return avFrame;
+}
+
+void UncompressedSampleProvider::ReleaseFrame(AVFrame* avFrame)
+{
+	if (avFrame != nullptr)
+	{
+		// Drop the references to the decoder buffers but keep the frame itself for reuse
+		av_frame_unref(avFrame);
+		std::lock_guard<std::mutex> lock(m_poolMutex);
+		m_framePool.push_back(avFrame);
+	}
+}
+
+void UncompressedSampleProvider::ClearDecodedFrames()
+{
+	while (!m_decodedFrames.IsEmpty())
+	{
+		ReleaseFrame(m_decodedFrames.Front().frame);
+		m_decodedFrames.PopFront();
+	}
+
+	DecodedFrame decodedFrame;
+	while (m_readyFrames != nullptr && m_readyFrames->TryPop(decodedFrame))
+	{
+		ReleaseFrame(decodedFrame.frame);
+	}
+}
+
+void UncompressedSampleProvider::Flush()
+{
+	PauseDecodeThread();
+	MediaSampleProvider::Flush();
+	m_seekTarget = AV_NOPTS_VALUE;
+	ResumeDecodeThread();
+}
+
+void UncompressedSampleProvider::SetSeekTarget(LONGLONG position)
+{
+	m_seekTarget = ConvertPosition(position);
+}
+
+// Called on the conversion thread, with the decode thread paused if there is one
+void UncompressedSampleProvider::FlushDecoder()
+{
+	MediaSampleProvider::FlushDecoder();
+
+	// Frames decoded before the flush belong to the old position
+	ClearDecodedFrames();
+	{
+		std::lock_guard<std::mutex> lock(m_stageMutex);
+		m_decodeResult = S_OK;
+	}
+	avcodec_flush_buffers(m_pAvCodecCtx);
+	m_isDecoderDrained = false;
+	m_pendingPacketCount = 0;
+	m_decodeTime = 0;
+	m_decodedDuration = 0;
+}
+
+// Duration of a decoded frame in microseconds, 0 if unknown
+int64_t UncompressedSampleProvider::GetFrameDuration(AVFrame* avFrame)
+{
+	AVStream* avStream = m_pAvFormatCtx->streams[m_streamIndex];
+	if (avFrame->pkt_duration > 0)
+	{
+		return av_rescale_q(avFrame->pkt_duration, avStream->time_base, AV_TIME_BASE_Q);
+	}
+	else if (avFrame->nb_samples > 0 && avFrame->sample_rate > 0)
+	{
+		return av_rescale(avFrame->nb_samples, AV_TIME_BASE, avFrame->sample_rate);
+	}
+	else if (avStream->avg_frame_rate.num > 0 && avStream->avg_frame_rate.den > 0)
+	{
+		return av_rescale_q(1, av_inv_q(avStream->avg_frame_rate), AV_TIME_BASE_Q);
+	}
+	return 0;
+}
+
+void UncompressedSampleProvider::UpdateDecodeLatency(AVFrame* avFrame)
+{
+	// Frames carry the pts of the packet they were decoded from. They can come out of the decoder
+	// in a different order than the packets went in, so look the packet up instead of taking the oldest.
+	for (int i = 0; i < m_pendingPacketCount; i++)
+	{
+		int index = (m_pendingPacketStart + i) % MaxPendingPackets;
+		if (m_pendingPackets[index].pts == avFrame->pts)
+		{
+			int64_t latency = av_gettime_relative() - m_pendingPackets[index].time;
+			m_decodeLatency = m_decodeLatency == 0 ? latency : (m_decodeLatency * 15 + latency) / 16;
+			m_latencyHistograms[static_cast<int>(LatencyStage::Decode)].Add(latency);
+
+			// Close the gap left by the matched packet
+			for (int j = i; j > 0; j--)
+			{
+				m_pendingPackets[(m_pendingPacketStart + j) % MaxPendingPackets] = m_pendingPackets[(m_pendingPacketStart + j - 1) % MaxPendingPackets];
+			}
+			m_pendingPacketStart = (m_pendingPacketStart + 1) % MaxPendingPackets;
+			m_pendingPacketCount--;
+			break;
+		}
+	}
+}
+
+HRESULT UncompressedSampleProvider::ProcessDecodedFrame(SampleWriter* dataWriter)
+{
+	ReleaseFrame(m_pAvFrame);
+	m_pAvFrame = nullptr;
 	return S_OK;
 }
 
-// Return S_FALSE for an incomplete frame
-HRESULT UncompressedSampleProvider::GetFrameFromFFmpegDecoder(AVPacket* avPacket)
+bool UncompressedSampleProvider::IsFrameLate(int64_t framePts, int64_t frameDuration)
 {
+	return false;
+}
 
-	DebugMessage(L"Decoding packet \n");
+// Return S_FALSE when the decoder needs more data before it can output a frame
+HRESULT UncompressedSampleProvider::GetFrameFromFFmpegDecoder(AVPacket* avPacket)
+{
+	TRACE_SPAN(TraceDecode, "Decode");
 
 	HRESULT hr = S_OK;
-	int decodeFrame = 0;
-
-	int ret = AVERROR(EAGAIN);
 
 	if (avPacket != nullptr)
 	{
-		int sendPacketResult = avcodec_send_packet(m_pAvCodecCtx, avPacket);
-		if (sendPacketResult == AVERROR(EAGAIN))
+		m_latencyHistograms[static_cast<int>(LatencyStage::Queue)].Add(av_gettime_relative() - m_packetReadTime);
+	}
+
+	if (avPacket != nullptr && avPacket->pts != AV_NOPTS_VALUE)
+	{
+		if (m_pendingPacketCount == MaxPendingPackets)
 		{
-			// The decoder should have been drained and always ready to access input
-			_ASSERT(FALSE);
-			DebugMessage(L"Decoder didn't return EAGAIN when feeding packet\n");
-			hr = E_UNEXPECTED;
+			// Forget the oldest packet, the decoder dropped it or it never had a matching pts
+			m_pendingPacketStart = (m_pendingPacketStart + 1) % MaxPendingPackets;
+			m_pendingPacketCount--;
 		}
-		else if (sendPacketResult < 0)
+		m_pendingPackets[(m_pendingPacketStart + m_pendingPacketCount) % MaxPendingPackets] = { avPacket->pts, av_gettime_relative() };
+		m_pendingPacketCount++;
+	}
+
+	int64_t decodeStart = av_gettime_relative();
+	std::unique_lock<std::mutex> decoderLock(m_decoderMutex);
+
+	if (avPacket != nullptr && (avPacket->flags & AV_PKT_FLAG_KEY))
+	{
+		int threadCount = m_requestedThreadCount.exchange(0);
+		if (threadCount > 0)
 		{
-			// We failed to send the packet
-			hr = E_FAIL;
-			DebugMessage(L"Decoder failed on the sample\n");
+			ReopenDecoder(threadCount);
 		}
 	}
 
-	/*
-	if (SUCCEEDED(hr))
+	if (avPacket != nullptr)
 	{
-		//binxie: drain the decoder 
-		AVFrame *pFrame = av_frame_alloc();
+		// The decoder copies this to the frames decoded from the packet, even when they come out reordered
+		m_pAvCodecCtx->reordered_opaque = m_packetReadTime;
+	}
 
-		bool GotFrame = false;
+	// Pictures ending before the seek target are only needed if later ones reference them
+	AVDiscard skipFrame = m_pAvCodecCtx->skip_frame;
+	if (avPacket != nullptr && avPacket->pts != AV_NOPTS_VALUE && avPacket->duration > 0 &&
+		avPacket->pts + avPacket->duration <= m_seekTarget && skipFrame < AVDISCARD_NONREF)
+	{
+		m_pAvCodecCtx->skip_frame = AVDISCARD_NONREF;
+	}
 
-		do {
-			ret = avcodec_receive_frame(m_pAvCodecCtx, pFrame);
+	// A null packet puts the decoder in draining mode so it returns its delayed frames
+	int sendPacketResult = avcodec_send_packet(m_pAvCodecCtx, avPacket);
+	m_pAvCodecCtx->skip_frame = skipFrame;
+	if (sendPacketResult == AVERROR(EAGAIN))
+	{
+		// The decoder is always drained after a packet so it should be ready to accept input
+		DebugMessage(L"Decoder returned EAGAIN when feeding packet\n");
+		hr = E_UNEXPECTED;
+	}
+	else if (sendPacketResult == AVERROR_EOF)
+	{
+		// Already draining, just collect whatever is left
+	}
+	else if (sendPacketResult < 0)
+	{
+		// We failed to send the packet
+		hr = E_FAIL;
+		DebugMessage(L"Decoder failed on the sample\n");
+	}
 
-			if (ret == AVERROR_EOF) {
-				avcodec_flush_buffers(m_pAvCodecCtx);
-				av_frame_unref(pFrame);
-				av_frame_free(&pFrame);
-				DebugMessage(L"reaching EOF \n");
-			}
+	// Drain every frame the decoder has ready instead of leaving them queued in the decoder
+	while (SUCCEEDED(hr))
+	{
+		AVFrame* pFrame = AcquireFrame();
+		if (pFrame == nullptr)
+		{
+			hr = E_OUTOFMEMORY;
+			break;
+		}
 
-			if (ret >= 0) {
-				m_pAvFrame = pFrame;
-				GotFrame = true;
+		int decodeFrame = avcodec_receive_frame(m_pAvCodecCtx, pFrame);
+		if (decodeFrame >= 0)
+		{
+			UpdateDecodeLatency(pFrame);
+			m_decodedDuration += GetFrameDuration(pFrame);
+			m_decodedFrames.PushBack({ pFrame, av_gettime_relative() });
+			continue;
+		}
 
-				DebugMessage(L"Drain 1 frame\n");
-			}
+		ReleaseFrame(pFrame);
+		if (decodeFrame == AVERROR_EOF)
+		{
+			DebugMessage(L"Decoder fully drained\n");
+			m_isDecoderDrained = true;
+		}
+		else if (decodeFrame != AVERROR(EAGAIN))
+		{
+			hr = E_FAIL;
+			DebugMessage(L"Failed to get a frame from the decoder\n");
+		}
+		break;
+	}
+	decoderLock.unlock();
 
-			//what if there is some other error??
+	// Packets that don't output a frame yet (reordering, frame threading) are accounted with the next frame
+	m_decodeTime += av_gettime_relative() - decodeStart;
+	if (m_decodedDuration > 0)
+	{
+		double load = (double)m_decodeTime / m_decodedDuration;
+		m_decodeLoad = m_decodeLoad == 0 ? load : (m_decodeLoad * 7 + load) / 8;
+		m_decodeTime = 0;
+		m_decodedDuration = 0;
+	}
+
+	if (hr == S_OK && m_decodedFrames.IsEmpty())
+	{
+		// The decoder doesn't have enough data to produce a frame,
+		// return S_FALSE to indicate a partial frame
+		hr = S_FALSE;
+	}
 
-			if (ret < 0 && ret != AVERROR(EAGAIN)) {
+	return hr;
+}
 
-				hr = E_FAIL;
-				av_frame_unref(pFrame);
-				av_frame_free(&pFrame);
-				DebugMessage(L"Failed to get a frame from the decoder\n");
+void UncompressedSampleProvider::SetDecoderThreadCount(int threadCount)
+{
+	m_requestedThreadCount = threadCount;
+}
 
-				return hr;
-			}
+// FFmpeg fixes the thread count when the codec is opened, so a new share needs a new decoder. Called
+// with m_decoderMutex held before a keyframe is sent, nothing after it references the old decoder.
+void UncompressedSampleProvider::ReopenDecoder(int threadCount)
+{
+	AVCodecContext* codecCtx = avcodec_alloc_context3(m_pAvCodecCtx->codec);
+	if (codecCtx == nullptr)
+	{
+		return;
+	}
 
-		} while (ret != AVERROR(EAGAIN));
+	if (avcodec_parameters_to_context(codecCtx, m_pAvFormatCtx->streams[m_streamIndex]->codecpar) < 0)
+	{
+		avcodec_free_context(&codecCtx);
+		return;
+	}
 
-		if (ret == AVERROR(EAGAIN) && !GotFrame) {
+	// Carry over the threading mode and what the decode quality and frame skipping changed
+	codecCtx->thread_count = threadCount;
+	codecCtx->thread_type = m_pAvCodecCtx->thread_type;
+	codecCtx->flags = m_pAvCodecCtx->flags;
+	codecCtx->flags2 = m_pAvCodecCtx->flags2;
+	codecCtx->skip_frame = m_pAvCodecCtx->skip_frame;
+	codecCtx->skip_loop_filter = m_pAvCodecCtx->skip_loop_filter;
+	codecCtx->skip_idct = m_pAvCodecCtx->skip_idct;
 
-			// The decoder doesn't have enough data to produce a frame,
-			// return S_FALSE to indicate a partial frame
-			hr = S_FALSE;
-			av_frame_unref(pFrame);
-			av_frame_free(&pFrame);
+	if (avcodec_open2(codecCtx, m_pAvCodecCtx->codec, NULL) < 0)
+	{
+		DebugMessage(L"Could not reopen the decoder\n");
+		avcodec_free_context(&codecCtx);
+		return;
+	}
 
-			DebugMessage(L"Don't have enough info to decode\n");
+	// The frames the old decoder still holds back (reordering, frame threading) come before the keyframe
+	if (avcodec_send_packet(m_pAvCodecCtx, nullptr) >= 0)
+	{
+		AVFrame* pFrame;
+		while ((pFrame = AcquireFrame()) != nullptr)
+		{
+			if (avcodec_receive_frame(m_pAvCodecCtx, pFrame) < 0)
+			{
+				ReleaseFrame(pFrame);
+				break;
+			}
+			UpdateDecodeLatency(pFrame);
+			m_decodedDuration += GetFrameDuration(pFrame);
+			m_decodedFrames.PushBack({ pFrame, av_gettime_relative() });
 		}
-		else {
+	}
+
+	avcodec_free_context(&m_pAvCodecCtx);
+	m_pAvCodecCtx = codecCtx;
+}
+
+// Feed packets to the decoder until it outputs at least one frame
+HRESULT UncompressedSampleProvider::DecodeNextPacket(bool allowSkip)
+{
+	HRESULT hr = S_OK;
+	bool isEndOfStream = false;
 
-			DebugMessage(L"Got frame\n");
+	// Continue reading until there is an appropriate packet in the stream
+	while (IsPacketQueueEmpty())
+	{
+		if (m_pReader->ReadPacket() < 0)
+		{
+			isEndOfStream = true;
+			break;
 		}
-	
-	} */
+	}
 
-	
-	if (SUCCEEDED(hr))
+	if (m_readyFrames == nullptr)
 	{
-		AVFrame *pFrame = av_frame_alloc();
-		// Try to get a frame from the decoder.
-		decodeFrame = avcodec_receive_frame(m_pAvCodecCtx, pFrame);
+		ApplyPendingSkip();
+	}
+	else if (IsSkipPending())
+	{
+		// Frames decoded from here on would be thrown away with the skip, the conversion thread applies it
+		return S_OK;
+	}
 
-		// The decoder is empty, send a packet to it.
-		if (decodeFrame == AVERROR(EAGAIN))
+	AVPacket avPacket;
+	if (!PopPacket(&avPacket))
+	{
+		if (!isEndOfStream)
 		{
-			// The decoder doesn't have enough data to produce a frame,
-			// return S_FALSE to indicate a partial frame
-			hr = S_FALSE;
-			av_frame_unref(pFrame);
-			av_frame_free(&pFrame);
+			// A live catch-up on the other stream's thread emptied the queue, read on
+			hr = S_OK;
 		}
-		else if (decodeFrame < 0)
+		else if (m_isDecoderDrained)
 		{
+			DebugMessage(L"GetNextSample reaching EOF\n");
 			hr = E_FAIL;
-			av_frame_unref(pFrame);
-			av_frame_free(&pFrame);
-			DebugMessage(L"Failed to get a frame from the decoder\n");
 		}
 		else
 		{
-			m_pAvFrame = pFrame;
+			// End of stream, flush the frames still held back by the decoder (reordering or frame threading)
+			hr = GetFrameFromFFmpegDecoder(nullptr);
+			if (hr == S_FALSE || (SUCCEEDED(hr) && m_decodedFrames.IsEmpty()))
+			{
+				hr = E_FAIL;
+			}
 		}
 	}
+	else
+	{
+		hr = GetFrameFromFFmpegDecoder(&avPacket);
+		av_packet_unref(&avPacket);
 
-	
+		if (FAILED(hr))
+		{
+			m_isDiscontinuous = true;
+			m_counters.decodeErrors++;
+			if (allowSkip)
+			{
+				// skip a few broken packets (maybe make this configurable later)
+				DebugMessage(L"Skipping broken packet\n");
+				m_counters.skippedPackets++;
+				hr = S_OK;
+			}
+		}
+	}
 
 	return hr;
 }
 
-HRESULT UncompressedSampleProvider::DecodeAVPacket(DataWriter^ dataWriter, AVPacket* avPacket, int64_t& framePts, int64_t& frameDuration)
+HRESULT UncompressedSampleProvider::GetNextPacket(SampleWriter* writer, LONGLONG& pts, LONGLONG& dur, bool allowSkip)
 {
 	HRESULT hr = S_OK;
-	bool fGotFrame  = false;
-	AVPacket *pPacket = avPacket;
+	int64_t framePts = 0;
+	int64_t frameDuration = 0;
+	int64_t decodedTime = 0;
 
 	while (SUCCEEDED(hr))
 	{
-		hr = GetFrameFromFFmpegDecoder(pPacket);
-		pPacket = nullptr;
-		if (SUCCEEDED(hr))
+		hr = TakeDecodedFrame(allowSkip, m_pAvFrame, decodedTime);
+		if (FAILED(hr))
 		{
-			if (hr == S_FALSE)
-			{
-				// If the decoder didn't give an initial frame we still need
-				// to feed it more frames. Keep S_FALSE as the result
-				if (fGotFrame)
-				{
-					hr = S_OK;
-				}
-				break;
-			}
-			// Update the timestamp if the packet has one
-			else if (m_pAvFrame->pts != AV_NOPTS_VALUE)
-			{
-				framePts = m_pAvFrame->pts;
-				frameDuration = m_pAvFrame->pkt_duration;
-			}
-			fGotFrame = true;
+			break;
+		}
 
-			hr = ProcessDecodedFrame(dataWriter);
+		// Try to get the best effort timestamp for the frame.
+		framePts = av_frame_get_best_effort_timestamp(m_pAvFrame);
+		frameDuration = m_pAvFrame->pkt_duration;
+		if (frameDuration <= 0 && m_pAvFormatCtx->streams[m_streamIndex]->codecpar->codec_type == AVMEDIA_TYPE_AUDIO && m_pAvFrame->sample_rate > 0)
+		{
+			frameDuration = av_rescale_q(m_pAvFrame->nb_samples, av_make_q(1, m_pAvFrame->sample_rate), m_pAvFormatCtx->streams[m_streamIndex]->time_base);
+		}
+
+		if (framePts == AV_NOPTS_VALUE)
+		{
+			framePts = m_nextFramePts;
 		}
+		m_nextFramePts = framePts + frameDuration;
+
+		int64_t seekTarget = m_seekTarget;
+		if (seekTarget != AV_NOPTS_VALUE && (frameDuration > 0 ? framePts + frameDuration <= seekTarget : framePts < seekTarget))
+		{
+			// Decoded only as a reference for the frames after the seek target, skip the conversion
+			ReleaseFrame(m_pAvFrame);
+			m_pAvFrame = nullptr;
+			continue;
+		}
+		if (seekTarget != AV_NOPTS_VALUE)
+		{
+			// Reached the target, later packets are decoded as usual again
+			m_seekTarget = AV_NOPTS_VALUE;
+		}
+
+		if (!IsFrameLate(framePts, frameDuration))
+		{
+			break;
+		}
+
+		// Don't spend time converting a frame the renderer would drop anyway
+		m_counters.droppedFrames++;
+		ReleaseFrame(m_pAvFrame);
+		m_pAvFrame = nullptr;
+	}
+
+	if (SUCCEEDED(hr))
+	{
+		// The frame is handed back to the pool by ProcessDecodedFrame
+		int64_t readTime = m_pAvFrame->reordered_opaque;
+		int64_t convertStart = av_gettime_relative();
+		{
+			TRACE_SPAN(TraceConvert, "Convert");
+			hr = ProcessDecodedFrame(writer);
+		}
+		ConvertTimestamps(framePts, frameDuration, pts, dur);
+
+		int64_t now = av_gettime_relative();
+		m_counters.conversionTime += now - convertStart;
+		m_latencyHistograms[static_cast<int>(LatencyStage::Convert)].Add(now - decodedTime);
+		if (m_sampleReadTime == AV_NOPTS_VALUE && readTime != AV_NOPTS_VALUE)
+		{
+			// Audio samples are built from several frames, the oldest one counts
+			m_sampleReadTime = readTime;
+		}
+		m_sampleConvertTime = now;
+	}
+
+	return hr;
+}
+
+HRESULT UncompressedSampleProvider::TakeDecodedFrame(bool allowSkip, AVFrame*& avFrame, int64_t& decodedTime)
+{
+	if (m_readyFrames != nullptr)
+	{
+		return TakeReadyFrame(avFrame, decodedTime);
+	}
+
+	HRESULT hr = S_OK;
+	while (SUCCEEDED(hr) && m_decodedFrames.IsEmpty())
+	{
+		hr = DecodeNextPacket(allowSkip);
+	}
+
+	if (SUCCEEDED(hr))
+	{
+		avFrame = m_decodedFrames.Front().frame;
+		decodedTime = m_decodedFrames.Front().decodedTime;
+		m_decodedFrames.PopFront();
 	}
 
 	return hr;
 }
+
+HRESULT UncompressedSampleProvider::TakeReadyFrame(AVFrame*& avFrame, int64_t& decodedTime)
+{
+	DecodedFrame decodedFrame;
+	while (!m_readyFrames->TryPop(decodedFrame))
+	{
+		if (IsSkipPending())
+		{
+			// Live catch-up: drop the frames decoded before the skip, then let the decode thread go on
+			PauseDecodeThread();
+			ApplyPendingSkip();
+			ResumeDecodeThread();
+			continue;
+		}
+
+		std::unique_lock<std::mutex> lock(m_stageMutex);
+		if (m_readyFrames->IsEmpty() && SUCCEEDED(m_decodeResult) && !IsSkipPending())
+		{
+			m_stageWakeUp.wait(lock);
+		}
+		else if (m_readyFrames->IsEmpty() && FAILED(m_decodeResult))
+		{
+			return m_decodeResult;
+		}
+	}
+
+	// The decode thread may be waiting for room. Notify under the lock so the wakeup isn't lost
+	// between its check and its wait.
+	{
+		std::lock_guard<std::mutex> lock(m_stageMutex);
+		m_stageWakeUp.notify_all();
+	}
+
+	avFrame = decodedFrame.frame;
+	decodedTime = decodedFrame.decodedTime;
+	return S_OK;
+}
+
+bool UncompressedSampleProvider::HasBufferedInput()
+{
+	return !m_decodedFrames.IsEmpty() || (m_readyFrames != nullptr && !m_readyFrames->IsEmpty()) || !IsPacketQueueEmpty();
+}
+
+void UncompressedSampleProvider::StartDecodeThread(size_t depth)
+{
+	m_readyFrames.reset(new SpscQueue<DecodedFrame>(depth));
+	m_stopDecoding = false;
+	m_isDecodeStarted = false;
+	m_decodeThread = std::thread([this]() { RunDecodeThread(); });
+}
+
+void UncompressedSampleProvider::StopDecodeThread()
+{
+	if (!m_decodeThread.joinable())
+	{
+		return;
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(m_stageMutex);
+		m_stopDecoding = true;
+		m_stageWakeUp.notify_all();
+	}
+	m_decodeThread.join();
+
+	// Hand the decoded frames back to the pool, the decoder continues on the request thread
+	ClearDecodedFrames();
+	m_readyFrames = nullptr;
+}
+
+void UncompressedSampleProvider::PauseDecodeThread()
+{
+	if (!m_decodeThread.joinable())
+	{
+		return;
+	}
+
+	std::unique_lock<std::mutex> lock(m_stageMutex);
+	m_decodePauseCount++;
+	while (m_isDecoding)
+	{
+		m_stageWakeUp.wait(lock);
+	}
+}
+
+void UncompressedSampleProvider::ResumeDecodeThread()
+{
+	if (!m_decodeThread.joinable())
+	{
+		return;
+	}
+
+	std::lock_guard<std::mutex> lock(m_stageMutex);
+	m_decodePauseCount--;
+	m_stageWakeUp.notify_all();
+}
+
+void UncompressedSampleProvider::PreRollDecodeThread()
+{
+	if (!m_decodeThread.joinable())
+	{
+		return;
+	}
+
+	std::lock_guard<std::mutex> lock(m_stageMutex);
+	m_isDecodeStarted = true;
+	m_stageWakeUp.notify_all();
+}
+
+// Decode stage: feed packets to the decoder and pass the frames on while there is room, so the
+// next frame is decoded while the previous one is converted
+void UncompressedSampleProvider::RunDecodeThread()
+{
+	std::unique_lock<std::mutex> lock(m_stageMutex);
+	while (!m_stopDecoding)
+	{
+		// Nothing is decoded before the first Starting, its seek would throw the frames away
+		if (!m_isDecodeStarted || m_decodePauseCount > 0 || FAILED(m_decodeResult) || m_readyFrames->IsFull() || IsSkipPending())
+		{
+			m_stageWakeUp.wait(lock);
+			continue;
+		}
+		m_isDecoding = true;
+		lock.unlock();
+
+		// Reading waits on the network without m_decoderMutex, so decoder settings can change meanwhile
+		HRESULT hr = S_OK;
+		while (SUCCEEDED(hr) && m_decodedFrames.IsEmpty() && !IsSkipPending())
+		{
+			hr = DecodeNextPacket(true);
+		}
+
+		// Frames that don't fit stay in m_decodedFrames until the conversion catches up
+		while (!m_decodedFrames.IsEmpty() && m_readyFrames->TryPush(m_decodedFrames.Front()))
+		{
+			m_decodedFrames.PopFront();
+		}
+
+		lock.lock();
+		m_isDecoding = false;
+		if (FAILED(hr))
+		{
+			m_decodeResult = hr;
+		}
+		m_stageWakeUp.notify_all();
+	}
+}
@@ -17,7 +17,15 @@
 //*****************************************************************************
 
 #pragma once
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
 #include "MediaSampleProvider.h"
+#include "RingBuffer.h"
+#include "SpscQueue.h"
 
 extern "C"
 {
@@ -28,18 +36,108 @@ namespace FFmpegInterop
 {
 	ref class UncompressedSampleProvider abstract : public MediaSampleProvider
 	{
+	public:
+		virtual ~UncompressedSampleProvider();
+		virtual void Flush() override;
+
 	internal:
-		// Try to get a frame from FFmpeg, otherwise, feed a frame to start decoding
+		virtual void FlushDecoder() override;
+		// Feed a packet to the decoder (or nullptr to drain it at the end of the stream)
+		// and move every frame it can produce to the decoded frame queue
 		virtual HRESULT GetFrameFromFFmpegDecoder(AVPacket* avPacket);
-		virtual HRESULT DecodeAVPacket(DataWriter^ dataWriter, AVPacket* avPacket, int64_t& framePts, int64_t& frameDuration) override;
-		virtual HRESULT ProcessDecodedFrame(DataWriter^ dataWriter);
+		virtual HRESULT GetNextPacket(SampleWriter* writer, LONGLONG& pts, LONGLONG& dur, bool allowSkip) override;
+		virtual HRESULT ProcessDecodedFrame(SampleWriter* dataWriter);
+		// Frames reported late are returned to the pool without being processed
+		virtual bool IsFrameLate(int64_t framePts, int64_t frameDuration);
 		UncompressedSampleProvider(
 			FFmpegReader^ reader,
 			AVFormatContext* avFormatCtx,
 			AVCodecContext* avCodecCtx);
 
+		// Frames are recycled instead of being allocated for every decoded picture
+		AVFrame* AcquireFrame();
+		void ReleaseFrame(AVFrame* avFrame);
+
+		// Demux and decode on a thread of their own, up to depth frames ahead of the conversion
+		void StartDecodeThread(size_t depth);
+		void StopDecodeThread();
+		// Hold the decode thread between packets, e.g. while the reader seeks. Calls nest.
+		void PauseDecodeThread();
+		void ResumeDecodeThread();
+		// Let the decode thread run once the reader is at the start position, it waits until then
+		void PreRollDecodeThread();
+		// True if a frame can be produced without reading from the source
+		bool HasBufferedInput();
+		// Accurate seek: frames ending before this position on the sample timeline are dropped
+		// before conversion. Cleared by the first frame past it and by Flush.
+		void SetSeekTarget(LONGLONG position);
+		// The decoder is reopened with this many threads at the next keyframe. It owns m_pAvCodecCtx from then on.
+		void SetDecoderThreadCount(int threadCount);
+
 	internal:
 		AVFrame* m_pAvFrame;
+		// Running average of the time between sending a packet and receiving its frame, in microseconds
+		std::atomic<int64_t> m_decodeLatency;
+		// Running average of the wall time spent in the decoder relative to the duration of the decoded frames
+		std::atomic<double> m_decodeLoad;
+		// Held while a packet is sent to the decoder and its frames are received, take it to change decoder settings
+		std::mutex m_decoderMutex;
+		// Seek target in the stream time base, AV_NOPTS_VALUE when there is none
+		std::atomic<int64_t> m_seekTarget;
+		// Decoder thread count to switch to at the next keyframe, 0 to keep the current decoder
+		std::atomic<int> m_requestedThreadCount;
+
+	private:
+		HRESULT DecodeNextPacket(bool allowSkip);
+		void ReopenDecoder(int threadCount);
+		// Next frame from the decoder, or from the decode thread when it runs
+		HRESULT TakeDecodedFrame(bool allowSkip, AVFrame*& avFrame, int64_t& decodedTime);
+		HRESULT TakeReadyFrame(AVFrame*& avFrame, int64_t& decodedTime);
+		void RunDecodeThread();
+		void ClearDecodedFrames();
+		void UpdateDecodeLatency(AVFrame* avFrame);
+		int64_t GetFrameDuration(AVFrame* avFrame);
+
+		struct PacketSendTime
+		{
+			int64_t pts;
+			int64_t time;
+		};
+
+		// Send times of the packets still inside the decoder, oldest first
+		static const int MaxPendingPackets = 32;
+		PacketSendTime m_pendingPackets[MaxPendingPackets];
+		int m_pendingPacketStart;
+		int m_pendingPacketCount;
+
+		// Decode time and decoded duration since the last load update, in microseconds
+		int64_t m_decodeTime;
+		int64_t m_decodedDuration;
+
+		// A frame waiting for conversion and when it came out of the decoder
+		struct DecodedFrame
+		{
+			AVFrame* frame;
+			int64_t decodedTime;
+		};
+
+		// Frames are acquired on the decode thread and released on the conversion thread
+		std::mutex m_poolMutex;
+		std::vector<AVFrame*> m_framePool;
+		RingBuffer<DecodedFrame> m_decodedFrames;
+		bool m_isDecoderDrained;
+
+		// Decode thread. m_readyFrames hands decoded frames to the conversion, everything
+		// else below is guarded by m_stageMutex.
+		std::unique_ptr<SpscQueue<DecodedFrame>> m_readyFrames;
+		std::thread m_decodeThread;
+		std::mutex m_stageMutex;
+		std::condition_variable m_stageWakeUp;
+		int m_decodePauseCount;
+		bool m_isDecodeStarted;
+		bool m_isDecoding;
+		bool m_stopDecoding;
+		// End of stream or a fatal decoder error, reported once the ready frames are used up
+		HRESULT m_decodeResult;
 	};
 }
-
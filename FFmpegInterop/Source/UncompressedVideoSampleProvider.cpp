@@ -23,10 +23,23 @@
 extern "C"
 {
 #include <libavutil/imgutils.h>
+#include <libavutil/time.h>
 }
 
 
 using namespace FFmpegInterop;
+using namespace Windows::Media::MediaProperties;
+
+// Number of scaler contexts kept around for streams that switch back and forth between formats
+const size_t SCALERCACHESIZE = 4;
+// Decoder frame skipping is reevaluated once per window (microseconds)
+const int64_t SKIPFRAMEWINDOW = 1000000;
+// Decode load above which the decode quality steps down, and below which it steps back up
+const double OVERLOADEDDECODELOAD = 0.9;
+const double HEADROOMDECODELOAD = 0.5;
+// Frames the load has to stay past a threshold before taking a step. Stepping up waits longer.
+const int OVERLOADEDFRAMES = 30;
+const int HEADROOMFRAMES = 150;
 
 UncompressedVideoSampleProvider::UncompressedVideoSampleProvider(
 	FFmpegReader^ reader,
@@ -34,6 +47,21 @@ UncompressedVideoSampleProvider::UncompressedVideoSampleProvider(
 	AVCodecContext* avCodecCtx)
 	: UncompressedSampleProvider(reader, avFormatCtx, avCodecCtx)
 	, m_pSwsCtx(nullptr)
+	, m_frameWidth(0)
+	, m_frameHeight(0)
+	, m_framePixelFormat(AV_PIX_FMT_NONE)
+	, m_frameAspectRatio(av_make_q(0, 1))
+	, m_outputWidth(0)
+	, m_outputHeight(0)
+	, m_formatChanged(false)
+	, m_lateFramesDropped(0)
+	, m_decodeQuality(DecodeQuality::Full)
+	, m_decodeQualityChanged(false)
+	, m_overloadedFrames(0)
+	, m_headroomFrames(0)
+	, m_skipWindowStart(AV_NOPTS_VALUE)
+	, m_skipWindowLateFrames(0)
+	, m_skipWindowsOnTime(0)
 {
 	for (int i = 0; i < 4; i++)
 	{
@@ -48,19 +76,16 @@ HRESULT UncompressedVideoSampleProvider::AllocateResources()
 	hr = UncompressedSampleProvider::AllocateResources();
 	if (SUCCEEDED(hr))
 	{
-		// Setup software scaler to convert any decoder pixel format (e.g. YUV420P) to NV12 that is supported in Windows & Windows Phone MediaElement
-		m_pSwsCtx = sws_getContext(
-			m_pAvCodecCtx->width,
-			m_pAvCodecCtx->height,
-			m_pAvCodecCtx->pix_fmt,
-			m_pAvCodecCtx->width,
-			m_pAvCodecCtx->height,
-			AV_PIX_FMT_NV12,
-			SWS_BICUBIC,
-			NULL,
-			NULL,
-			NULL);
+		// Setup software scaler and output buffer for the format the decoder was opened with.
+		// Frames that arrive with a different size or pixel format are handled in UpdateOutputFormat.
+		m_frameWidth = m_pAvCodecCtx->width;
+		m_frameHeight = m_pAvCodecCtx->height;
+		m_framePixelFormat = m_pAvCodecCtx->pix_fmt;
+		m_frameAspectRatio = m_pAvCodecCtx->sample_aspect_ratio;
+		m_outputWidth = m_frameWidth;
+		m_outputHeight = m_frameHeight;
 
+		m_pSwsCtx = GetScaler(m_frameWidth, m_frameHeight, m_framePixelFormat, m_outputWidth, m_outputHeight);
 		if (m_pSwsCtx == nullptr)
 		{
 			hr = E_OUTOFMEMORY;
@@ -69,52 +94,309 @@ HRESULT UncompressedVideoSampleProvider::AllocateResources()
 
 	if (SUCCEEDED(hr))
 	{
-		m_pAvFrame = av_frame_alloc();
-		if (m_pAvFrame == nullptr)
+		if (av_image_alloc(m_rgVideoBufferData, m_rgVideoBufferLineSize, m_outputWidth, m_outputHeight, AV_PIX_FMT_NV12, 1) < 0)
 		{
-			hr = E_OUTOFMEMORY;
+			hr = E_FAIL;
 		}
 	}
 
-	if (SUCCEEDED(hr))
+	return hr;
+}
+
+UncompressedVideoSampleProvider::~UncompressedVideoSampleProvider()
+{
+	if (m_rgVideoBufferData)
+	{
+		av_freep(m_rgVideoBufferData);
+	}
+
+	for (auto& entry : m_scalerCache)
+	{
+		sws_freeContext(entry.swsCtx);
+	}
+	m_scalerCache.clear();
+}
+
+SwsContext* UncompressedVideoSampleProvider::GetScaler(int width, int height, AVPixelFormat pixelFormat, int outputWidth, int outputHeight)
+{
+	for (auto it = m_scalerCache.begin(); it != m_scalerCache.end(); ++it)
 	{
-		if (av_image_alloc(m_rgVideoBufferData, m_rgVideoBufferLineSize, m_pAvCodecCtx->width, m_pAvCodecCtx->height, AV_PIX_FMT_NV12, 1) < 0)
+		if (it->width == width && it->height == height && it->pixelFormat == pixelFormat && it->outputWidth == outputWidth && it->outputHeight == outputHeight)
 		{
-			hr = E_FAIL;
+			// Move the hit to the front so the least recently used entry is evicted first
+			m_scalerCache.splice(m_scalerCache.begin(), m_scalerCache, it);
+			return m_scalerCache.front().swsCtx;
+		}
+	}
+
+	// Setup software scaler to convert any decoder pixel format (e.g. YUV420P) to NV12 that is supported in Windows & Windows Phone MediaElement
+	SwsContext* swsCtx = sws_getContext(
+		width,
+		height,
+		pixelFormat,
+		outputWidth,
+		outputHeight,
+		AV_PIX_FMT_NV12,
+		SWS_BICUBIC,
+		NULL,
+		NULL,
+		NULL);
+
+	if (swsCtx != nullptr)
+	{
+		if (m_scalerCache.size() >= SCALERCACHESIZE)
+		{
+			sws_freeContext(m_scalerCache.back().swsCtx);
+			m_scalerCache.pop_back();
 		}
+		m_scalerCache.push_front({ width, height, pixelFormat, outputWidth, outputHeight, swsCtx });
+	}
+
+	return swsCtx;
+}
+
+// Compare the decoded frame against the current output format and switch scaler and buffers if needed
+HRESULT UncompressedVideoSampleProvider::UpdateOutputFormat(AVFrame* avFrame)
+{
+	HRESULT hr = S_OK;
+	AVPixelFormat pixelFormat = static_cast<AVPixelFormat>(avFrame->format);
+	int outputWidth = avFrame->width;
+	int outputHeight = avFrame->height;
+
+	if (m_decodeQuality.load() == DecodeQuality::ReducedResolution)
+	{
+		// Half size, kept even for the NV12 chroma plane
+		outputWidth = max(avFrame->width / 2 & ~1, 2);
+		outputHeight = max(avFrame->height / 2 & ~1, 2);
+	}
+
+	if (avFrame->width != m_frameWidth || avFrame->height != m_frameHeight || pixelFormat != m_framePixelFormat ||
+		outputWidth != m_outputWidth || outputHeight != m_outputHeight)
+	{
+		DebugMessage(L"Decoded video format changed\n");
+
+		SwsContext* swsCtx = GetScaler(avFrame->width, avFrame->height, pixelFormat, outputWidth, outputHeight);
+		if (swsCtx == nullptr)
+		{
+			hr = E_OUTOFMEMORY;
+		}
+
+		if (SUCCEEDED(hr) && (outputWidth != m_outputWidth || outputHeight != m_outputHeight))
+		{
+			// Reallocate the NV12 output buffer for the new dimensions
+			av_freep(m_rgVideoBufferData);
+			if (av_image_alloc(m_rgVideoBufferData, m_rgVideoBufferLineSize, outputWidth, outputHeight, AV_PIX_FMT_NV12, 1) < 0)
+			{
+				m_frameWidth = 0;
+				m_frameHeight = 0;
+				m_outputWidth = 0;
+				m_outputHeight = 0;
+				hr = E_OUTOFMEMORY;
+			}
+		}
+
+		if (SUCCEEDED(hr))
+		{
+			m_pSwsCtx = swsCtx;
+			m_frameWidth = avFrame->width;
+			m_frameHeight = avFrame->height;
+			m_framePixelFormat = pixelFormat;
+			if (outputWidth != m_outputWidth || outputHeight != m_outputHeight)
+			{
+				m_outputWidth = outputWidth;
+				m_outputHeight = outputHeight;
+				m_formatChanged = true;
+			}
+		}
+	}
+
+	if (SUCCEEDED(hr) && avFrame->sample_aspect_ratio.num > 0 && av_cmp_q(avFrame->sample_aspect_ratio, m_frameAspectRatio) != 0)
+	{
+		m_frameAspectRatio = avFrame->sample_aspect_ratio;
+		m_formatChanged = true;
 	}
 
 	return hr;
 }
 
-UncompressedVideoSampleProvider::~UncompressedVideoSampleProvider()
+SampleFormat UncompressedVideoSampleProvider::TakeSampleFormat()
 {
-	if (m_pAvFrame)
+	SampleFormat format = { m_formatChanged, m_outputWidth, m_outputHeight, m_frameAspectRatio };
+	m_formatChanged = false;
+	return format;
+}
+
+// Signal the new format to the media pipeline. MediaStreamSource picks up changed encoding properties
+// on the stream descriptor together with the next sample, so playback continues without a reopen.
+void UncompressedVideoSampleProvider::ApplySampleFormat(const SampleFormat& format)
+{
+	if (!format.isChanged || m_pStreamDescriptor == nullptr)
 	{
-		av_frame_free(&m_pAvFrame);
+		return;
 	}
 
-	if (m_rgVideoBufferData)
+	VideoEncodingProperties^ videoProperties = m_pStreamDescriptor->EncodingProperties;
+	videoProperties->Width = format.width;
+	videoProperties->Height = format.height;
+
+	if (format.aspectRatio.num > 0 && format.aspectRatio.den != 0)
 	{
-		av_freep(m_rgVideoBufferData);
+		videoProperties->PixelAspectRatio->Numerator = format.aspectRatio.num;
+		videoProperties->PixelAspectRatio->Denominator = format.aspectRatio.den;
 	}
 }
 
-HRESULT UncompressedVideoSampleProvider::DecodeAVPacket(DataWriter^ dataWriter, AVPacket* avPacket, int64_t& framePts, int64_t& frameDuration)
+void UncompressedVideoSampleProvider::FlushDecoder()
 {
-	HRESULT hr = S_OK;
-	hr = UncompressedSampleProvider::DecodeAVPacket(dataWriter, avPacket, framePts, frameDuration);
+	UncompressedSampleProvider::FlushDecoder();
+	ResetClock();
+}
+
+void UncompressedVideoSampleProvider::ResetClock()
+{
+	m_clock.Stop();
+}
+
+void UncompressedVideoSampleProvider::SetBufferTime(TimeSpan bufferTime)
+{
+	m_clock.SetBufferTime(bufferTime.Duration / 10);
+}
+
+// The renderer presents samples in real time starting with the first one it receives, so the sample
+// handed out first after a (re)start anchors the clock to the wall clock. Frames decoded ahead, e.g.
+// during pre-roll, are never late while the clock isn't running.
+void UncompressedVideoSampleProvider::RecordSampleHandoff(MediaStreamSample^ sample, const SampleTiming& timing)
+{
+	UncompressedSampleProvider::RecordSampleHandoff(sample, timing);
 
-	// Don't set a timestamp on S_FALSE
-	if (hr == S_OK)
+	m_clock.Start(av_gettime_relative(), sample->Timestamp.Duration / 10);
+}
+
+// Called by the decoding thread, which can run ahead of the renderer by the ready queue
+bool UncompressedVideoSampleProvider::IsFrameLate(int64_t framePts, int64_t frameDuration)
+{
+	// Compare on the sample timeline, which the renderer clock follows
+	LONGLONG pts = 0;
+	LONGLONG dur = 0;
+	ConvertTimestamps(framePts, max(frameDuration, 0LL), pts, dur);
+	bool isLate = m_clock.IsFrameLate(av_gettime_relative(), (pts + dur) / 10);
+
+	UpdateSkipFrame(isLate);
+
+	if (isLate)
 	{
-		// Try to get the best effort timestamp for the frame.
-		framePts = av_frame_get_best_effort_timestamp(m_pAvFrame);
-		m_interlaced_frame = m_pAvFrame->interlaced_frame == 1;
-		m_top_field_first = m_pAvFrame->top_field_first == 1;
+		m_lateFramesDropped++;
 	}
 
-	return hr;
+	return isLate;
+}
+
+// Dropping after decode still pays for decoding. Under sustained overload let the decoder skip
+// non reference frames, then everything but keyframes, and step back once frames are on time again.
+void UncompressedVideoSampleProvider::UpdateSkipFrame(bool isLate)
+{
+	int64_t now = av_gettime_relative();
+	if (m_skipWindowStart == AV_NOPTS_VALUE)
+	{
+		m_skipWindowStart = now;
+	}
+
+	if (isLate)
+	{
+		m_skipWindowLateFrames++;
+	}
+
+	if (now - m_skipWindowStart < SKIPFRAMEWINDOW)
+	{
+		return;
+	}
+
+	std::lock_guard<std::mutex> lock(m_decoderMutex);
+	if (m_skipWindowLateFrames > 2)
+	{
+		m_skipWindowsOnTime = 0;
+		if (m_pAvCodecCtx->skip_frame < AVDISCARD_NONREF)
+		{
+			DebugMessage(L"Video decoder overloaded, skipping non reference frames\n");
+			m_pAvCodecCtx->skip_frame = AVDISCARD_NONREF;
+		}
+		else if (m_pAvCodecCtx->skip_frame < AVDISCARD_NONKEY)
+		{
+			DebugMessage(L"Video decoder overloaded, decoding keyframes only\n");
+			m_pAvCodecCtx->skip_frame = AVDISCARD_NONKEY;
+		}
+	}
+	else if (m_skipWindowLateFrames == 0 && m_pAvCodecCtx->skip_frame > AVDISCARD_DEFAULT)
+	{
+		// Require a few clean windows before relaxing so we don't oscillate at the edge of overload
+		if (++m_skipWindowsOnTime >= 3)
+		{
+			m_skipWindowsOnTime = 0;
+			m_pAvCodecCtx->skip_frame = m_pAvCodecCtx->skip_frame > AVDISCARD_NONREF ? AVDISCARD_NONREF : AVDISCARD_DEFAULT;
+		}
+	}
+
+	m_skipWindowStart = now;
+	m_skipWindowLateFrames = 0;
+}
+
+// Walk down the ladder one step at a time while the decoder can't keep up with the frame rate,
+// and back up once it has plenty of headroom again. The wider gap and longer wait on the way up
+// keep the quality from flapping around a single threshold.
+void UncompressedVideoSampleProvider::UpdateDecodeQuality()
+{
+	DecodeQuality quality = m_decodeQuality.load();
+
+	if (m_decodeLoad > OVERLOADEDDECODELOAD)
+	{
+		m_headroomFrames = 0;
+		if (++m_overloadedFrames >= OVERLOADEDFRAMES && quality != DecodeQuality::ReducedResolution)
+		{
+			quality = static_cast<DecodeQuality>(static_cast<int>(quality) + 1);
+		}
+	}
+	else if (m_decodeLoad < HEADROOMDECODELOAD)
+	{
+		m_overloadedFrames = 0;
+		if (++m_headroomFrames >= HEADROOMFRAMES && quality != DecodeQuality::Full)
+		{
+			quality = static_cast<DecodeQuality>(static_cast<int>(quality) - 1);
+		}
+	}
+	else
+	{
+		m_overloadedFrames = 0;
+		m_headroomFrames = 0;
+	}
+
+	if (quality != m_decodeQuality.load())
+	{
+		DebugMessage(L"Decode quality changed\n");
+		m_decodeQuality = quality;
+		m_decodeQualityChanged = true;
+		m_overloadedFrames = 0;
+		m_headroomFrames = 0;
+		ApplyDecodeQuality();
+	}
+}
+
+void UncompressedVideoSampleProvider::ApplyDecodeQuality()
+{
+	int step = static_cast<int>(m_decodeQuality.load());
+
+	std::lock_guard<std::mutex> lock(m_decoderMutex);
+	m_pAvCodecCtx->skip_loop_filter = step >= static_cast<int>(DecodeQuality::SkipLoopFilter) ? AVDISCARD_ALL : AVDISCARD_DEFAULT;
+	if (step >= static_cast<int>(DecodeQuality::Fast))
+	{
+		m_pAvCodecCtx->flags2 |= AV_CODEC_FLAG2_FAST;
+	}
+	else
+	{
+		m_pAvCodecCtx->flags2 &= ~AV_CODEC_FLAG2_FAST;
+	}
+	m_pAvCodecCtx->skip_idct = step >= static_cast<int>(DecodeQuality::SkipNonRefIdct) ? AVDISCARD_NONREF : AVDISCARD_DEFAULT;
+
+	// ReducedResolution is picked up by UpdateOutputFormat with the next frame
 }
 
 MediaStreamSample^ UncompressedVideoSampleProvider::GetNextSample()
@@ -123,6 +405,8 @@ MediaStreamSample^ UncompressedVideoSampleProvider::GetNextSample()
 
 	if (sample != nullptr)
 	{
+		UpdateDecodeQuality();
+
 		if (m_interlaced_frame)
 		{
 			sample->ExtendedProperties->Insert(MFSampleExtension_Interlaced, TRUE);
@@ -138,20 +422,30 @@ MediaStreamSample^ UncompressedVideoSampleProvider::GetNextSample()
 	return sample;
 }
 
-HRESULT UncompressedVideoSampleProvider::WriteAVPacketToStream(DataWriter^ dataWriter, AVPacket* avPacket)
+HRESULT UncompressedVideoSampleProvider::ProcessDecodedFrame(SampleWriter* dataWriter)
 {
-	// Convert decoded video pixel format to NV12 using FFmpeg software scaler
-	if (sws_scale(m_pSwsCtx, (const uint8_t **)(m_pAvFrame->data), m_pAvFrame->linesize, 0, m_pAvCodecCtx->height, m_rgVideoBufferData, m_rgVideoBufferLineSize) < 0)
+	m_interlaced_frame = m_pAvFrame->interlaced_frame == 1;
+	m_top_field_first = m_pAvFrame->top_field_first == 1;
+
+	HRESULT hr = UpdateOutputFormat(m_pAvFrame);
+
+	if (SUCCEEDED(hr))
 	{
-		return E_FAIL;
+		// Convert decoded video pixel format to NV12 using FFmpeg software scaler
+		if (sws_scale(m_pSwsCtx, (const uint8_t **)(m_pAvFrame->data), m_pAvFrame->linesize, 0, m_frameHeight, m_rgVideoBufferData, m_rgVideoBufferLineSize) < 0)
+		{
+			hr = E_FAIL;
+		}
+	}
+
+	if (SUCCEEDED(hr))
+	{
+		dataWriter->WriteBytes(m_rgVideoBufferData[0], m_rgVideoBufferLineSize[0] * m_outputHeight);
+		dataWriter->WriteBytes(m_rgVideoBufferData[1], m_rgVideoBufferLineSize[1] * m_outputHeight / 2);
 	}
 
-	auto YBuffer = ref new Platform::Array<uint8_t>(m_rgVideoBufferData[0], m_rgVideoBufferLineSize[0] * m_pAvCodecCtx->height);
-	auto UVBuffer = ref new Platform::Array<uint8_t>(m_rgVideoBufferData[1], m_rgVideoBufferLineSize[1] * m_pAvCodecCtx->height / 2);
-	dataWriter->WriteBytes(YBuffer);
-	dataWriter->WriteBytes(UVBuffer);
-	av_frame_unref(m_pAvFrame);
-	av_frame_free(&m_pAvFrame);
+	ReleaseFrame(m_pAvFrame);
+	m_pAvFrame = nullptr;
 
-	return S_OK;
+	return hr;
 }
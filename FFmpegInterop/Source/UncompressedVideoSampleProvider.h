@@ -17,7 +17,10 @@
 //*****************************************************************************
 
 #pragma once
+#include <list>
 #include "UncompressedSampleProvider.h"
+#include "DecodeQualityChangedEventArgs.h"
+#include "PresentationClock.h"
 
 extern "C"
 {
@@ -37,14 +40,72 @@ namespace FFmpegInterop
 			FFmpegReader^ reader,
 			AVFormatContext* avFormatCtx,
 			AVCodecContext* avCodecCtx);
-		virtual HRESULT WriteAVPacketToStream(DataWriter^ writer, AVPacket* avPacket) override;
-		virtual HRESULT DecodeAVPacket(DataWriter^ dataWriter, AVPacket* avPacket, int64_t& framePts, int64_t& frameDuration) override;
+		virtual HRESULT ProcessDecodedFrame(SampleWriter* dataWriter) override;
 		virtual HRESULT AllocateResources() override;
+		virtual bool IsFrameLate(int64_t framePts, int64_t frameDuration) override;
+		virtual void FlushDecoder() override;
+		// Anchors the presentation clock if it isn't running
+		virtual void RecordSampleHandoff(MediaStreamSample^ sample, const SampleTiming& timing) override;
+		virtual SampleFormat TakeSampleFormat() override;
+		virtual void ApplySampleFormat(const SampleFormat& format) override;
+		// Restart the presentation clock with the next sample handed out, e.g. when playback starts or resumes
+		void ResetClock();
+		// The renderer holds this much media before it presents, frames within it aren't late (TimeSpan units)
+		void SetBufferTime(TimeSpan bufferTime);
+		// Push the current decode quality to the codec context
+		void ApplyDecodeQuality();
+
+	internal:
+		// Stream descriptor whose encoding properties are updated when the decoded format changes mid-stream
+		VideoStreamDescriptor^ m_pStreamDescriptor;
+		// Decoded frames discarded because they were already late. Written by the decoding thread,
+		// read by the property getters.
+		std::atomic<unsigned long long> m_lateFramesDropped;
+		std::atomic<DecodeQuality> m_decodeQuality;
+		// Set when the ladder took a step, cleared by whoever reports it
+		std::atomic<bool> m_decodeQualityChanged;
 
 	private:
+		struct ScalerCacheEntry
+		{
+			int width;
+			int height;
+			AVPixelFormat pixelFormat;
+			int outputWidth;
+			int outputHeight;
+			SwsContext* swsCtx;
+		};
+
+		HRESULT UpdateOutputFormat(AVFrame* avFrame);
+		SwsContext* GetScaler(int width, int height, AVPixelFormat pixelFormat, int outputWidth, int outputHeight);
+		void UpdateDecodeQuality();
+		void UpdateSkipFrame(bool isLate);
+
+		// Most recently used scaler first
+		std::list<ScalerCacheEntry> m_scalerCache;
 		SwsContext* m_pSwsCtx;
 		int m_rgVideoBufferLineSize[4];
 		uint8_t* m_rgVideoBufferData[4];
+		int m_frameWidth;
+		int m_frameHeight;
+		AVPixelFormat m_framePixelFormat;
+		AVRational m_frameAspectRatio;
+		// NV12 output size, smaller than the decoded frame at DecodeQuality::ReducedResolution
+		int m_outputWidth;
+		int m_outputHeight;
+		bool m_formatChanged;
+
+		// Consecutive frames decoded above or well below real time
+		int m_overloadedFrames;
+		int m_headroomFrames;
+
+		// Presentation clock, anchored by the request thread at the first sample handed out after a (re)start
+		// and read by the decoding thread
+		PresentationClock m_clock;
+		// Late frames seen in the current evaluation window and the number of windows without any
+		int64_t m_skipWindowStart;
+		int m_skipWindowLateFrames;
+		int m_skipWindowsOnTime;
 		bool m_interlaced_frame;
 		bool m_top_field_first;
 	};
@@ -36,10 +36,25 @@ using namespace FFmpegInterop;
 using namespace Windows::Graphics::Imaging;
 using namespace Microsoft::Graphics::Canvas::UI::Xaml;
 
+// A capture recorded with FFmpegInteropConfig::CapturePath and copied to the app's local folder.
+// When present it is replayed in real time instead of connecting to the RTMP server, so the
+// benchmark runs without any external source.
+static const wchar_t* BenchmarkCaptureName = L"benchmark.fficap";
+static const wchar_t* BenchmarkLiveUri = L"rtmp://localhost:1935/live/test";
+// Latency sampling interval and how long after the first frame the report is written
+static const long long BenchmarkSampleInterval = 1000000; // 100ms in 100ns units
+static const long long BenchmarkDuration = 30000000; // 30s in microseconds
+// A file copied to the local folder under this name is played instead to measure the seek latency.
+// It is seeked to evenly spread positions, in accurate mode first and then in fast mode.
+static const wchar_t* BenchmarkSeekName = L"benchmark-seek.mp4";
+static const int BenchmarkSeekCount = 20;
 
 DirectXPage::DirectXPage():
 	m_windowVisible(true),
-	m_coreInput(nullptr)
+	m_coreInput(nullptr),
+	m_isSeekBenchmark(false),
+	m_seekCount(0),
+	m_isSeekDone(false)
 {
 	InitializeComponent();
 
@@ -47,13 +62,35 @@ DirectXPage::DirectXPage():
 
 		// Set FFmpeg specific options. List of options can be found in https://www.ffmpeg.org/ffmpeg-protocols.html
 		PropertySet^ options = ref new PropertySet();
+		String^ uri = ref new String(BenchmarkLiveUri);
 
-		// Below are some sample options that you can set to configure RTSP streaming
-		//options->Insert("rtsp_flags", "prefer_tcp");
-		options->Insert("rtmp_buffer", 100);
-		options->Insert("rtmp_live", "live");
+		String^ capturePath = Windows::Storage::ApplicationData::Current->LocalFolder->Path + L"\\" + ref new String(BenchmarkCaptureName);
+		String^ seekPath = Windows::Storage::ApplicationData::Current->LocalFolder->Path + L"\\" + ref new String(BenchmarkSeekName);
+		WIN32_FILE_ATTRIBUTE_DATA attributes;
+		if (GetFileAttributesExW(seekPath->Data(), GetFileExInfoStandard, &attributes))
+		{
+			m_isSeekBenchmark = true;
+			uri = seekPath;
+		}
+		else if (GetFileAttributesExW(capturePath->Data(), GetFileExInfoStandard, &attributes))
+		{
+			// Serve the recorded packets at the pace they originally arrived
+			options->Insert("replay_speed", "1");
+			uri = capturePath;
+		}
+		else
+		{
+			// Below are some sample options that you can set to configure RTSP streaming
+			//options->Insert("rtsp_flags", "prefer_tcp");
+			options->Insert("rtmp_buffer", 100);
+			options->Insert("rtmp_live", "live");
+		}
+
+		FFmpegInteropConfig^ config = ref new FFmpegInteropConfig();
+		config->Profile = m_isSeekBenchmark ? LatencyProfile::Playback : LatencyProfile::Live;
 
-		FFmpegMSS = FFmpegInteropMSS::CreateFFmpegInteropMSSFromUri("rtmp://localhost:1935/live/test", false, false, options);
+		m_benchmark.Start();
+		FFmpegMSS = FFmpegInteropMSS::CreateFFmpegInteropMSSFromUri(uri, false, false, options, config);
 
 		mediaPlayer = ref new MediaPlayer();
 
@@ -62,8 +99,7 @@ DirectXPage::DirectXPage():
 		mediaPlayer->VideoFrameAvailable += ref new TypedEventHandler<MediaPlayer^, Platform::Object^>(this, &DirectXPage::mediaPlayer_VideoFrameAvailable);
 		mediaPlayer->PlaybackSession->BufferingStarted += ref new TypedEventHandler<MediaPlaybackSession ^, Platform::Object^>(this, &DirectXPage::BufferingEnded);
 		mediaPlayer->PlaybackSession->BufferingEnded += ref new TypedEventHandler<MediaPlaybackSession ^, Platform::Object^>(this, &DirectXPage::BufferingEnded);
-
-		GotFirst = false;
+		mediaPlayer->PlaybackSession->SeekCompleted += ref new TypedEventHandler<MediaPlaybackSession ^, Platform::Object^>(this, &DirectXPage::SeekCompleted);
 
 		if (FFmpegMSS != nullptr)
 		{
@@ -260,14 +296,31 @@ void DirectXPage::OnSwapChainPanelSizeChanged(Object^ sender, SizeChangedEventAr
 
 void DirectXPage::mediaPlayer_VideoFrameAvailable(MediaPlayer^ sender, Object^ args)
 {
-	if (!GotFirst) {
+	if (m_isSeekBenchmark) {
+
+		// The first frame after a seek ends its measurement and starts the next seek
+		if (!m_benchmark.HasFirstSample() || (m_isSeekDone.exchange(false) && m_benchmark.SeekCompleted())) {
+			m_benchmark.FirstSample(sender->PlaybackSession->Position.Duration / 10);
+			ThreadPool::RunAsync(ref new WorkItemHandler([this](IAsyncAction^) {
+				StartNextSeek();
+			}));
+		}
+	}
+	else if (!m_benchmark.HasFirstSample()) {
+
+		m_benchmark.FirstSample(sender->PlaybackSession->Position.Duration / 10);
 
-		double mpSeconds = av_gettime() / 1000000.0;
-		wchar_t buffer[250];
-		swprintf_s(buffer, L"first media player frame available at: %f", mpSeconds);
-		OutputDebugStringW(buffer);
+		TimeSpan interval;
+		interval.Duration = BenchmarkSampleInterval;
+		m_benchmarkTimer = ThreadPoolTimer::CreatePeriodicTimer(ref new TimerElapsedHandler([this](ThreadPoolTimer^ timer) {
 
-		GotFirst = true;
+			m_benchmark.Sample(mediaPlayer->PlaybackSession->Position.Duration / 10);
+
+			if (m_benchmark.GetElapsedSinceFirstSample() >= BenchmarkDuration) {
+				timer->Cancel();
+				OutputDebugStringW(m_benchmark.GetReport().c_str());
+			}
+		}), interval);
 	}
 
 	
@@ -304,6 +357,30 @@ void DirectXPage::mediaPlayer_VideoFrameAvailable(MediaPlayer^ sender, Object^ a
 	
 }
 
+void DirectXPage::StartNextSeek()
+{
+	if (m_seekCount == 2 * BenchmarkSeekCount) {
+		OutputDebugStringW(m_benchmark.GetSeekReport().c_str());
+		return;
+	}
+
+	// Both modes seek to the same positions
+	SeekMode mode = m_seekCount < BenchmarkSeekCount ? SeekMode::Accurate : SeekMode::Fast;
+	int index = m_seekCount % BenchmarkSeekCount;
+	m_seekCount++;
+
+	TimeSpan position;
+	position.Duration = FFmpegMSS->Duration.Duration * (2 * index + 1) / (2 * BenchmarkSeekCount);
+	FFmpegMSS->SeekMode = mode;
+	m_benchmark.SeekStarted(mode);
+	mediaPlayer->PlaybackSession->Position = position;
+}
+
+void DirectXPage::SeekCompleted(MediaPlaybackSession^ sender, Object^ args)
+{
+	m_isSeekDone = true;
+}
+
 void DirectXPage::BufferingStarted(MediaPlaybackSession^ sender, Object^ args)
 {
 	double mpSeconds = av_gettime() / 1000000.0;
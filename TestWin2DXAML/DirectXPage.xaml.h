@@ -7,8 +7,11 @@
 
 #include "DirectXPage.g.h"
 
+#include <atomic>
+
 #include "Common\DeviceResources.h"
 #include "TestWin2DXAMLMain.h"
+#include "LatencyBenchmark.h"
 
 namespace TestWin2DXAML
 {
@@ -60,8 +63,15 @@ namespace TestWin2DXAML
 		void mediaPlayer_VideoFrameAvailable(Windows::Media::Playback::MediaPlayer^ sender, Platform::Object^ args);
 		void DirectXPage::BufferingStarted(Windows::Media::Playback::MediaPlaybackSession^ sender, Platform::Object^ args);
 		void DirectXPage::BufferingEnded(Windows::Media::Playback::MediaPlaybackSession^ sender, Platform::Object^ args);
-
-		bool GotFirst;
+		void SeekCompleted(Windows::Media::Playback::MediaPlaybackSession^ sender, Platform::Object^ args);
+		void StartNextSeek();
+
+		LatencyBenchmark m_benchmark;
+		Windows::System::Threading::ThreadPoolTimer^ m_benchmarkTimer;
+		// Seek benchmark: seeks started so far and whether the player finished the current one
+		bool m_isSeekBenchmark;
+		int m_seekCount;
+		std::atomic<bool> m_isSeekDone;
 
 		Windows::Graphics::Imaging::SoftwareBitmap^ frameServerDest;
 		Microsoft::Graphics::Canvas::UI::Xaml::CanvasImageSource^ canvasImageSource;
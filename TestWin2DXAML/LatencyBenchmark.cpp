@@ -0,0 +1,135 @@
+﻿//
+// LatencyBenchmark.cpp
+// Implementation of the LatencyBenchmark class.
+//
+
+#include "pch.h"
+#include "LatencyBenchmark.h"
+#include <algorithm>
+
+extern "C"
+{
+#include <libavutil/time.h>
+}
+
+using namespace TestWin2DXAML;
+
+LatencyBenchmark::LatencyBenchmark() :
+	m_connectTime(0),
+	m_firstSampleTime(-1),
+	m_firstSamplePosition(0),
+	m_seekStartTime(-1),
+	m_seekMode(FFmpegInterop::SeekMode::Accurate)
+{
+}
+
+void LatencyBenchmark::Start()
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	m_connectTime = av_gettime_relative();
+	m_firstSampleTime = -1;
+	m_latencies.clear();
+}
+
+void LatencyBenchmark::FirstSample(long long position)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	if (m_firstSampleTime < 0)
+	{
+		m_firstSampleTime = av_gettime_relative();
+		m_firstSamplePosition = position;
+	}
+}
+
+// The first frame was the newest one when the source was opened, so its latency is the startup time.
+// Every later frame adds the wall clock time playback fell behind the media time since then.
+void LatencyBenchmark::Sample(long long position)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	if (m_firstSampleTime < 0)
+	{
+		return;
+	}
+
+	long long now = av_gettime_relative();
+	long long latency = (m_firstSampleTime - m_connectTime) + (now - m_firstSampleTime) - (position - m_firstSamplePosition);
+	m_latencies.push_back(latency);
+}
+
+bool LatencyBenchmark::HasFirstSample()
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	return m_firstSampleTime >= 0;
+}
+
+long long LatencyBenchmark::GetElapsedSinceFirstSample()
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	return m_firstSampleTime >= 0 ? av_gettime_relative() - m_firstSampleTime : 0;
+}
+
+std::wstring LatencyBenchmark::GetReport()
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+
+	wchar_t buffer[250];
+	if (m_firstSampleTime < 0)
+	{
+		swprintf_s(buffer, L"benchmark: no sample received\n");
+		return buffer;
+	}
+
+	std::vector<long long> sorted(m_latencies);
+	std::sort(sorted.begin(), sorted.end());
+	auto percentile = [&sorted](double p) -> double
+	{
+		return sorted.empty() ? 0.0 : sorted[(size_t)(p * (sorted.size() - 1))] / 1000.0;
+	};
+
+	swprintf_s(buffer, L"benchmark: connect to first sample %.1f ms, latency p50 %.1f ms, p95 %.1f ms, p99 %.1f ms, max %.1f ms (%u samples)\n",
+		(m_firstSampleTime - m_connectTime) / 1000.0, percentile(0.5), percentile(0.95), percentile(0.99), percentile(1.0), (unsigned int)sorted.size());
+	return buffer;
+}
+
+void LatencyBenchmark::SeekStarted(FFmpegInterop::SeekMode mode)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	m_seekStartTime = av_gettime_relative();
+	m_seekMode = mode;
+}
+
+bool LatencyBenchmark::SeekCompleted()
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	if (m_seekStartTime < 0)
+	{
+		return false;
+	}
+
+	m_seekLatencies[static_cast<int>(m_seekMode)].push_back(av_gettime_relative() - m_seekStartTime);
+	m_seekStartTime = -1;
+	return true;
+}
+
+std::wstring LatencyBenchmark::GetSeekReport()
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+
+	std::wstring report = L"benchmark: seek to first frame";
+	const wchar_t* modeNames[] = { L"accurate", L"fast" };
+	for (int mode = 0; mode < 2; mode++)
+	{
+		std::vector<long long> sorted(m_seekLatencies[mode]);
+		std::sort(sorted.begin(), sorted.end());
+		auto percentile = [&sorted](double p) -> double
+		{
+			return sorted.empty() ? 0.0 : sorted[(size_t)(p * (sorted.size() - 1))] / 1000.0;
+		};
+
+		wchar_t buffer[250];
+		swprintf_s(buffer, L", %s p50 %.1f ms, p95 %.1f ms, max %.1f ms (%u seeks)",
+			modeNames[mode], percentile(0.5), percentile(0.95), percentile(1.0), (unsigned int)sorted.size());
+		report += buffer;
+	}
+	return report + L"\n";
+}
@@ -0,0 +1,50 @@
+﻿//
+// LatencyBenchmark.h
+// Measures startup time and end-to-end latency of a live source, and seek latency of a file.
+//
+
+#pragma once
+
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace TestWin2DXAML
+{
+	// Collects connect-to-first-sample time and latency samples of one playback session.
+	// All times are in microseconds on the av_gettime_relative clock.
+	class LatencyBenchmark
+	{
+	public:
+		LatencyBenchmark();
+
+		// Call right before the source is opened
+		void Start();
+		// Call when the first video frame is presented, position is the playback position at that time
+		void FirstSample(long long position);
+		// Latency of the frame at the current playback position, assuming the source runs in real time
+		void Sample(long long position);
+
+		bool HasFirstSample();
+		long long GetElapsedSinceFirstSample();
+		std::wstring GetReport();
+
+		// Call right before the playback position is set, and when the first frame after the seek is presented
+		void SeekStarted(FFmpegInterop::SeekMode mode);
+		// Returns false if no seek was in progress
+		bool SeekCompleted();
+		std::wstring GetSeekReport();
+
+	private:
+		std::mutex m_mutex;
+		long long m_connectTime;
+		long long m_firstSampleTime;
+		long long m_firstSamplePosition;
+		std::vector<long long> m_latencies;
+
+		// Seek to first frame times, indexed by SeekMode
+		long long m_seekStartTime;
+		FFmpegInterop::SeekMode m_seekMode;
+		std::vector<long long> m_seekLatencies[2];
+	};
+}
@@ -0,0 +1,193 @@
+//*****************************************************************************
+//
+//	Copyright 2017 Microsoft Corporation
+//
+//	Licensed under the Apache License, Version 2.0 (the "License");
+//	you may not use this file except in compliance with the License.
+//	You may obtain a copy of the License at
+//
+//	http ://www.apache.org/licenses/LICENSE-2.0
+//
+//	Unless required by applicable law or agreed to in writing, software
+//	distributed under the License is distributed on an "AS IS" BASIS,
+//	WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//	See the License for the specific language governing permissions and
+//	limitations under the License.
+//
+//*****************************************************************************
+
+
+
+// Counts heap allocations of the portable queues and pools the sample path cycles through and
+// checks that they stop once warmed up:
+//   cl /EHsc /I. /I..\..\FFmpegInterop\Source AllocationTest.cpp ..\..\FFmpegInterop\Source\SampleBufferPool.cpp
+//   g++ -std=c++14 -pthread -I. -I../../FFmpegInterop/Source AllocationTest.cpp ../../FFmpegInterop/Source/SampleBufferPool.cpp
+// The WinRT objects created per sample (MediaStreamSample and the PooledBuffer wrapping the pooled
+// memory) and FFmpeg's own allocations are outside of what this measures.
+
+#include "pch.h"
+#include "RingBuffer.h"
+#include "SampleBufferPool.h"
+#include "SpscQueue.h"
+#include <atomic>
+#include <new>
+#include <stdio.h>
+#include <stdlib.h>
+
+using namespace FFmpegInterop;
+
+static std::atomic<int> allocations(0);
+
+void* operator new(size_t size)
+{
+	allocations++;
+	void* p = malloc(size > 0 ? size : 1);
+	if (p == nullptr)
+	{
+		throw std::bad_alloc();
+	}
+	return p;
+}
+
+void operator delete(void* p) noexcept
+{
+	free(p);
+}
+
+void operator delete(void* p, size_t) noexcept
+{
+	free(p);
+}
+
+static int failures = 0;
+
+#define CHECK(condition) \
+	if (!(condition)) \
+	{ \
+		printf("%s(%d): %s failed\n", __FILE__, __LINE__, #condition); \
+		failures++; \
+	}
+
+const int WARMUPSAMPLES = 100;
+const int SAMPLES = 10000;
+
+// Samples of varying size with a few of them in flight in the pipeline, like SampleWriter and PooledBuffer use the pool
+static void SampleMemoryIsRecycled()
+{
+	const int inFlightCount = 3;
+	uint8_t data[4096] = { 0 };
+	SampleBufferPool pool;
+	std::vector<uint8_t> inFlight[inFlightCount];
+
+	int counted = 0;
+	for (int i = 0; i < WARMUPSAMPLES + SAMPLES; i++)
+	{
+		if (i == WARMUPSAMPLES)
+		{
+			counted = allocations;
+		}
+
+		std::vector<uint8_t> sample = pool.Acquire();
+		// Written in a few pieces, like the packets of a passthrough sample
+		size_t size = 1024 + (i * 7919) % 3072;
+		for (size_t written = 0; written < size; written += 512)
+		{
+			sample.insert(sample.end(), data, data + min((size_t)512, size - written));
+		}
+
+		// The renderer releases the oldest sample
+		pool.Release(std::move(inFlight[i % inFlightCount]));
+		inFlight[i % inFlightCount] = std::move(sample);
+	}
+	CHECK(allocations - counted == 0);
+}
+
+struct DecodedFrame
+{
+	void* frame;
+	int64_t decodedTime;
+};
+
+// The decoded frame queue fills up in bursts, e.g. when a decoder with frame threading drains
+static void DecodedFrameQueueKeepsItsMemory()
+{
+	RingBuffer<DecodedFrame> frames;
+	int counted = 0;
+	for (int i = 0; i < WARMUPSAMPLES + SAMPLES; i++)
+	{
+		if (i == WARMUPSAMPLES)
+		{
+			counted = allocations;
+		}
+
+		int burst = i % 10 == 0 ? 8 : 1;
+		for (int j = 0; j < burst; j++)
+		{
+			frames.PushBack({ nullptr, i });
+		}
+		while (!frames.IsEmpty())
+		{
+			frames.PopFront();
+		}
+	}
+	CHECK(allocations - counted == 0);
+	CHECK(frames.GetSize() == 0);
+}
+
+// The FIFO order survives the ring growing while it wraps around
+static void RingBufferKeepsOrderWhenGrowing()
+{
+	RingBuffer<int> ring;
+	int next = 0;
+	int expected = 0;
+	for (int i = 0; i < 3; i++)
+	{
+		ring.PushBack(next++);
+	}
+	ring.PopFront();
+	expected++;
+	for (int i = 0; i < 20; i++)
+	{
+		ring.PushBack(next++);
+	}
+	CHECK(ring.GetSize() == 22);
+	while (!ring.IsEmpty())
+	{
+		CHECK(ring.Front() == expected);
+		ring.PopFront();
+		expected++;
+	}
+	CHECK(expected == next);
+
+	ring.PushBack(1);
+	ring.Clear();
+	CHECK(ring.IsEmpty());
+}
+
+// The handoff between the decode thread and the conversion never allocates
+static void ReadyFrameQueueDoesNotAllocate()
+{
+	SpscQueue<DecodedFrame> readyFrames(2);
+	int counted = allocations;
+	DecodedFrame frame;
+	for (int i = 0; i < SAMPLES; i++)
+	{
+		readyFrames.TryPush({ nullptr, i });
+		readyFrames.TryPush({ nullptr, i });
+		while (readyFrames.TryPop(frame))
+		{
+		}
+	}
+	CHECK(allocations - counted == 0);
+}
+
+int main()
+{
+	SampleMemoryIsRecycled();
+	DecodedFrameQueueKeepsItsMemory();
+	RingBufferKeepsOrderWhenGrowing();
+	ReadyFrameQueueDoesNotAllocate();
+
+	printf(failures == 0 ? "passed\n" : "%d checks failed\n", failures);
+	return failures == 0 ? 0 : 1;
+}
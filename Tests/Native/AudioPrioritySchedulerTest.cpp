@@ -0,0 +1,92 @@
+//*****************************************************************************
+//
+//	Copyright 2017 Microsoft Corporation
+//
+//	Licensed under the Apache License, Version 2.0 (the "License");
+//	you may not use this file except in compliance with the License.
+//	You may obtain a copy of the License at
+//
+//	http ://www.apache.org/licenses/LICENSE-2.0
+//
+//	Unless required by applicable law or agreed to in writing, software
+//	distributed under the License is distributed on an "AS IS" BASIS,
+//	WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//	See the License for the specific language governing permissions and
+//	limitations under the License.
+//
+//*****************************************************************************
+
+
+// Tests of the portable AudioPriorityScheduler, built together with its source:
+//   cl /EHsc /I. /I..\..\FFmpegInterop\Source AudioPrioritySchedulerTest.cpp ..\..\FFmpegInterop\Source\AudioPriorityScheduler.cpp
+//   g++ -std=c++14 -pthread -I. -I../../FFmpegInterop/Source AudioPrioritySchedulerTest.cpp ../../FFmpegInterop/Source/AudioPriorityScheduler.cpp
+
+#include "pch.h"
+#include "AudioPriorityScheduler.h"
+#include <stdio.h>
+
+using namespace FFmpegInterop;
+
+static int failures = 0;
+
+#define CHECK(condition) \
+	if (!(condition)) \
+	{ \
+		printf("%s(%d): %s failed\n", __FILE__, __LINE__, #condition); \
+		failures++; \
+	}
+
+// Decoding falls behind with packets waiting: audio is starving until it is back at three quarters
+static void StarvesWhileInputIsBuffered()
+{
+	AudioPriorityScheduler scheduler;
+	scheduler.SetAudioBuffer(90, 200, true);
+	CHECK(scheduler.IsAudioStarving());
+	CHECK(scheduler.YieldToAudio(1000));
+	CHECK(scheduler.GetVideoYieldCount() == 1);
+
+	scheduler.SetAudioBuffer(120, 200, true);
+	CHECK(scheduler.IsAudioStarving());
+	scheduler.SetAudioBuffer(150, 200, true);
+	CHECK(!scheduler.IsAudioStarving());
+	CHECK(!scheduler.YieldToAudio(1000));
+}
+
+// At the live edge the queue stays low because packets arrive in real time, that is not CPU contention
+static void DoesNotStarveWhileWaitingOnTheSource()
+{
+	AudioPriorityScheduler scheduler;
+	for (int i = 0; i < 100; i++)
+	{
+		scheduler.SetAudioBuffer(0, 200, false);
+		scheduler.SetAudioBuffer(20, 200, false);
+	}
+	CHECK(!scheduler.IsAudioStarving());
+	CHECK(!scheduler.YieldToAudio(1000));
+	CHECK(scheduler.GetVideoYieldCount() == 0);
+
+	// Waiting on the source leaves a starving state as it is
+	scheduler.SetAudioBuffer(20, 200, true);
+	CHECK(scheduler.IsAudioStarving());
+	scheduler.SetAudioBuffer(20, 200, false);
+	CHECK(scheduler.IsAudioStarving());
+}
+
+static void IdleAudioReleasesVideo()
+{
+	AudioPriorityScheduler scheduler;
+	scheduler.SetAudioBuffer(0, 200, true);
+	CHECK(scheduler.IsAudioStarving());
+	scheduler.SetAudioIdle();
+	CHECK(!scheduler.IsAudioStarving());
+}
+
+int main()
+{
+	StarvesWhileInputIsBuffered();
+	DoesNotStarveWhileWaitingOnTheSource();
+	IdleAudioReleasesVideo();
+
+	printf(failures == 0 ? "passed\n" : "%d checks failed\n", failures);
+	return failures == 0 ? 0 : 1;
+}
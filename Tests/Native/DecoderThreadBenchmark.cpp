@@ -0,0 +1,170 @@
+//*****************************************************************************
+//
+//	Copyright 2017 Microsoft Corporation
+//
+//	Licensed under the Apache License, Version 2.0 (the "License");
+//	you may not use this file except in compliance with the License.
+//	You may obtain a copy of the License at
+//
+//	http ://www.apache.org/licenses/LICENSE-2.0
+//
+//	Unless required by applicable law or agreed to in writing, software
+//	distributed under the License is distributed on an "AS IS" BASIS,
+//	WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//	See the License for the specific language governing permissions and
+//	limitations under the License.
+//
+//*****************************************************************************
+
+
+
+// Throughput of N concurrent video decodes, each with a share of the DecoderThreadBudget compared to
+// one thread per core each. Needs the FFmpeg development packages:
+//   g++ -std=c++14 -O2 -pthread -I. -I../../FFmpegInterop/Source DecoderThreadBenchmark.cpp ../../FFmpegInterop/Source/DecoderThreadBudget.cpp $(pkg-config --cflags --libs libavformat libavcodec libavutil) -o DecoderThreadBenchmark
+//   ./DecoderThreadBenchmark video.mp4 16
+// Every decode runs through the first 300 frames of the file with frame threading, like file playback.
+
+#include "pch.h"
+#include "DecoderThreadBudget.h"
+#include <chrono>
+#include <stdio.h>
+#include <stdlib.h>
+#include <thread>
+#include <vector>
+
+extern "C"
+{
+#include <libavcodec/avcodec.h>
+#include <libavformat/avformat.h>
+}
+
+using namespace FFmpegInterop;
+
+const int FRAMELIMIT = 300;
+const int NORMALPRIORITY = 1;
+
+struct Decode
+{
+	AVFormatContext* formatCtx;
+	AVCodecContext* codecCtx;
+	int streamIndex;
+	int frameCount;
+};
+
+static bool OpenDecode(const char* path, Decode& decode)
+{
+	decode.formatCtx = nullptr;
+	decode.codecCtx = nullptr;
+	decode.frameCount = 0;
+	if (avformat_open_input(&decode.formatCtx, path, NULL, NULL) < 0 || avformat_find_stream_info(decode.formatCtx, NULL) < 0)
+	{
+		return false;
+	}
+
+	AVCodec* codec = nullptr;
+	decode.streamIndex = av_find_best_stream(decode.formatCtx, AVMEDIA_TYPE_VIDEO, -1, -1, &codec, 0);
+	if (decode.streamIndex < 0)
+	{
+		return false;
+	}
+
+	decode.codecCtx = avcodec_alloc_context3(codec);
+	return decode.codecCtx != nullptr && avcodec_parameters_to_context(decode.codecCtx, decode.formatCtx->streams[decode.streamIndex]->codecpar) >= 0;
+}
+
+static void CloseDecode(Decode& decode)
+{
+	avcodec_free_context(&decode.codecCtx);
+	avformat_close_input(&decode.formatCtx);
+}
+
+static void RunDecode(Decode* decode)
+{
+	AVPacket packet;
+	AVFrame* frame = av_frame_alloc();
+	while (decode->frameCount < FRAMELIMIT && av_read_frame(decode->formatCtx, &packet) >= 0)
+	{
+		if (packet.stream_index == decode->streamIndex && avcodec_send_packet(decode->codecCtx, &packet) >= 0)
+		{
+			while (avcodec_receive_frame(decode->codecCtx, frame) >= 0)
+			{
+				decode->frameCount++;
+			}
+		}
+		av_packet_unref(&packet);
+	}
+	av_frame_free(&frame);
+}
+
+// Decoded frames per second of all decodes together
+static double MeasureThroughput(const char* path, int decoderCount, bool useBudget)
+{
+	DecoderThreadBudget budget(std::thread::hardware_concurrency());
+	std::vector<Decode> decodes(decoderCount);
+	std::vector<int> ids;
+
+	// Register everybody first so the shares are final before decoding starts
+	for (auto& decode : decodes)
+	{
+		if (!OpenDecode(path, decode))
+		{
+			fprintf(stderr, "Could not open %s\n", path);
+			exit(1);
+		}
+		ids.push_back(budget.Register(decode.codecCtx->width, decode.codecCtx->height, 1.0, NORMALPRIORITY));
+	}
+
+	for (int i = 0; i < decoderCount; i++)
+	{
+		decodes[i].codecCtx->thread_count = useBudget ? budget.GetThreadCount(ids[i]) : (int)std::thread::hardware_concurrency();
+		decodes[i].codecCtx->thread_type = FF_THREAD_FRAME | FF_THREAD_SLICE;
+		if (avcodec_open2(decodes[i].codecCtx, decodes[i].codecCtx->codec, NULL) < 0)
+		{
+			fprintf(stderr, "Could not open the decoder\n");
+			exit(1);
+		}
+	}
+
+	auto start = std::chrono::steady_clock::now();
+	std::vector<std::thread> threads;
+	for (auto& decode : decodes)
+	{
+		threads.push_back(std::thread(RunDecode, &decode));
+	}
+	int frameCount = 0;
+	for (int i = 0; i < decoderCount; i++)
+	{
+		threads[i].join();
+		frameCount += decodes[i].frameCount;
+		CloseDecode(decodes[i]);
+	}
+	std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+	return frameCount / elapsed.count();
+}
+
+int main(int argc, char* argv[])
+{
+	if (argc < 2)
+	{
+		printf("usage: %s file [max decoders]\n", argv[0]);
+		return 1;
+	}
+	int maxDecoders = argc > 2 ? atoi(argv[2]) : 16;
+
+#if LIBAVFORMAT_VERSION_MAJOR < 58
+	av_register_all();
+#endif
+	av_log_set_level(AV_LOG_ERROR);
+
+	printf("%u hardware threads\n", std::thread::hardware_concurrency());
+	printf("decoders  per core fps  budget fps  gain\n");
+	for (int decoderCount = 1; decoderCount <= maxDecoders; decoderCount = decoderCount < maxDecoders && decoderCount * 2 > maxDecoders ? maxDecoders : decoderCount * 2)
+	{
+		double perCore = MeasureThroughput(argv[1], decoderCount, false);
+		double budgeted = MeasureThroughput(argv[1], decoderCount, true);
+		printf("%8d  %12.1f  %10.1f  %4.2f\n", decoderCount, perCore, budgeted, budgeted / perCore);
+	}
+
+	return 0;
+}
@@ -0,0 +1,167 @@
+//*****************************************************************************
+//
+//	Copyright 2017 Microsoft Corporation
+//
+//	Licensed under the Apache License, Version 2.0 (the "License");
+//	you may not use this file except in compliance with the License.
+//	You may obtain a copy of the License at
+//
+//	http ://www.apache.org/licenses/LICENSE-2.0
+//
+//	Unless required by applicable law or agreed to in writing, software
+//	distributed under the License is distributed on an "AS IS" BASIS,
+//	WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//	See the License for the specific language governing permissions and
+//	limitations under the License.
+//
+//*****************************************************************************
+
+
+
+// Tests of the portable DecoderThreadBudget, built together with its source:
+//   cl /EHsc /I. /I..\..\FFmpegInterop\Source DecoderThreadBudgetTest.cpp ..\..\FFmpegInterop\Source\DecoderThreadBudget.cpp
+//   g++ -std=c++14 -pthread -I. -I../../FFmpegInterop/Source DecoderThreadBudgetTest.cpp ../../FFmpegInterop/Source/DecoderThreadBudget.cpp
+
+#include "pch.h"
+#include "DecoderThreadBudget.h"
+#include <stdio.h>
+
+using namespace FFmpegInterop;
+
+static int failures = 0;
+
+#define CHECK(condition) \
+	if (!(condition)) \
+	{ \
+		printf("%s(%d): %s failed\n", __FILE__, __LINE__, #condition); \
+		failures++; \
+	}
+
+// Priorities as in FFmpegInterop::DecoderPriority
+const int LOW = 0;
+const int NORMAL = 1;
+const int HIGH = 2;
+
+// A single decoder gets the whole budget
+static void SingleDecoderGetsEverything()
+{
+	DecoderThreadBudget budget(8);
+	int id = budget.Register(1920, 1080, 1.0, NORMAL);
+	CHECK(budget.GetThreadCount(id) == 8);
+
+	budget.Unregister(id);
+	CHECK(budget.GetThreadCount(id) == 1);
+}
+
+// Equal tiles split the budget evenly. With fewer threads than tiles each one still keeps a thread.
+static void EqualDecodersShareEvenly()
+{
+	DecoderThreadBudget budget(32);
+	int ids[16];
+	for (int i = 0; i < 16; i++)
+	{
+		ids[i] = budget.Register(1280, 720, 1.0, NORMAL);
+	}
+	int total = 0;
+	for (int i = 0; i < 16; i++)
+	{
+		CHECK(budget.GetThreadCount(ids[i]) == 2);
+		total += budget.GetThreadCount(ids[i]);
+	}
+	CHECK(total == 32);
+
+	budget.SetTotalThreads(8);
+	for (int i = 0; i < 16; i++)
+	{
+		CHECK(budget.GetThreadCount(ids[i]) == 1);
+	}
+}
+
+// The focused tile gets most of what is left after everybody has one thread
+static void PriorityWeightsTheShare()
+{
+	DecoderThreadBudget budget(16);
+	int focused = budget.Register(1920, 1080, 1.0, HIGH);
+	int tiles[4];
+	for (int i = 0; i < 4; i++)
+	{
+		tiles[i] = budget.Register(1920, 1080, 1.0, LOW);
+	}
+	// 11 spare threads, weights 4 : 0.5 x 4
+	CHECK(budget.GetThreadCount(focused) == 1 + 7);
+	int total = budget.GetThreadCount(focused);
+	for (int i = 0; i < 4; i++)
+	{
+		total += budget.GetThreadCount(tiles[i]);
+		CHECK(budget.GetThreadCount(tiles[i]) >= 1 + 1);
+	}
+	CHECK(total == 16);
+
+	// Moving the focus moves the threads
+	budget.SetPriority(focused, LOW);
+	budget.SetPriority(tiles[0], HIGH);
+	CHECK(budget.GetThreadCount(tiles[0]) == 8);
+	CHECK(budget.GetThreadCount(focused) <= 3);
+}
+
+// Resolution and codec complexity weight the share like priority does
+static void CostWeightsTheShare()
+{
+	DecoderThreadBudget budget(12);
+	int uhd = budget.Register(3840, 2160, 1.5, NORMAL);
+	int sd = budget.Register(720, 576, 0.6, NORMAL);
+	CHECK(budget.GetThreadCount(uhd) == 11);
+	CHECK(budget.GetThreadCount(sd) == 1);
+}
+
+// A thread is held back for audio while any instance decodes it, but never the last one
+static void AudioReservesOneThread()
+{
+	DecoderThreadBudget budget(8);
+	int id = budget.Register(1920, 1080, 1.0, NORMAL);
+	budget.ReserveAudioThread();
+	budget.ReserveAudioThread();
+	CHECK(budget.GetThreadCount(id) == 7);
+	budget.ReleaseAudioThread();
+	CHECK(budget.GetThreadCount(id) == 7);
+	budget.ReleaseAudioThread();
+	CHECK(budget.GetThreadCount(id) == 8);
+
+	budget.SetTotalThreads(1);
+	budget.ReserveAudioThread();
+	CHECK(budget.GetThreadCount(id) == 1);
+}
+
+// Running decoders notice a rebalance through the generation
+static void RebalanceChangesGeneration()
+{
+	DecoderThreadBudget budget(4);
+	unsigned int generation = budget.GetGeneration();
+	int id = budget.Register(1920, 1080, 1.0, NORMAL);
+	CHECK(budget.GetGeneration() != generation);
+
+	generation = budget.GetGeneration();
+	budget.SetPriority(id, HIGH);
+	CHECK(budget.GetGeneration() != generation);
+
+	generation = budget.GetGeneration();
+	budget.Unregister(id);
+	CHECK(budget.GetGeneration() != generation);
+
+	// A budget of zero threads still has one
+	budget.SetTotalThreads(0);
+	CHECK(budget.GetTotalThreads() == 1);
+}
+
+int main()
+{
+	SingleDecoderGetsEverything();
+	EqualDecodersShareEvenly();
+	PriorityWeightsTheShare();
+	CostWeightsTheShare();
+	AudioReservesOneThread();
+	RebalanceChangesGeneration();
+
+	printf(failures == 0 ? "passed\n" : "%d checks failed\n", failures);
+	return failures == 0 ? 0 : 1;
+}
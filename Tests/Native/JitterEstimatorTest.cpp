@@ -0,0 +1,144 @@
+//*****************************************************************************
+//
+//	Copyright 2017 Microsoft Corporation
+//
+//	Licensed under the Apache License, Version 2.0 (the "License");
+//	you may not use this file except in compliance with the License.
+//	You may obtain a copy of the License at
+//
+//	http ://www.apache.org/licenses/LICENSE-2.0
+//
+//	Unless required by applicable law or agreed to in writing, software
+//	distributed under the License is distributed on an "AS IS" BASIS,
+//	WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//	See the License for the specific language governing permissions and
+//	limitations under the License.
+//
+//*****************************************************************************
+
+
+
+// Tests of the portable JitterEstimator, built together with its source:
+//   cl /EHsc /I. /I..\..\FFmpegInterop\Source JitterEstimatorTest.cpp ..\..\FFmpegInterop\Source\JitterEstimator.cpp
+//   g++ -std=c++14 -I. -I../../FFmpegInterop/Source JitterEstimatorTest.cpp ../../FFmpegInterop/Source/JitterEstimator.cpp
+
+#include "pch.h"
+#include "JitterEstimator.h"
+#include <stdio.h>
+
+using namespace FFmpegInterop;
+
+static int failures = 0;
+
+#define CHECK(condition) \
+	if (!(condition)) \
+	{ \
+		printf("%s(%d): %s failed\n", __FILE__, __LINE__, #condition); \
+		failures++; \
+	}
+
+// 25 fps, in microseconds
+const int64_t FRAMEDURATION = 40000;
+
+// Packets arriving exactly in step with their timestamps need no buffer beyond the minimum
+static void SteadyArrivalHasNoJitter()
+{
+	JitterEstimator estimator;
+	estimator.SetBounds(100000, 2000000);
+	for (int i = 0; i < 500; i++)
+	{
+		// The constant offset is the unknown network delay, it doesn't count as jitter
+		estimator.AddPacket(1000000 + i * FRAMEDURATION, i * FRAMEDURATION);
+	}
+	CHECK(estimator.GetPacketCount() == 500);
+	CHECK(estimator.GetJitter() == 0);
+	CHECK(estimator.GetPeakDelay() == 0);
+	CHECK(estimator.GetTargetDelay() == 100000);
+}
+
+// Every other packet 10 ms late: the RFC 3550 estimate converges to the 10 ms difference
+static void JitterFollowsArrivalVariation()
+{
+	JitterEstimator estimator;
+	for (int i = 0; i < 500; i++)
+	{
+		estimator.AddPacket(i * FRAMEDURATION + (i % 2) * 10000, i * FRAMEDURATION);
+	}
+	CHECK(estimator.GetJitter() > 9000 && estimator.GetJitter() <= 10000);
+	CHECK(estimator.GetPeakDelay() == 10000);
+	CHECK(estimator.GetTargetDelay() >= estimator.GetJitter() * 4);
+}
+
+// A single stall sets the buffer to the delay it caused, which is forgotten again within about a minute
+static void StallRaisesPeakDelayUntilItDecays()
+{
+	JitterEstimator estimator;
+	int i = 0;
+	for (; i < 100; i++)
+	{
+		estimator.AddPacket(i * FRAMEDURATION, i * FRAMEDURATION);
+	}
+	estimator.AddPacket(i * FRAMEDURATION + 500000, i * FRAMEDURATION);
+	i++;
+	CHECK(estimator.GetPeakDelay() == 500000);
+	CHECK(estimator.GetTargetDelay() >= 500000);
+
+	// 80 s of steady packets
+	for (int end = i + 2000; i < end; i++)
+	{
+		estimator.AddPacket(i * FRAMEDURATION, i * FRAMEDURATION);
+	}
+	CHECK(estimator.GetPeakDelay() == 0);
+	CHECK(estimator.GetTargetDelay() == 0);
+}
+
+// IBBP video arriving steadily in decode order. The dts follows the arrival, the pts of the reordered
+// frames jumps around it and would be taken for jitter.
+static void ReorderedPtsAreNotJitter()
+{
+	// Decode order I0 P3 B1 B2 P6 B4 B5 ..., the presentation index is the decode index plus this
+	static const int reorder[] = { -1, 2, -1 };
+
+	JitterEstimator byDts;
+	JitterEstimator byPts;
+	for (int i = 0; i < 500; i++)
+	{
+		int64_t arrivalTime = 1000000 + i * FRAMEDURATION;
+		int64_t dts = i * FRAMEDURATION;
+		int64_t pts = (i == 0 ? 0 : i + reorder[i % 3]) * FRAMEDURATION;
+		byDts.AddPacket(arrivalTime, dts);
+		byPts.AddPacket(arrivalTime, pts);
+	}
+	CHECK(byDts.GetJitter() == 0);
+	CHECK(byDts.GetPeakDelay() == 0);
+	CHECK(byPts.GetJitter() > FRAMEDURATION / 2);
+}
+
+static void TargetStaysWithinBounds()
+{
+	JitterEstimator estimator;
+	estimator.SetBounds(50000, 200000);
+	estimator.AddPacket(0, 0);
+	estimator.AddPacket(1000000, FRAMEDURATION);
+	CHECK(estimator.GetTargetDelay() == 200000);
+
+	// A maximum below the minimum is raised to it
+	estimator.SetBounds(300000, 100000);
+	CHECK(estimator.GetTargetDelay() == 300000);
+
+	estimator.Reset();
+	CHECK(estimator.GetPacketCount() == 0);
+	CHECK(estimator.GetTargetDelay() == 300000);
+}
+
+int main()
+{
+	SteadyArrivalHasNoJitter();
+	JitterFollowsArrivalVariation();
+	StallRaisesPeakDelayUntilItDecays();
+	ReorderedPtsAreNotJitter();
+	TargetStaysWithinBounds();
+
+	printf(failures == 0 ? "passed\n" : "%d checks failed\n", failures);
+	return failures == 0 ? 0 : 1;
+}
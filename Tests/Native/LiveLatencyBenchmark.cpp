@@ -0,0 +1,212 @@
+//*****************************************************************************
+//
+//	Copyright 2017 Microsoft Corporation
+//
+//	Licensed under the Apache License, Version 2.0 (the "License");
+//	you may not use this file except in compliance with the License.
+//	You may obtain a copy of the License at
+//
+//	http ://www.apache.org/licenses/LICENSE-2.0
+//
+//	Unless required by applicable law or agreed to in writing, software
+//	distributed under the License is distributed on an "AS IS" BASIS,
+//	WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//	See the License for the specific language governing permissions and
+//	limitations under the License.
+//
+//*****************************************************************************
+
+
+
+// Headless live latency benchmark, the Linux counterpart of the LatencyBenchmark in TestWin2DXAML. A media
+// file is first recorded into a packet capture paced by its decode timestamps, then played back through the
+// replay demuxer at replay_speed=1 like a live source, so no streaming server is needed. Needs the FFmpeg
+// development packages, 3.x or 4.x since the replay demuxer is registered at runtime:
+//   g++ -std=c++14 -O2 -I. -I../../FFmpegInterop/Source LiveLatencyBenchmark.cpp ../../FFmpegInterop/Source/PacketCapture.cpp $(pkg-config --cflags --libs libavformat libavcodec libavutil) -o LiveLatencyBenchmark
+//   ./LiveLatencyBenchmark video.mp4 30
+// A capture recorded by the library (.fficap) is replayed as it is.
+
+#include "pch.h"
+#include "PacketCapture.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+
+extern "C"
+{
+#include <libavcodec/avcodec.h>
+#include <libavutil/time.h>
+}
+
+using namespace FFmpegInterop;
+
+const char* CAPTUREPATH = "LiveLatencyBenchmark.fficap";
+
+static bool IsCapture(const char* path)
+{
+	size_t length = strlen(path);
+	return length > 7 && strcmp(path + length - 7, ".fficap") == 0;
+}
+
+// Records the first seconds of the file, each packet arriving at its decode time after the first one
+static bool RecordCapture(const char* path, int seconds)
+{
+	AVFormatContext* avFormatCtx = nullptr;
+	if (avformat_open_input(&avFormatCtx, path, NULL, NULL) < 0 || avformat_find_stream_info(avFormatCtx, NULL) < 0)
+	{
+		avformat_close_input(&avFormatCtx);
+		return false;
+	}
+
+	int videoStreamIndex = av_find_best_stream(avFormatCtx, AVMEDIA_TYPE_VIDEO, -1, -1, NULL, 0);
+	int audioStreamIndex = av_find_best_stream(avFormatCtx, AVMEDIA_TYPE_AUDIO, -1, -1, NULL, 0);
+	PacketCapture* capture = videoStreamIndex >= 0 ? PacketCapture::Create(CAPTUREPATH, avFormatCtx, audioStreamIndex, videoStreamIndex) : nullptr;
+	if (capture == nullptr)
+	{
+		avformat_close_input(&avFormatCtx);
+		return false;
+	}
+
+	const AVRational microseconds = { 1, 1000000 };
+	int64_t firstTime = AV_NOPTS_VALUE;
+	int64_t lastTime = 0;
+	AVPacket avPacket;
+	while (av_read_frame(avFormatCtx, &avPacket) >= 0)
+	{
+		int64_t timestamp = avPacket.dts != AV_NOPTS_VALUE ? avPacket.dts : avPacket.pts;
+		if (timestamp != AV_NOPTS_VALUE)
+		{
+			// Packets arrive in order even when the streams are interleaved loosely
+			lastTime = max(lastTime, av_rescale_q(timestamp, avFormatCtx->streams[avPacket.stream_index]->time_base, microseconds));
+			if (firstTime == AV_NOPTS_VALUE)
+			{
+				firstTime = lastTime;
+			}
+		}
+
+		if (firstTime != AV_NOPTS_VALUE && lastTime - firstTime > seconds * 1000000LL)
+		{
+			av_packet_unref(&avPacket);
+			break;
+		}
+
+		capture->Write(&avPacket, lastTime);
+		av_packet_unref(&avPacket);
+	}
+
+	delete capture;
+	avformat_close_input(&avFormatCtx);
+	return true;
+}
+
+static double Percentile(const std::vector<int64_t>& sorted, double p)
+{
+	return sorted.empty() ? 0.0 : sorted[(size_t)(p * (sorted.size() - 1))] / 1000.0;
+}
+
+int main(int argc, char** argv)
+{
+	if (argc < 2)
+	{
+		printf("usage: LiveLatencyBenchmark <media file or .fficap capture> [seconds]\n");
+		return 1;
+	}
+
+	int seconds = argc > 2 ? atoi(argv[2]) : 30;
+#if LIBAVFORMAT_VERSION_MAJOR < 58
+	av_register_all();
+#endif
+	PacketCapture::RegisterReplayFormat();
+
+	const char* capturePath = argv[1];
+	if (!IsCapture(capturePath))
+	{
+		if (!RecordCapture(argv[1], seconds))
+		{
+			printf("can't record a capture of %s\n", argv[1]);
+			return 1;
+		}
+		capturePath = CAPTUREPATH;
+	}
+
+	// Opened the way the library opens a live source, stream info included
+	int64_t connectTime = av_gettime_relative();
+	AVDictionary* options = nullptr;
+	av_dict_set(&options, "replay_speed", "1", 0);
+	AVFormatContext* avFormatCtx = nullptr;
+	int result = avformat_open_input(&avFormatCtx, capturePath, NULL, &options);
+	av_dict_free(&options);
+	if (result < 0 || avformat_find_stream_info(avFormatCtx, NULL) < 0)
+	{
+		printf("can't open %s\n", capturePath);
+		return 1;
+	}
+
+	int videoStreamIndex = av_find_best_stream(avFormatCtx, AVMEDIA_TYPE_VIDEO, -1, -1, NULL, 0);
+	AVCodec* avCodec = videoStreamIndex >= 0 ? avcodec_find_decoder(avFormatCtx->streams[videoStreamIndex]->codecpar->codec_id) : nullptr;
+	AVCodecContext* avCodecCtx = avCodec != nullptr ? avcodec_alloc_context3(avCodec) : nullptr;
+	if (avCodecCtx == nullptr
+		|| avcodec_parameters_to_context(avCodecCtx, avFormatCtx->streams[videoStreamIndex]->codecpar) < 0
+		|| avcodec_open2(avCodecCtx, avCodec, NULL) < 0)
+	{
+		printf("can't decode the video stream of %s\n", capturePath);
+		return 1;
+	}
+
+	// Same measure as the LatencyBenchmark of the sample app: the first frame was the newest one when
+	// the source was opened, every later frame adds the time decoding fell behind the media time since
+	const AVRational microseconds = { 1, 1000000 };
+	AVRational timeBase = avFormatCtx->streams[videoStreamIndex]->time_base;
+	int64_t firstPacketTime = -1;
+	int64_t firstFrameTime = -1;
+	int64_t firstFramePosition = 0;
+	std::vector<int64_t> latencies;
+	AVFrame* avFrame = av_frame_alloc();
+	AVPacket avPacket;
+	while (av_read_frame(avFormatCtx, &avPacket) >= 0)
+	{
+		if (firstPacketTime < 0)
+		{
+			firstPacketTime = av_gettime_relative();
+		}
+
+		if (avPacket.stream_index == videoStreamIndex && avcodec_send_packet(avCodecCtx, &avPacket) >= 0)
+		{
+			while (avcodec_receive_frame(avCodecCtx, avFrame) >= 0)
+			{
+				int64_t now = av_gettime_relative();
+				int64_t pts = avFrame->best_effort_timestamp;
+				int64_t position = pts != AV_NOPTS_VALUE ? av_rescale_q(pts, timeBase, microseconds) : 0;
+				if (firstFrameTime < 0)
+				{
+					firstFrameTime = now;
+					firstFramePosition = position;
+				}
+				latencies.push_back((firstFrameTime - connectTime) + (now - firstFrameTime) - (position - firstFramePosition));
+				av_frame_unref(avFrame);
+			}
+		}
+		av_packet_unref(&avPacket);
+	}
+
+	av_frame_free(&avFrame);
+	avcodec_free_context(&avCodecCtx);
+	avformat_close_input(&avFormatCtx);
+	if (capturePath == CAPTUREPATH)
+	{
+		remove(CAPTUREPATH);
+	}
+
+	if (firstFrameTime < 0)
+	{
+		printf("no frame decoded\n");
+		return 1;
+	}
+
+	std::sort(latencies.begin(), latencies.end());
+	printf("connect to first packet %.1f ms, to first frame %.1f ms\n", (firstPacketTime - connectTime) / 1000.0, (firstFrameTime - connectTime) / 1000.0);
+	printf("latency p50 %.1f ms, p95 %.1f ms, p99 %.1f ms, max %.1f ms (%u frames)\n",
+		Percentile(latencies, 0.5), Percentile(latencies, 0.95), Percentile(latencies, 0.99), Percentile(latencies, 1.0), (unsigned int)latencies.size());
+	return 0;
+}
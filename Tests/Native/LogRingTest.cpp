@@ -0,0 +1,232 @@
+//*****************************************************************************
+//
+//	Copyright 2017 Microsoft Corporation
+//
+//	Licensed under the Apache License, Version 2.0 (the "License");
+//	you may not use this file except in compliance with the License.
+//	You may obtain a copy of the License at
+//
+//	http ://www.apache.org/licenses/LICENSE-2.0
+//
+//	Unless required by applicable law or agreed to in writing, software
+//	distributed under the License is distributed on an "AS IS" BASIS,
+//	WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//	See the License for the specific language governing permissions and
+//	limitations under the License.
+//
+//*****************************************************************************
+
+
+
+// Tests of the portable LogRing behind LogSink, built together with its source:
+//   cl /EHsc /I. /I..\..\FFmpegInterop\Source LogRingTest.cpp ..\..\FFmpegInterop\Source\LogRing.cpp
+//   g++ -std=c++14 -pthread -I. -I../../FFmpegInterop/Source LogRingTest.cpp ../../FFmpegInterop/Source/LogRing.cpp
+// Worth running under -fsanitize=thread after changes to the ring.
+
+#include "pch.h"
+#include "LogRing.h"
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <stdio.h>
+#include <string.h>
+#include <thread>
+#include <vector>
+
+using namespace FFmpegInterop;
+
+static int failures = 0;
+
+#define CHECK(condition) \
+	if (!(condition)) \
+	{ \
+		printf("%s(%d): %s failed\n", __FILE__, __LINE__, #condition); \
+		failures++; \
+	}
+
+const int WARNING = 24;
+const int INFO = 32;
+
+static size_t PushLine(LogRing& ring, int level, int producer, int line)
+{
+	return ring.Push(level, [level, producer, line](char* text, int size)
+	{
+		snprintf(text, size, "producer %d line %d level %d\n", producer, line, level);
+	});
+}
+
+// Pops everything queued
+static std::vector<LogRing::Line> PopAll(LogRing& ring)
+{
+	std::vector<LogRing::Line> lines;
+	LogRing::Line batch[32];
+	size_t count;
+	while ((count = ring.Pop(batch, 32)) > 0)
+	{
+		lines.insert(lines.end(), batch, batch + count);
+	}
+	return lines;
+}
+
+// Nothing is queued before Open or after Close, dropped lines are counted
+static void DropsLinesWhileClosed()
+{
+	std::unique_ptr<LogRing> ring(new LogRing());
+	CHECK(PushLine(*ring, WARNING, 0, 0) == 0);
+	CHECK(ring->GetDroppedCount() == 1);
+
+	ring->Open();
+	CHECK(PushLine(*ring, WARNING, 0, 1) == 1);
+	CHECK(PushLine(*ring, INFO, 0, 2) == 2);
+	ring->Close();
+	CHECK(PushLine(*ring, WARNING, 0, 3) == 0);
+	CHECK(ring->GetDroppedCount() == 2);
+
+	std::vector<LogRing::Line> lines = PopAll(*ring);
+	CHECK(lines.size() == 2);
+	CHECK(lines.size() == 2 && lines[0].level == WARNING && strcmp(lines[0].text, "producer 0 line 1 level 24\n") == 0);
+	CHECK(lines.size() == 2 && lines[1].level == INFO && strcmp(lines[1].text, "producer 0 line 2 level 32\n") == 0);
+	CHECK(ring->GetCount() == 0);
+}
+
+// Under the drop policy info lines stop at three quarters of the ring, warnings can use the rest
+static void KeepsRoomForWarnings()
+{
+	std::unique_ptr<LogRing> ring(new LogRing());
+	ring->Open();
+
+	int line = 0;
+	while (PushLine(*ring, INFO, 0, line) != 0)
+	{
+		line++;
+	}
+	CHECK(line == LogRing::Capacity - LogRing::ReservedForWarnings);
+	while (PushLine(*ring, WARNING, 0, line) != 0)
+	{
+		line++;
+	}
+	CHECK(line == LogRing::Capacity);
+	CHECK(ring->GetCount() == LogRing::Capacity);
+	CHECK(ring->GetDroppedCount() == 2);
+
+	// Popping frees the slots for the next round, across the wrap of the ring
+	CHECK(PopAll(*ring).size() == LogRing::Capacity);
+	CHECK(PushLine(*ring, INFO, 0, line) == 1);
+}
+
+// Producers flood the ring while the consumer pops in batches. Every line arrives whole and in the
+// order of its producer, or is counted as dropped (block = false) or waits for room (block = true).
+static void HandlesFullLoad(bool blockWhenFull)
+{
+	const int producerCount = 4;
+	const int linesPerProducer = 100000;
+
+	std::unique_ptr<LogRing> ring(new LogRing());
+	ring->SetBlockWhenFull(blockWhenFull);
+	ring->Open();
+
+	std::vector<std::thread> producers;
+	for (int producer = 0; producer < producerCount; producer++)
+	{
+		producers.push_back(std::thread([&ring, producer]()
+		{
+			for (int line = 0; line < linesPerProducer; line++)
+			{
+				PushLine(*ring, line % 10 == 0 ? WARNING : INFO, producer, line);
+			}
+		}));
+	}
+
+	// The test thread is the consumer, it stops once the producers are done and the ring is empty
+	std::atomic<int> running(producerCount);
+	std::thread watcher([&producers, &running]()
+	{
+		for (auto& producer : producers)
+		{
+			producer.join();
+			running--;
+		}
+	});
+	int lastLine[producerCount] = { -1, -1, -1, -1 };
+	bool isWellFormed = true;
+	bool inOrder = true;
+	uint64_t delivered = 0;
+	LogRing::Line batch[32];
+	while (true)
+	{
+		bool isLast = running == 0;
+		size_t count = ring->Pop(batch, 32);
+		for (size_t i = 0; i < count; i++)
+		{
+			int producer, line, level;
+			if (sscanf(batch[i].text, "producer %d line %d level %d", &producer, &line, &level) != 3
+				|| producer < 0 || producer >= producerCount || level != batch[i].level)
+			{
+				isWellFormed = false;
+				continue;
+			}
+			inOrder = inOrder && line > lastLine[producer];
+			lastLine[producer] = line;
+		}
+		delivered += count;
+		if (count == 0 && isLast)
+		{
+			break;
+		}
+		if (count == 0)
+		{
+			std::this_thread::yield();
+		}
+	}
+	watcher.join();
+
+	CHECK(isWellFormed);
+	CHECK(inOrder);
+	CHECK(delivered + ring->GetDroppedCount() == (uint64_t)producerCount * linesPerProducer);
+	if (blockWhenFull)
+	{
+		CHECK(ring->GetDroppedCount() == 0);
+		for (int producer = 0; producer < producerCount; producer++)
+		{
+			CHECK(lastLine[producer] == linesPerProducer - 1);
+		}
+	}
+}
+
+// A producer waiting for room under the block policy gives up when the ring is closed
+static void CloseReleasesBlockedProducers()
+{
+	std::unique_ptr<LogRing> ring(new LogRing());
+	ring->SetBlockWhenFull(true);
+	ring->Open();
+	for (int line = 0; line < (int)LogRing::Capacity; line++)
+	{
+		PushLine(*ring, INFO, 0, line);
+	}
+	CHECK(ring->GetCount() == LogRing::Capacity);
+
+	size_t result = 1;
+	std::thread producer([&ring, &result]()
+	{
+		result = PushLine(*ring, INFO, 1, 0);
+	});
+	std::this_thread::sleep_for(std::chrono::milliseconds(20));
+	ring->Close();
+	producer.join();
+
+	CHECK(result == 0);
+	CHECK(ring->GetDroppedCount() == 1);
+	CHECK(PopAll(*ring).size() == LogRing::Capacity);
+}
+
+int main()
+{
+	DropsLinesWhileClosed();
+	KeepsRoomForWarnings();
+	HandlesFullLoad(false);
+	HandlesFullLoad(true);
+	CloseReleasesBlockedProducers();
+
+	printf(failures == 0 ? "passed\n" : "%d checks failed\n", failures);
+	return failures == 0 ? 0 : 1;
+}
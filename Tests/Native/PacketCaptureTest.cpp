@@ -0,0 +1,243 @@
+//*****************************************************************************
+//
+//	Copyright 2017 Microsoft Corporation
+//
+//	Licensed under the Apache License, Version 2.0 (the "License");
+//	you may not use this file except in compliance with the License.
+//	You may obtain a copy of the License at
+//
+//	http ://www.apache.org/licenses/LICENSE-2.0
+//
+//	Unless required by applicable law or agreed to in writing, software
+//	distributed under the License is distributed on an "AS IS" BASIS,
+//	WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//	See the License for the specific language governing permissions and
+//	limitations under the License.
+//
+//*****************************************************************************
+
+
+
+// Tests of the PacketCapture recorder and its replay demuxer, built together with its source. Needs the
+// FFmpeg development packages, 3.x or 4.x since the replay demuxer is registered at runtime:
+//   g++ -std=c++14 -I. -I../../FFmpegInterop/Source PacketCaptureTest.cpp ../../FFmpegInterop/Source/PacketCapture.cpp $(pkg-config --cflags --libs libavformat libavcodec libavutil) -o PacketCaptureTest
+
+#include "pch.h"
+#include "PacketCapture.h"
+#include <chrono>
+#include <stdio.h>
+#include <string.h>
+
+extern "C"
+{
+#include <libavutil/mem.h>
+}
+
+using namespace FFmpegInterop;
+
+static int failures = 0;
+
+#define CHECK(condition) \
+	if (!(condition)) \
+	{ \
+		printf("%s(%d): %s failed\n", __FILE__, __LINE__, #condition); \
+		failures++; \
+	}
+
+const char* CAPTUREPATH = "PacketCaptureTest.fficap";
+const int PACKETCOUNT = 100;
+// Packets are recorded 10 ms apart, the first one 5 s into the session
+const int64_t ARRIVALSTART = 5000000;
+const int64_t ARRIVALINTERVAL = 10000;
+
+// Video, audio and a data stream that isn't recorded, like a source with subtitles
+static AVFormatContext* CreateSource()
+{
+	AVFormatContext* avFormatCtx = avformat_alloc_context();
+
+	AVStream* video = avformat_new_stream(avFormatCtx, NULL);
+	video->codecpar->codec_type = AVMEDIA_TYPE_VIDEO;
+	video->codecpar->codec_id = AV_CODEC_ID_H264;
+	video->codecpar->width = 1280;
+	video->codecpar->height = 720;
+	video->codecpar->sample_aspect_ratio = av_make_q(1, 1);
+	video->time_base = av_make_q(1, 90000);
+	video->codecpar->extradata = (uint8_t*)av_mallocz(4 + AV_INPUT_BUFFER_PADDING_SIZE);
+	video->codecpar->extradata_size = 4;
+	memcpy(video->codecpar->extradata, "\x01\x64\x00\x1f", 4);
+
+	AVStream* audio = avformat_new_stream(avFormatCtx, NULL);
+	audio->codecpar->codec_type = AVMEDIA_TYPE_AUDIO;
+	audio->codecpar->codec_id = AV_CODEC_ID_AAC;
+	audio->codecpar->sample_rate = 48000;
+	audio->codecpar->channels = 2;
+	audio->codecpar->channel_layout = AV_CH_LAYOUT_STEREO;
+	audio->time_base = av_make_q(1, 48000);
+
+	AVStream* data = avformat_new_stream(avFormatCtx, NULL);
+	data->codecpar->codec_type = AVMEDIA_TYPE_DATA;
+	data->time_base = av_make_q(1, 1000);
+
+	return avFormatCtx;
+}
+
+// Source stream, timestamps and payload of packet i. Every third packet is audio, the rest video with
+// a keyframe every 10 packets and its dts one frame behind the pts.
+static int GetStreamIndex(int i)
+{
+	return i % 3 == 2 ? 1 : 0;
+}
+
+static void FillPacket(int i, AVPacket* avPacket, uint8_t* data)
+{
+	av_init_packet(avPacket);
+	avPacket->stream_index = GetStreamIndex(i);
+	avPacket->pts = avPacket->stream_index == 0 ? (i + 1) * 3000 : i * 1024;
+	avPacket->dts = avPacket->stream_index == 0 ? i * 3000 : i * 1024;
+	avPacket->duration = avPacket->stream_index == 0 ? 3000 : 1024;
+	avPacket->flags = avPacket->stream_index == 0 && i % 10 == 0 ? AV_PKT_FLAG_KEY : 0;
+	avPacket->size = 16 + i;
+	for (int j = 0; j < avPacket->size; j++)
+	{
+		data[j] = (uint8_t)(i + j);
+	}
+	avPacket->data = data;
+}
+
+static void WriteCapture()
+{
+	AVFormatContext* source = CreateSource();
+	PacketCapture* capture = PacketCapture::Create(CAPTUREPATH, source, 1, 0);
+	CHECK(capture != nullptr);
+	if (capture != nullptr)
+	{
+		uint8_t data[256];
+		AVPacket avPacket;
+		for (int i = 0; i < PACKETCOUNT; i++)
+		{
+			FillPacket(i, &avPacket, data);
+			capture->Write(&avPacket, ARRIVALSTART + i * ARRIVALINTERVAL);
+
+			// Not selected for recording
+			avPacket.stream_index = 2;
+			capture->Write(&avPacket, ARRIVALSTART + i * ARRIVALINTERVAL);
+		}
+		delete capture;
+	}
+	avformat_free_context(source);
+}
+
+static AVFormatContext* OpenReplay(const char* speed, const char* jitter)
+{
+	AVDictionary* options = nullptr;
+	av_dict_set(&options, "replay_speed", speed, 0);
+	av_dict_set(&options, "replay_jitter", jitter, 0);
+	AVFormatContext* avFormatCtx = nullptr;
+	int result = avformat_open_input(&avFormatCtx, CAPTUREPATH, NULL, &options);
+	av_dict_free(&options);
+	return result >= 0 ? avFormatCtx : nullptr;
+}
+
+// Reads the whole replay and returns the number of packets, checking each against what was recorded
+static int ReadReplay(AVFormatContext* avFormatCtx)
+{
+	uint8_t data[256];
+	AVPacket expected;
+	AVPacket avPacket;
+	int count = 0;
+	while (av_read_frame(avFormatCtx, &avPacket) >= 0)
+	{
+		FillPacket(count, &expected, data);
+		// The capture lists video first, whatever the source order
+		CHECK(avPacket.stream_index == (expected.stream_index == 0 ? 0 : 1));
+		CHECK(avPacket.pts == expected.pts);
+		CHECK(avPacket.dts == expected.dts);
+		CHECK(avPacket.duration == expected.duration);
+		CHECK((avPacket.flags & AV_PKT_FLAG_KEY) == expected.flags);
+		CHECK(avPacket.size == expected.size && memcmp(avPacket.data, expected.data, expected.size) == 0);
+		av_packet_unref(&avPacket);
+		count++;
+	}
+	return count;
+}
+
+// Everything recorded comes back unchanged, the stream that wasn't selected is left out
+static void ReplayReturnsTheRecordedPackets()
+{
+	AVFormatContext* avFormatCtx = OpenReplay("0", "0");
+	CHECK(avFormatCtx != nullptr);
+	if (avFormatCtx == nullptr)
+	{
+		return;
+	}
+
+	CHECK(avFormatCtx->nb_streams == 2);
+	AVCodecParameters* video = avFormatCtx->streams[0]->codecpar;
+	CHECK(video->codec_type == AVMEDIA_TYPE_VIDEO && video->codec_id == AV_CODEC_ID_H264);
+	CHECK(video->width == 1280 && video->height == 720);
+	CHECK(video->extradata_size == 4 && memcmp(video->extradata, "\x01\x64\x00\x1f", 4) == 0);
+	CHECK(av_cmp_q(avFormatCtx->streams[0]->time_base, av_make_q(1, 90000)) == 0);
+	AVCodecParameters* audio = avFormatCtx->streams[1]->codecpar;
+	CHECK(audio->codec_type == AVMEDIA_TYPE_AUDIO && audio->codec_id == AV_CODEC_ID_AAC);
+	CHECK(audio->sample_rate == 48000 && audio->channels == 2 && audio->channel_layout == AV_CH_LAYOUT_STEREO);
+	CHECK(av_cmp_q(avFormatCtx->streams[1]->time_base, av_make_q(1, 48000)) == 0);
+
+	CHECK(ReadReplay(avFormatCtx) == PACKETCOUNT);
+	avformat_close_input(&avFormatCtx);
+}
+
+static int64_t MeasureReplay(const char* speed, const char* jitter)
+{
+	AVFormatContext* avFormatCtx = OpenReplay(speed, jitter);
+	CHECK(avFormatCtx != nullptr);
+	if (avFormatCtx == nullptr)
+	{
+		return 0;
+	}
+
+	auto start = std::chrono::steady_clock::now();
+	CHECK(ReadReplay(avFormatCtx) == PACKETCOUNT);
+	auto elapsed = std::chrono::steady_clock::now() - start;
+	avformat_close_input(&avFormatCtx);
+	return std::chrono::duration_cast<std::chrono::microseconds>(elapsed).count();
+}
+
+// The recording spans 990 ms from its first packet, the replay paces it the same way, scaled by the speed
+static void ReplayKeepsTheRecordedTiming()
+{
+	const int64_t recorded = (PACKETCOUNT - 1) * ARRIVALINTERVAL;
+
+	int64_t elapsed = MeasureReplay("1", "0");
+	CHECK(elapsed >= recorded && elapsed < recorded + 200000);
+
+	elapsed = MeasureReplay("4", "0");
+	CHECK(elapsed >= recorded / 4 && elapsed < recorded / 4 + 200000);
+
+	CHECK(MeasureReplay("0", "0") < recorded / 4);
+}
+
+// Jitter delays packets but never reorders them
+static void JitterDelaysPacketsInOrder()
+{
+	const int64_t recorded = (PACKETCOUNT - 1) * ARRIVALINTERVAL;
+
+	int64_t elapsed = MeasureReplay("10", "100000");
+	CHECK(elapsed >= recorded / 10 && elapsed < recorded / 10 + 100000 + 200000);
+}
+
+int main()
+{
+#if LIBAVFORMAT_VERSION_MAJOR < 58
+	av_register_all();
+#endif
+	PacketCapture::RegisterReplayFormat();
+
+	WriteCapture();
+	ReplayReturnsTheRecordedPackets();
+	ReplayKeepsTheRecordedTiming();
+	JitterDelaysPacketsInOrder();
+	remove(CAPTUREPATH);
+
+	printf(failures == 0 ? "passed\n" : "%d checks failed\n", failures);
+	return failures == 0 ? 0 : 1;
+}
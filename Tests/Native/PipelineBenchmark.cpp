@@ -0,0 +1,307 @@
+//*****************************************************************************
+//
+//	Copyright 2017 Microsoft Corporation
+//
+//	Licensed under the Apache License, Version 2.0 (the "License");
+//	you may not use this file except in compliance with the License.
+//	You may obtain a copy of the License at
+//
+//	http ://www.apache.org/licenses/LICENSE-2.0
+//
+//	Unless required by applicable law or agreed to in writing, software
+//	distributed under the License is distributed on an "AS IS" BASIS,
+//	WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//	See the License for the specific language governing permissions and
+//	limitations under the License.
+//
+//*****************************************************************************
+
+
+
+// Video throughput of decode followed by conversion to NV12 and the copy into the sample buffer, once
+// sequentially on one thread like VideoDecodeAheadFrames = 0, once staged with the decode on its own
+// thread handing frames to the conversion through an SpscQueue like UncompressedSampleProvider.
+// Needs the FFmpeg development packages:
+//   g++ -std=c++14 -O2 -pthread -I. -I../../FFmpegInterop/Source PipelineBenchmark.cpp $(pkg-config --cflags --libs libavformat libavcodec libswscale libavutil) -o PipelineBenchmark
+//   ./PipelineBenchmark video.mp4
+// Every run goes through the first 600 frames of the file with frame threading, like file playback.
+
+#include "pch.h"
+#include "SpscQueue.h"
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <stdio.h>
+#include <stdlib.h>
+#include <thread>
+#include <vector>
+
+extern "C"
+{
+#include <libavcodec/avcodec.h>
+#include <libavformat/avformat.h>
+#include <libavutil/imgutils.h>
+#include <libswscale/swscale.h>
+}
+
+using namespace FFmpegInterop;
+
+const int FRAMELIMIT = 600;
+
+struct Decode
+{
+	AVFormatContext* formatCtx;
+	AVCodecContext* codecCtx;
+	int streamIndex;
+	bool isDraining;
+	int frameCount;
+};
+
+static bool OpenDecode(const char* path, Decode& decode)
+{
+	decode.formatCtx = nullptr;
+	decode.codecCtx = nullptr;
+	decode.isDraining = false;
+	decode.frameCount = 0;
+	if (avformat_open_input(&decode.formatCtx, path, NULL, NULL) < 0 || avformat_find_stream_info(decode.formatCtx, NULL) < 0)
+	{
+		return false;
+	}
+
+	AVCodec* codec = nullptr;
+	decode.streamIndex = av_find_best_stream(decode.formatCtx, AVMEDIA_TYPE_VIDEO, -1, -1, &codec, 0);
+	if (decode.streamIndex < 0)
+	{
+		return false;
+	}
+
+	decode.codecCtx = avcodec_alloc_context3(codec);
+	if (decode.codecCtx == nullptr || avcodec_parameters_to_context(decode.codecCtx, decode.formatCtx->streams[decode.streamIndex]->codecpar) < 0)
+	{
+		return false;
+	}
+	decode.codecCtx->thread_count = (int)std::thread::hardware_concurrency();
+	decode.codecCtx->thread_type = FF_THREAD_FRAME | FF_THREAD_SLICE;
+	return avcodec_open2(decode.codecCtx, codec, NULL) >= 0;
+}
+
+static void CloseDecode(Decode& decode)
+{
+	avcodec_free_context(&decode.codecCtx);
+	avformat_close_input(&decode.formatCtx);
+}
+
+// Returns false at the end of the stream or after FRAMELIMIT frames
+static bool DecodeNextFrame(Decode& decode, AVFrame* frame)
+{
+	while (decode.frameCount < FRAMELIMIT)
+	{
+		int result = avcodec_receive_frame(decode.codecCtx, frame);
+		if (result >= 0)
+		{
+			decode.frameCount++;
+			return true;
+		}
+		if (result != AVERROR(EAGAIN) || decode.isDraining)
+		{
+			return false;
+		}
+
+		AVPacket packet;
+		if (av_read_frame(decode.formatCtx, &packet) < 0)
+		{
+			decode.isDraining = true;
+			avcodec_send_packet(decode.codecCtx, NULL);
+			continue;
+		}
+		if (packet.stream_index == decode.streamIndex)
+		{
+			avcodec_send_packet(decode.codecCtx, &packet);
+		}
+		av_packet_unref(&packet);
+	}
+	return false;
+}
+
+// Conversion and copy into one contiguous buffer, what UncompressedVideoSampleProvider does per sample
+class Converter
+{
+public:
+	Converter()
+		: m_swsCtx(nullptr)
+	{
+	}
+
+	~Converter()
+	{
+		sws_freeContext(m_swsCtx);
+	}
+
+	void Convert(AVFrame* frame)
+	{
+		m_swsCtx = sws_getCachedContext(m_swsCtx, frame->width, frame->height, (AVPixelFormat)frame->format,
+			frame->width, frame->height, AV_PIX_FMT_NV12, SWS_BICUBIC, NULL, NULL, NULL);
+		int size = av_image_get_buffer_size(AV_PIX_FMT_NV12, frame->width, frame->height, 1);
+		if (m_swsCtx == nullptr || size < 0)
+		{
+			return;
+		}
+
+		m_buffer.resize(size);
+		uint8_t* planes[4];
+		int lineSizes[4];
+		av_image_fill_arrays(planes, lineSizes, m_buffer.data(), AV_PIX_FMT_NV12, frame->width, frame->height, 1);
+		sws_scale(m_swsCtx, frame->data, frame->linesize, 0, frame->height, planes, lineSizes);
+
+		// The sample buffer is a separate copy of the converted picture
+		m_sample.assign(m_buffer.begin(), m_buffer.end());
+	}
+
+private:
+	SwsContext* m_swsCtx;
+	std::vector<uint8_t> m_buffer;
+	std::vector<uint8_t> m_sample;
+};
+
+// Frames per second through decode and conversion on one thread
+static double MeasureSequential(const char* path)
+{
+	Decode decode;
+	if (!OpenDecode(path, decode))
+	{
+		fprintf(stderr, "Could not open %s\n", path);
+		exit(1);
+	}
+
+	Converter converter;
+	AVFrame* frame = av_frame_alloc();
+	auto start = std::chrono::steady_clock::now();
+	while (DecodeNextFrame(decode, frame))
+	{
+		converter.Convert(frame);
+		av_frame_unref(frame);
+	}
+	std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+	av_frame_free(&frame);
+	int frameCount = decode.frameCount;
+	CloseDecode(decode);
+	return frameCount / elapsed.count();
+}
+
+// Frames per second with the decode running up to depth frames ahead of the conversion. Same handoff
+// as UncompressedSampleProvider: pooled frames through the ring, a condition variable to wait on,
+// notified under the lock.
+static double MeasureStaged(const char* path, size_t depth)
+{
+	Decode decode;
+	if (!OpenDecode(path, decode))
+	{
+		fprintf(stderr, "Could not open %s\n", path);
+		exit(1);
+	}
+
+	SpscQueue<AVFrame*> readyFrames(depth);
+	std::mutex stageMutex;
+	std::condition_variable stageWakeUp;
+	bool isEnded = false;
+	std::mutex poolMutex;
+	std::vector<AVFrame*> framePool;
+
+	auto start = std::chrono::steady_clock::now();
+	std::thread decodeThread([&]()
+	{
+		while (true)
+		{
+			AVFrame* frame = nullptr;
+			{
+				std::lock_guard<std::mutex> lock(poolMutex);
+				if (!framePool.empty())
+				{
+					frame = framePool.back();
+					framePool.pop_back();
+				}
+			}
+			if (frame == nullptr)
+			{
+				frame = av_frame_alloc();
+			}
+
+			if (!DecodeNextFrame(decode, frame))
+			{
+				av_frame_free(&frame);
+				break;
+			}
+
+			std::unique_lock<std::mutex> lock(stageMutex);
+			while (!readyFrames.TryPush(frame))
+			{
+				stageWakeUp.wait(lock);
+			}
+			stageWakeUp.notify_all();
+		}
+
+		std::lock_guard<std::mutex> lock(stageMutex);
+		isEnded = true;
+		stageWakeUp.notify_all();
+	});
+
+	Converter converter;
+	while (true)
+	{
+		AVFrame* frame = nullptr;
+		{
+			std::unique_lock<std::mutex> lock(stageMutex);
+			while (!readyFrames.TryPop(frame) && !isEnded)
+			{
+				stageWakeUp.wait(lock);
+			}
+			stageWakeUp.notify_all();
+		}
+		if (frame == nullptr && !readyFrames.TryPop(frame))
+		{
+			break;
+		}
+
+		converter.Convert(frame);
+		av_frame_unref(frame);
+		std::lock_guard<std::mutex> lock(poolMutex);
+		framePool.push_back(frame);
+	}
+	decodeThread.join();
+	std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+	for (auto frame : framePool)
+	{
+		av_frame_free(&frame);
+	}
+	int frameCount = decode.frameCount;
+	CloseDecode(decode);
+	return frameCount / elapsed.count();
+}
+
+int main(int argc, char* argv[])
+{
+	if (argc < 2)
+	{
+		printf("usage: %s file\n", argv[0]);
+		return 1;
+	}
+
+#if LIBAVFORMAT_VERSION_MAJOR < 58
+	av_register_all();
+#endif
+	av_log_set_level(AV_LOG_ERROR);
+
+	double sequential = MeasureSequential(argv[1]);
+	printf("%u hardware threads\n", std::thread::hardware_concurrency());
+	printf("mode        fps     gain\n");
+	printf("sequential  %7.1f\n", sequential);
+	for (size_t depth = 1; depth <= 4; depth *= 2)
+	{
+		double staged = MeasureStaged(argv[1], depth);
+		printf("staged %zu    %7.1f  %4.2f\n", depth, staged, staged / sequential);
+	}
+
+	return 0;
+}
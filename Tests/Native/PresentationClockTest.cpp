@@ -0,0 +1,165 @@
+//*****************************************************************************
+//
+//	Copyright 2017 Microsoft Corporation
+//
+//	Licensed under the Apache License, Version 2.0 (the "License");
+//	you may not use this file except in compliance with the License.
+//	You may obtain a copy of the License at
+//
+//	http ://www.apache.org/licenses/LICENSE-2.0
+//
+//	Unless required by applicable law or agreed to in writing, software
+//	distributed under the License is distributed on an "AS IS" BASIS,
+//	WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//	See the License for the specific language governing permissions and
+//	limitations under the License.
+//
+//*****************************************************************************
+
+
+
+// Tests of the portable PresentationClock, built together with its source:
+//   cl /EHsc /I. /I..\..\FFmpegInterop\Source PresentationClockTest.cpp ..\..\FFmpegInterop\Source\PresentationClock.cpp
+//   g++ -std=c++14 -I. -I../../FFmpegInterop/Source PresentationClockTest.cpp ../../FFmpegInterop/Source/PresentationClock.cpp
+
+#include "pch.h"
+#include "PresentationClock.h"
+#include <stdio.h>
+
+using namespace FFmpegInterop;
+
+static int failures = 0;
+
+#define CHECK(condition) \
+	if (!(condition)) \
+	{ \
+		printf("%s(%d): %s failed\n", __FILE__, __LINE__, #condition); \
+		failures++; \
+	}
+
+// 25 fps, in microseconds
+const int64_t FRAMEDURATION = 40000;
+
+// Delay of frame i behind its timestamp, a repeating pattern of up to 250 ms like a bursty network link
+static int64_t DeliveryJitter(int i)
+{
+	static const int64_t pattern[] = { 0, 30000, 250000, 120000, 10000, 200000, 0, 90000 };
+	return pattern[i % 8];
+}
+
+// Counts the frames a live stream loses when frame i is decoded as soon as it arrives. The first frame
+// is handed out on arrival and anchors the clock.
+static int CountLateFrames(PresentationClock& clock, int frameCount)
+{
+	int lateFrames = 0;
+	clock.Start(DeliveryJitter(0), 0);
+	for (int i = 1; i < frameCount; i++)
+	{
+		int64_t arrivalTime = i * FRAMEDURATION + DeliveryJitter(i);
+		if (clock.IsFrameLate(arrivalTime, (i + 1) * FRAMEDURATION))
+		{
+			lateFrames++;
+		}
+	}
+	return lateFrames;
+}
+
+// Frames are never late before a sample was handed out, e.g. while the producer pre-rolls
+static void StoppedClockIsNeverLate()
+{
+	PresentationClock clock;
+	CHECK(!clock.IsRunning());
+	CHECK(clock.GetLateness(10000000, 0) == 0);
+	CHECK(!clock.IsFrameLate(10000000, 0));
+
+	clock.Start(0, 0);
+	CHECK(clock.IsRunning());
+	clock.Stop();
+	CHECK(!clock.IsRunning());
+}
+
+// Only the first sample handed out anchors the clock
+static void StartAnchorsOnce()
+{
+	PresentationClock clock;
+	clock.Start(1000000, 5000000);
+	clock.Start(2000000, 0);
+	CHECK(clock.GetLateness(1500000, 5000000) == 500000);
+}
+
+// Jittered delivery inside the jitter buffer loses no frames, the same delivery without it does
+static void JitterWithinBufferTimeIsNotLate()
+{
+	PresentationClock buffered;
+	buffered.SetBufferTime(300000);
+	CHECK(CountLateFrames(buffered, 1000) == 0);
+
+	PresentationClock unbuffered;
+	CHECK(CountLateFrames(unbuffered, 1000) > 0);
+}
+
+// A frame arriving later than the buffer time is still dropped
+static void JitterBeyondBufferTimeIsLate()
+{
+	PresentationClock clock;
+	clock.SetBufferTime(100000);
+	clock.Start(0, 0);
+	CHECK(clock.GetLateness(FRAMEDURATION + 100000, FRAMEDURATION) == 0);
+	CHECK(!clock.IsFrameLate(FRAMEDURATION + 100000, FRAMEDURATION));
+	CHECK(clock.IsFrameLate(FRAMEDURATION + 300000, FRAMEDURATION));
+}
+
+// The buffer time follows the jitter estimate while playing
+static void BufferTimeChangesApplyImmediately()
+{
+	PresentationClock clock;
+	clock.Start(0, 0);
+	CHECK(clock.IsFrameLate(500000, FRAMEDURATION));
+	clock.SetBufferTime(500000);
+	CHECK(clock.GetBufferTime() == 500000);
+	CHECK(!clock.IsFrameLate(500000, FRAMEDURATION));
+}
+
+// A run of late frames lets one through so the picture keeps moving
+static void LateRunIsBroken()
+{
+	PresentationClock clock;
+	clock.Start(0, 0);
+	int delivered = 0;
+	for (int i = 0; i < 18; i++)
+	{
+		if (!clock.IsFrameLate(1000000, 0))
+		{
+			delivered++;
+		}
+	}
+	CHECK(delivered == 2);
+}
+
+// Being far behind means the renderer stalled, the clock stops instead of dropping everything
+static void StallStopsTheClock()
+{
+	PresentationClock clock;
+	clock.SetBufferTime(300000);
+	clock.Start(0, 0);
+	CHECK(!clock.IsFrameLate(5000000, FRAMEDURATION));
+	CHECK(!clock.IsRunning());
+
+	clock.Start(5000000, FRAMEDURATION);
+	CHECK(clock.IsRunning());
+	CHECK(!clock.IsFrameLate(5000000, 2 * FRAMEDURATION));
+}
+
+int main()
+{
+	StoppedClockIsNeverLate();
+	StartAnchorsOnce();
+	JitterWithinBufferTimeIsNotLate();
+	JitterBeyondBufferTimeIsLate();
+	BufferTimeChangesApplyImmediately();
+	LateRunIsBroken();
+	StallStopsTheClock();
+
+	printf(failures == 0 ? "passed\n" : "%d checks failed\n", failures);
+	return failures == 0 ? 0 : 1;
+}
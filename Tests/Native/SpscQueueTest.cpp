@@ -0,0 +1,384 @@
+//*****************************************************************************
+//
+//	Copyright 2017 Microsoft Corporation
+//
+//	Licensed under the Apache License, Version 2.0 (the "License");
+//	you may not use this file except in compliance with the License.
+//	You may obtain a copy of the License at
+//
+//	http ://www.apache.org/licenses/LICENSE-2.0
+//
+//	Unless required by applicable law or agreed to in writing, software
+//	distributed under the License is distributed on an "AS IS" BASIS,
+//	WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//	See the License for the specific language governing permissions and
+//	limitations under the License.
+//
+//*****************************************************************************
+
+
+
+// Tests of the portable SpscQueue and of the way UncompressedSampleProvider hands decoded frames from its
+// decode thread to the conversion, header only:
+//   cl /EHsc /I. /I..\..\FFmpegInterop\Source SpscQueueTest.cpp
+//   g++ -std=c++14 -pthread -I. -I../../FFmpegInterop/Source SpscQueueTest.cpp
+// Worth running under -fsanitize=thread after changes to either.
+
+#include "pch.h"
+#include "RingBuffer.h"
+#include "SpscQueue.h"
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <stdio.h>
+#include <thread>
+
+using namespace FFmpegInterop;
+
+static int failures = 0;
+
+#define CHECK(condition) \
+	if (!(condition)) \
+	{ \
+		printf("%s(%d): %s failed\n", __FILE__, __LINE__, #condition); \
+		failures++; \
+	}
+
+// Holds exactly its capacity, in order, across the wrap of the ring
+static void KeepsOrderUpToCapacity()
+{
+	SpscQueue<int> queue(3);
+	CHECK(queue.IsEmpty());
+	CHECK(!queue.IsFull());
+
+	int item = 0;
+	CHECK(!queue.TryPop(item));
+	for (int round = 0; round < 5; round++)
+	{
+		CHECK(queue.TryPush(round * 10 + 1));
+		CHECK(queue.TryPush(round * 10 + 2));
+		CHECK(queue.TryPush(round * 10 + 3));
+		CHECK(queue.IsFull());
+		CHECK(!queue.TryPush(0));
+
+		CHECK(queue.TryPop(item) && item == round * 10 + 1);
+		CHECK(!queue.IsFull());
+		CHECK(queue.TryPop(item) && item == round * 10 + 2);
+		CHECK(queue.TryPop(item) && item == round * 10 + 3);
+		CHECK(queue.IsEmpty());
+		CHECK(!queue.TryPop(item));
+	}
+}
+
+// One producer and one consumer spinning on a small ring, every item arrives once and in order
+static void PassesItemsBetweenThreads()
+{
+	const int itemCount = 1000000;
+	SpscQueue<int> queue(4);
+
+	std::thread producer([&queue]()
+	{
+		for (int i = 0; i < itemCount; i++)
+		{
+			while (!queue.TryPush(i))
+			{
+				std::this_thread::yield();
+			}
+		}
+	});
+
+	int expected = 0;
+	bool inOrder = true;
+	while (expected < itemCount)
+	{
+		int item;
+		if (queue.TryPop(item))
+		{
+			inOrder = inOrder && item == expected;
+			expected++;
+		}
+		else
+		{
+			std::this_thread::yield();
+		}
+	}
+	producer.join();
+
+	CHECK(inOrder);
+	CHECK(queue.IsEmpty());
+}
+
+// The decode thread protocol of UncompressedSampleProvider with a counter as decoder: RunDecodeThread,
+// TakeReadyFrame, PauseDecodeThread/ResumeDecodeThread and FlushDecoder, same locking and wakeups.
+// The decoder sometimes returns two frames for one packet, the second waits in the decoded frames
+// when the ring is full, like frames in m_decodedFrames.
+class DecodeStage
+{
+public:
+	DecodeStage(size_t depth, int frameCount)
+		: m_readyFrames(depth)
+		, m_frameCount(frameCount)
+		, m_nextFrame(0)
+		, m_packetCount(0)
+		, m_pauseCount(0)
+		, m_isStarted(false)
+		, m_isDecoding(false)
+		, m_stop(false)
+		, m_isEnded(false)
+		, m_isPaused(false)
+		, m_isDecodingWhilePaused(false)
+	{
+		m_thread = std::thread([this]() { Run(); });
+	}
+
+	~DecodeStage()
+	{
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			m_stop = true;
+			m_wakeUp.notify_all();
+		}
+		m_thread.join();
+	}
+
+	void Start()
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_isStarted = true;
+		m_wakeUp.notify_all();
+	}
+
+	void Pause()
+	{
+		std::unique_lock<std::mutex> lock(m_mutex);
+		m_pauseCount++;
+		while (m_isDecoding)
+		{
+			m_wakeUp.wait(lock);
+		}
+		m_isPaused = true;
+	}
+
+	void Resume()
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_pauseCount--;
+		m_isPaused = m_pauseCount > 0;
+		m_wakeUp.notify_all();
+	}
+
+	// Call paused: drops everything decoded and continues decoding at frame, like a seek
+	void Flush(int frame)
+	{
+		while (!m_decodedFrames.IsEmpty())
+		{
+			m_decodedFrames.PopFront();
+		}
+		int item;
+		while (m_readyFrames.TryPop(item))
+		{
+		}
+		m_nextFrame = frame;
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_isEnded = false;
+	}
+
+	// Returns false at the end of the stream
+	bool Take(int& frame)
+	{
+		while (!m_readyFrames.TryPop(frame))
+		{
+			std::unique_lock<std::mutex> lock(m_mutex);
+			if (m_readyFrames.IsEmpty() && !m_isEnded)
+			{
+				m_wakeUp.wait(lock);
+			}
+			else if (m_readyFrames.IsEmpty() && m_isEnded)
+			{
+				return false;
+			}
+		}
+
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_wakeUp.notify_all();
+		return true;
+	}
+
+	// Whether the decode thread ever ran between a Pause and its Resume
+	bool IsDecodingWhilePaused()
+	{
+		return m_isDecodingWhilePaused;
+	}
+
+private:
+	void Run()
+	{
+		std::unique_lock<std::mutex> lock(m_mutex);
+		while (!m_stop)
+		{
+			if (!m_isStarted || m_pauseCount > 0 || m_isEnded || m_readyFrames.IsFull())
+			{
+				m_wakeUp.wait(lock);
+				continue;
+			}
+			m_isDecoding = true;
+			lock.unlock();
+
+			bool isEnded = false;
+			while (!isEnded && m_decodedFrames.IsEmpty())
+			{
+				isEnded = !DecodeNextPacket();
+			}
+
+			while (!m_decodedFrames.IsEmpty() && m_readyFrames.TryPush(m_decodedFrames.Front()))
+			{
+				m_decodedFrames.PopFront();
+			}
+
+			lock.lock();
+			m_isDecoding = false;
+			if (isEnded)
+			{
+				m_isEnded = true;
+			}
+			m_wakeUp.notify_all();
+		}
+	}
+
+	bool DecodeNextPacket()
+	{
+		if (m_isPaused)
+		{
+			m_isDecodingWhilePaused = true;
+		}
+
+		if (m_nextFrame >= m_frameCount)
+		{
+			return false;
+		}
+
+		// Every third packet gives two frames, every fifth none (still buffered in the decoder)
+		m_packetCount++;
+		if (m_packetCount % 5 != 0)
+		{
+			m_decodedFrames.PushBack(m_nextFrame++);
+			if (m_packetCount % 3 == 0 && m_nextFrame < m_frameCount)
+			{
+				m_decodedFrames.PushBack(m_nextFrame++);
+			}
+		}
+		return true;
+	}
+
+	SpscQueue<int> m_readyFrames;
+	std::thread m_thread;
+	std::mutex m_mutex;
+	std::condition_variable m_wakeUp;
+
+	// Decoder, used by the decode thread or with it paused
+	RingBuffer<int> m_decodedFrames;
+	int m_frameCount;
+	int m_nextFrame;
+	int m_packetCount;
+
+	int m_pauseCount;
+	bool m_isStarted;
+	bool m_isDecoding;
+	bool m_stop;
+	bool m_isEnded;
+
+	// Set from the return of Pause to the last Resume
+	std::atomic<bool> m_isPaused;
+	std::atomic<bool> m_isDecodingWhilePaused;
+};
+
+// All frames arrive once and in order through the ring, then the end of the stream
+static void HandsOffEveryFrame()
+{
+	const int frameCount = 200000;
+	for (size_t depth = 1; depth <= 4; depth++)
+	{
+		DecodeStage stage(depth, frameCount);
+		stage.Start();
+
+		int expected = 0;
+		bool inOrder = true;
+		int frame;
+		while (stage.Take(frame))
+		{
+			inOrder = inOrder && frame == expected;
+			expected++;
+		}
+
+		CHECK(inOrder);
+		CHECK(expected == frameCount);
+		// The end stays reported
+		CHECK(!stage.Take(frame));
+	}
+}
+
+// Seeks while the decode thread runs ahead: the decode thread never decodes while paused, and after
+// a flush only frames from the new position arrive
+static void FlushesWhileDecoding()
+{
+	const int frameCount = 100000;
+	DecodeStage stage(2, frameCount);
+	stage.Start();
+
+	int expected = 0;
+	bool inOrder = true;
+	int seekCount = 0;
+	int frame;
+	while (stage.Take(frame))
+	{
+		inOrder = inOrder && frame == expected;
+		expected = frame + 1;
+
+		if (frame % 997 == 0)
+		{
+			// Seek a bit ahead, sometimes past the end
+			int target = frame + 500 + (seekCount % 7) * 1000;
+			stage.Pause();
+			stage.Flush(target);
+				stage.Resume();
+			expected = target;
+			seekCount++;
+		}
+	}
+
+	CHECK(inOrder);
+	CHECK(seekCount > 10);
+	CHECK(!stage.IsDecodingWhilePaused());
+}
+
+// Nested pauses, as Flush pauses inside a catch-up skip: decoding resumes only after the last Resume
+static void NestedPausesHoldTheDecodeThread()
+{
+	DecodeStage stage(2, 1000);
+	stage.Start();
+
+	int frame;
+	CHECK(stage.Take(frame) && frame == 0);
+	stage.Pause();
+	stage.Pause();
+	stage.Flush(100);
+	stage.Resume();
+	// Still paused, nothing was decoded since the flush
+	std::this_thread::sleep_for(std::chrono::milliseconds(20));
+	stage.Resume();
+
+	CHECK(stage.Take(frame) && frame == 100);
+	CHECK(!stage.IsDecodingWhilePaused());
+}
+
+int main()
+{
+	KeepsOrderUpToCapacity();
+	PassesItemsBetweenThreads();
+	HandsOffEveryFrame();
+	FlushesWhileDecoding();
+	NestedPausesHoldTheDecodeThread();
+
+	printf(failures == 0 ? "passed\n" : "%d checks failed\n", failures);
+	return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,189 @@
+//*****************************************************************************
+//
+//	Copyright 2017 Microsoft Corporation
+//
+//	Licensed under the Apache License, Version 2.0 (the "License");
+//	you may not use this file except in compliance with the License.
+//	You may obtain a copy of the License at
+//
+//	http ://www.apache.org/licenses/LICENSE-2.0
+//
+//	Unless required by applicable law or agreed to in writing, software
+//	distributed under the License is distributed on an "AS IS" BASIS,
+//	WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//	See the License for the specific language governing permissions and
+//	limitations under the License.
+//
+//*****************************************************************************
+
+
+
+// Startup phase timings over a file corpus, the Linux counterpart of FFmpegInteropMSS::GetStartupTimings
+// for CI. Each file goes through the same FFmpeg calls the library makes on startup, timed per phase from
+// the start like StartupTimings. Needs the FFmpeg development packages:
+//   g++ -std=c++14 -O2 -I. StartupBenchmark.cpp $(pkg-config --cflags --libs libavformat libavcodec libavutil) -o StartupBenchmark
+//   ./StartupBenchmark corpus/*.mp4
+// Prints one CSV line per file and the median, p95 and max of each phase in milliseconds. Phases that
+// don't apply, e.g. audio phases of a file without audio, are left empty and out of the summary.
+
+#include "pch.h"
+#include <stdio.h>
+#include <vector>
+
+extern "C"
+{
+#include <libavformat/avformat.h>
+#include <libavcodec/avcodec.h>
+#include <libavutil/time.h>
+}
+
+// The phases of StartupTimings that don't depend on the MediaStreamSource
+enum StartupPhase
+{
+	OpenInput,
+	FindStreamInfo,
+	OpenAudioDecoder,
+	OpenVideoDecoder,
+	FirstAudioSample,
+	FirstVideoSample,
+	PhaseCount
+};
+
+static const char* PhaseNames[PhaseCount] = { "OpenInput", "FindStreamInfo", "OpenAudioDecoder", "OpenVideoDecoder", "FirstAudioSample", "FirstVideoSample" };
+
+static AVCodecContext* OpenDecoder(AVFormatContext* avFormatCtx, int streamIndex)
+{
+	AVCodec* avCodec = avcodec_find_decoder(avFormatCtx->streams[streamIndex]->codecpar->codec_id);
+	AVCodecContext* avCodecCtx = avCodec != nullptr ? avcodec_alloc_context3(avCodec) : nullptr;
+	if (avCodecCtx != nullptr
+		&& (avcodec_parameters_to_context(avCodecCtx, avFormatCtx->streams[streamIndex]->codecpar) < 0 || avcodec_open2(avCodecCtx, avCodec, NULL) < 0))
+	{
+		avcodec_free_context(&avCodecCtx);
+	}
+	return avCodecCtx;
+}
+
+// Returns the time of each phase in microseconds since the start, -1 for phases not reached
+static std::vector<int64_t> MeasureStartup(const char* path)
+{
+	std::vector<int64_t> times(PhaseCount, -1);
+	int64_t start = av_gettime_relative();
+	auto stamp = [&times, start](StartupPhase phase)
+	{
+		times[phase] = av_gettime_relative() - start;
+	};
+
+	AVFormatContext* avFormatCtx = nullptr;
+	if (avformat_open_input(&avFormatCtx, path, NULL, NULL) < 0)
+	{
+		return times;
+	}
+	stamp(OpenInput);
+
+	if (avformat_find_stream_info(avFormatCtx, NULL) < 0)
+	{
+		avformat_close_input(&avFormatCtx);
+		return times;
+	}
+	stamp(FindStreamInfo);
+
+	int audioStreamIndex = av_find_best_stream(avFormatCtx, AVMEDIA_TYPE_AUDIO, -1, -1, NULL, 0);
+	int videoStreamIndex = av_find_best_stream(avFormatCtx, AVMEDIA_TYPE_VIDEO, -1, -1, NULL, 0);
+	AVCodecContext* audioCodecCtx = nullptr;
+	AVCodecContext* videoCodecCtx = nullptr;
+	if (audioStreamIndex >= 0 && (audioCodecCtx = OpenDecoder(avFormatCtx, audioStreamIndex)) != nullptr)
+	{
+		stamp(OpenAudioDecoder);
+	}
+	if (videoStreamIndex >= 0 && (videoCodecCtx = OpenDecoder(avFormatCtx, videoStreamIndex)) != nullptr)
+	{
+		stamp(OpenVideoDecoder);
+	}
+
+	// Reads until both streams delivered their first frame
+	AVFrame* avFrame = av_frame_alloc();
+	AVPacket avPacket;
+	while ((audioCodecCtx != nullptr && times[FirstAudioSample] < 0) || (videoCodecCtx != nullptr && times[FirstVideoSample] < 0))
+	{
+		if (av_read_frame(avFormatCtx, &avPacket) < 0)
+		{
+			break;
+		}
+
+		AVCodecContext* avCodecCtx = avPacket.stream_index == audioStreamIndex ? audioCodecCtx : avPacket.stream_index == videoStreamIndex ? videoCodecCtx : nullptr;
+		StartupPhase phase = avPacket.stream_index == audioStreamIndex ? FirstAudioSample : FirstVideoSample;
+		if (avCodecCtx != nullptr && times[phase] < 0 && avcodec_send_packet(avCodecCtx, &avPacket) >= 0 && avcodec_receive_frame(avCodecCtx, avFrame) >= 0)
+		{
+			stamp(phase);
+			av_frame_unref(avFrame);
+		}
+		av_packet_unref(&avPacket);
+	}
+
+	av_frame_free(&avFrame);
+	avcodec_free_context(&audioCodecCtx);
+	avcodec_free_context(&videoCodecCtx);
+	avformat_close_input(&avFormatCtx);
+	return times;
+}
+
+int main(int argc, char** argv)
+{
+	if (argc < 2)
+	{
+		printf("usage: StartupBenchmark <media file>...\n");
+		return 1;
+	}
+
+#if LIBAVFORMAT_VERSION_MAJOR < 58
+	av_register_all();
+#endif
+	avformat_network_init();
+
+	printf("file");
+	for (int phase = 0; phase < PhaseCount; phase++)
+	{
+		printf(",%s", PhaseNames[phase]);
+	}
+	printf("\n");
+
+	std::vector<int64_t> phaseTimes[PhaseCount];
+	int failedFiles = 0;
+	for (int i = 1; i < argc; i++)
+	{
+		std::vector<int64_t> times = MeasureStartup(argv[i]);
+		failedFiles += times[FindStreamInfo] < 0 ? 1 : 0;
+
+		printf("%s", argv[i]);
+		for (int phase = 0; phase < PhaseCount; phase++)
+		{
+			if (times[phase] >= 0)
+			{
+				printf(",%.2f", times[phase] / 1000.0);
+				phaseTimes[phase].push_back(times[phase]);
+			}
+			else
+			{
+				printf(",");
+			}
+		}
+		printf("\n");
+	}
+
+	printf("\n");
+	for (int phase = 0; phase < PhaseCount; phase++)
+	{
+		std::vector<int64_t>& sorted = phaseTimes[phase];
+		if (sorted.empty())
+		{
+			continue;
+		}
+		std::sort(sorted.begin(), sorted.end());
+		printf("%-18s median %8.2f ms, p95 %8.2f ms, max %8.2f ms (%u files)\n", PhaseNames[phase],
+			sorted[(sorted.size() - 1) / 2] / 1000.0, sorted[(size_t)(0.95 * (sorted.size() - 1))] / 1000.0, sorted.back() / 1000.0, (unsigned int)sorted.size());
+	}
+
+	avformat_network_deinit();
+	// Files that can't be opened fail the run, so a broken corpus doesn't pass unnoticed in CI
+	return failedFiles == 0 ? 0 : 1;
+}
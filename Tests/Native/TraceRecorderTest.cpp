@@ -0,0 +1,226 @@
+//*****************************************************************************
+//
+//	Copyright 2017 Microsoft Corporation
+//
+//	Licensed under the Apache License, Version 2.0 (the "License");
+//	you may not use this file except in compliance with the License.
+//	You may obtain a copy of the License at
+//
+//	http ://www.apache.org/licenses/LICENSE-2.0
+//
+//	Unless required by applicable law or agreed to in writing, software
+//	distributed under the License is distributed on an "AS IS" BASIS,
+//	WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//	See the License for the specific language governing permissions and
+//	limitations under the License.
+//
+//*****************************************************************************
+
+
+
+// Tests of the portable TraceRecorder, built together with its source:
+//   cl /EHsc /I. /I..\..\FFmpegInterop\Source TraceRecorderTest.cpp ..\..\FFmpegInterop\Source\TraceRecorder.cpp
+//   g++ -std=c++14 -pthread -I. -I../../FFmpegInterop/Source TraceRecorderTest.cpp ../../FFmpegInterop/Source/TraceRecorder.cpp
+
+#include "pch.h"
+#include "TraceRecorder.h"
+#include <set>
+#include <stdio.h>
+#include <stdlib.h>
+#include <thread>
+
+using namespace FFmpegInterop;
+
+static int failures = 0;
+
+#define CHECK(condition) \
+	if (!(condition)) \
+	{ \
+		printf("%s(%d): %s failed\n", __FILE__, __LINE__, #condition); \
+		failures++; \
+	}
+
+static size_t CountOccurrences(const std::string& text, const std::string& pattern)
+{
+	size_t count = 0;
+	for (size_t pos = text.find(pattern); pos != std::string::npos; pos = text.find(pattern, pos + pattern.size()))
+	{
+		count++;
+	}
+	return count;
+}
+
+static size_t CountEvents(const std::string& json)
+{
+	return CountOccurrences(json, "\"ph\":\"X\"");
+}
+
+// Thread ids of all events in the export
+static std::set<int> GetThreadIds(const std::string& json)
+{
+	std::set<int> threadIds;
+	const std::string key = "\"tid\":";
+	for (size_t pos = json.find(key); pos != std::string::npos; pos = json.find(key, pos + key.size()))
+	{
+		threadIds.insert(atoi(json.c_str() + pos + key.size()));
+	}
+	return threadIds;
+}
+
+static void RecordSpans(unsigned int category, const char* name, int count)
+{
+	for (int i = 0; i < count; i++)
+	{
+		TraceSpan span(category, name);
+	}
+}
+
+// Only the categories in the mask are recorded, and only between Start and Stop
+static void RecordsEnabledCategories()
+{
+	TraceRecorder& recorder = TraceRecorder::Instance();
+	recorder.Stop();
+	RecordSpans(TraceDecode, "before", 1);
+
+	recorder.Start(TraceDecode | TraceConvert);
+	CHECK(recorder.IsEnabled(TraceDecode));
+	CHECK(!recorder.IsEnabled(TraceDemux));
+	RecordSpans(TraceDecode, "decode", 2);
+	RecordSpans(TraceConvert, "convert", 1);
+	RecordSpans(TraceDemux, "demux", 1);
+	recorder.Stop();
+	RecordSpans(TraceDecode, "after", 1);
+
+	std::string json = recorder.ExportChromeTrace();
+	CHECK(CountEvents(json) == 3);
+	CHECK(CountOccurrences(json, "\"name\":\"decode\",\"cat\":\"decode\"") == 2);
+	CHECK(CountOccurrences(json, "\"name\":\"convert\",\"cat\":\"convert\"") == 1);
+	CHECK(json.find("demux") == std::string::npos);
+	CHECK(json.find("before") == std::string::npos);
+	CHECK(json.find("after") == std::string::npos);
+}
+
+// A new recording discards the events of the last one
+static void StartDiscardsEarlierEvents()
+{
+	TraceRecorder& recorder = TraceRecorder::Instance();
+	recorder.Start(TraceDecode);
+	RecordSpans(TraceDecode, "first", 3);
+	recorder.Start(TraceDecode);
+	RecordSpans(TraceDecode, "second", 1);
+	recorder.Stop();
+
+	std::string json = recorder.ExportChromeTrace();
+	CHECK(CountEvents(json) == 1);
+	CHECK(json.find("first") == std::string::npos);
+	CHECK(json.find("second") != std::string::npos);
+}
+
+// Timestamps are relative to Start, both in microseconds with the nanoseconds as fraction
+static void ExportsCompleteEvents()
+{
+	TraceRecorder& recorder = TraceRecorder::Instance();
+	recorder.Start(TraceSeek);
+	int64_t now = TraceRecorder::Now();
+	recorder.Record(TraceSeek, "seek", now + 1000000, now + 1002500);
+	recorder.Stop();
+
+	std::string json = recorder.ExportChromeTrace();
+	CHECK(json.compare(0, 16, "{\"traceEvents\":[") == 0);
+	CHECK(json.compare(json.size() - 2, 2, "]}") == 0);
+	CHECK(json.find("\"name\":\"seek\",\"cat\":\"seek\",\"ph\":\"X\",\"pid\":1") != std::string::npos);
+	CHECK(json.find("\"dur\":2.500}") != std::string::npos);
+
+	size_t ts = json.find("\"ts\":");
+	CHECK(ts != std::string::npos);
+	double start = atof(json.c_str() + ts + 5);
+	CHECK(start >= 1000.0 && start < 1000.0 + 1000000.0);
+}
+
+// Spans compiled out above FFMPEGINTEROP_TRACE_LEVEL record nothing, even when their category is enabled
+static void VerboseSpansAreCompiledOut()
+{
+	TraceRecorder& recorder = TraceRecorder::Instance();
+	recorder.Start(TraceDecode);
+	{
+		TRACE_SPAN(TraceDecode, "span");
+	}
+	{
+		TRACE_SPAN_VERBOSE(TraceDecode, "verbose");
+	}
+	recorder.Stop();
+
+	std::string json = recorder.ExportChromeTrace();
+	CHECK(json.find("\"span\"") != std::string::npos);
+	CHECK((json.find("\"verbose\"") != std::string::npos) == (FFMPEGINTEROP_TRACE_LEVEL >= 2));
+}
+
+// Every thread records into its own buffer without a lock, spanning several chunks
+static void RecordsFromManyThreads()
+{
+	const int threadCount = 4;
+	const int spansPerThread = 1000;
+
+	TraceRecorder& recorder = TraceRecorder::Instance();
+	recorder.Start(TraceDecode);
+	std::thread threads[threadCount];
+	for (auto& thread : threads)
+	{
+		thread = std::thread(RecordSpans, TraceDecode, "thread", spansPerThread);
+	}
+	for (auto& thread : threads)
+	{
+		thread.join();
+	}
+
+	// Threads that exited before the export keep their events for it
+	std::string json = recorder.ExportChromeTrace();
+	CHECK(CountEvents(json) == threadCount * spansPerThread);
+	CHECK(GetThreadIds(json).size() == threadCount);
+
+	// Exporting while threads record sees a consistent prefix of each buffer
+	std::thread writer(RecordSpans, TraceDecode, "writer", spansPerThread * 10);
+	size_t lastCount = 0;
+	for (int i = 0; i < 20; i++)
+	{
+		size_t count = CountEvents(recorder.ExportChromeTrace());
+		CHECK(count >= lastCount);
+		lastCount = count;
+	}
+	writer.join();
+	recorder.Stop();
+	CHECK(CountEvents(recorder.ExportChromeTrace()) == threadCount * spansPerThread + spansPerThread * 10);
+
+	// The next recording frees the buffers of the exited threads
+	recorder.Start(TraceDecode);
+	RecordSpans(TraceDecode, "main", 1);
+	recorder.Stop();
+	json = recorder.ExportChromeTrace();
+	CHECK(CountEvents(json) == 1);
+	CHECK(GetThreadIds(json).size() == 1);
+}
+
+// A thread keeps at most EventsPerChunk * ChunksPerThread events per recording and drops the rest
+static void DropsEventsBeyondTheBufferSize()
+{
+	TraceRecorder& recorder = TraceRecorder::Instance();
+	recorder.Start(TraceSample);
+	std::thread thread(RecordSpans, TraceSample, "sample", 256 * 256 + 100);
+	thread.join();
+	recorder.Stop();
+
+	CHECK(CountEvents(recorder.ExportChromeTrace()) == 256 * 256);
+}
+
+int main()
+{
+	RecordsEnabledCategories();
+	StartDiscardsEarlierEvents();
+	ExportsCompleteEvents();
+	VerboseSpansAreCompiledOut();
+	RecordsFromManyThreads();
+	DropsEventsBeyondTheBufferSize();
+
+	printf(failures == 0 ? "passed\n" : "%d checks failed\n", failures);
+	return failures == 0 ? 0 : 1;
+}